@@ -259,7 +259,7 @@ static int cls_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist *o
   map<string, bufferlist>::iterator iter = keys.begin();
 
   size_t i;
-  bool removed = false;
+  map<string, bufferlist>::iterator last = keys.end();
   for (i = 0; i < max_entries && iter != keys.end(); ++i, ++iter) {
     const string& index = iter->first;
 
@@ -268,19 +268,24 @@ static int cls_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist *o
     if (index.compare(0, to_index.size(), to_index) > 0)
       break;
 
-    CLS_LOG(20, "removing key: index=%s", index.c_str());
-
-    int rc = cls_cxx_map_remove_key(hctx, index);
-    if (rc < 0) {
-      CLS_LOG(1, "ERROR: cls_cxx_map_remove_key failed rc=%d", rc);
-      return -EINVAL;
-    }
-    removed = true;
+    last = iter;
   }
 
-  if (!removed)
+  if (last == keys.end())
     return -ENODATA;
 
+  /* the listed keys are contiguous, remove them with a single range op */
+  string end_index = last->first;
+  end_index.push_back('\0');
+
+  CLS_LOG(20, "removing keys: [%s, %s]", keys.begin()->first.c_str(), last->first.c_str());
+
+  rc = cls_cxx_map_remove_range(hctx, keys.begin()->first, end_index);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: cls_cxx_map_remove_range failed rc=%d", rc);
+    return -EINVAL;
+  }
+
   return 0;
 }
 
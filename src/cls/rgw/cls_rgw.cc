@@ -2392,13 +2392,23 @@ static int bi_log_list_trim_cb(cls_method_context_t hctx, const string& key, rgw
   return 0;
 }
 
-static int bi_log_remove_entry(cls_method_context_t hctx, rgw_bi_log_entry& entry)
+static void bi_log_entry_key(rgw_bi_log_entry& entry, string& key)
 {
-  string key;
   key = BI_PREFIX_CHAR;
   key.append(bucket_index_prefixes[BI_BUCKET_LOG_INDEX]);
   key.append(entry.id);
-  return cls_cxx_map_remove_key(hctx, key);
+}
+
+static int bi_log_remove_entries(cls_method_context_t hctx,
+                                 list<rgw_bi_log_entry>& entries)
+{
+  /* entries were listed in key order, so they make up a contiguous key
+   * range and can be removed with a single range op */
+  string first_key, last_key;
+  bi_log_entry_key(entries.front(), first_key);
+  bi_log_entry_key(entries.back(), last_key);
+  last_key.push_back('\0');
+  return cls_cxx_map_remove_range(hctx, first_key, last_key);
 }
 
 static int bi_log_list_trim_entries(cls_method_context_t hctx,
@@ -2436,14 +2446,9 @@ static int rgw_bi_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist
   if (entries.empty())
     return -ENODATA;
 
-  list<rgw_bi_log_entry>::iterator iter;
-  for (iter = entries.begin(); iter != entries.end(); ++iter) {
-    rgw_bi_log_entry& entry = *iter;
-
-    ret = bi_log_remove_entry(hctx, entry);
-    if (ret < 0)
-      return ret;
-  }
+  ret = bi_log_remove_entries(hctx, entries);
+  if (ret < 0)
+    return ret;
 
   return 0;
 }
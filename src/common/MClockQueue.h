@@ -0,0 +1,340 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef MCLOCK_QUEUE_H
+#define MCLOCK_QUEUE_H
+
+#include "common/OpQueue.h"
+#include "common/Clock.h"
+#include "include/assert.h"
+
+#include <map>
+#include <list>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+/**
+ * Tag based (mClock style) scheduler for normal items
+ *
+ * Every item belongs to a scheduling class chosen by a Classifier (e.g.
+ * client io, recovery, scrub) which carries three parameters:
+ *
+ *  - reservation: ops/sec each sender of the class is guaranteed
+ *  - weight: share of the remaining capacity
+ *  - limit: ops/sec above which a sender only runs if nobody else can
+ *
+ * Tags are kept per (class, sender) so that one busy sender cannot use up
+ * the reservation of the others in its class. The head item of each sender
+ * is tagged with
+ *
+ *   R = max(prev R + 1/reservation, arrival)
+ *   P = max(prev P + 1/weight, arrival)
+ *   L = max(prev L + 1/limit, arrival)
+ *
+ * On dequeue the sender with the smallest R <= now is served first; if
+ * there is none, the one with the smallest P among those with L <= now.
+ * Items served by weight do not advance R, so they do not count against
+ * the reservation. Unlike mClock proper the queue is work conserving: if
+ * every sender is over its limit the smallest P is still served.
+ *
+ * Strict items bypass the tags and are served highest priority first, as
+ * with PrioritizedQueue.
+ */
+template <typename T, typename K>
+class MClockQueue : public OpQueue<T, K> {
+public:
+  struct ClientInfo {
+    double reservation;  ///< ops/sec, 0 for none
+    double weight;       ///< relative share, must be > 0
+    double limit;        ///< ops/sec, 0 for none
+    ClientInfo(double r = 0, double w = 1, double l = 0)
+      : reservation(r), weight(w), limit(l) {}
+  };
+
+  /// maps an item to its scheduling class and the class to its parameters
+  struct Classifier {
+    virtual unsigned get_class(const K &cl, const T &item) = 0;
+    virtual ClientInfo get_info(unsigned c) = 0;
+    virtual ~Classifier() {}
+  };
+
+  typedef double (*clock_func_t)();
+
+  static double default_clock() {
+    return (double)ceph_clock_now(NULL);
+  }
+
+private:
+  typedef std::pair<unsigned, K> Key;
+
+  struct Entry {
+    T item;
+    double arrival;
+    Entry(T i, double a) : item(i), arrival(a) {}
+  };
+
+  struct Client {
+    ClientInfo info;
+    std::deque<Entry> q;
+    double prev_r, prev_p, prev_l;
+    double r, p, l;   ///< tags of q.front(), valid if tagged
+    bool tagged;
+    Client() : prev_r(0), prev_p(0), prev_l(0), r(0), p(0), l(0),
+	       tagged(false) {}
+
+    void tag() {
+      if (tagged)
+	return;
+      double arrival = q.front().arrival;
+      if (info.reservation > 0)
+	r = std::max(prev_r + 1.0 / info.reservation, arrival);
+      else
+	r = std::numeric_limits<double>::max();
+      p = std::max(prev_p + 1.0 / info.weight, arrival);
+      if (info.limit > 0)
+	l = std::max(prev_l + 1.0 / info.limit, arrival);
+      else
+	l = 0;
+      tagged = true;
+    }
+    T pop(bool by_reservation) {
+      assert(tagged);
+      T ret = q.front().item;
+      q.pop_front();
+      if (by_reservation)
+	prev_r = r;
+      prev_p = p;
+      prev_l = l;
+      tagged = false;
+      return ret;
+    }
+  };
+  typedef std::map<Key, Client> Clients;
+
+  typedef std::list<std::pair<K, T> > StrictList;
+  typedef std::map<unsigned, StrictList> StrictQueues;
+
+  Classifier *classifier;
+  clock_func_t clock;
+  Clients clients;
+  StrictQueues high_queue;
+  unsigned size;
+  uint64_t served_by_reservation, served_by_weight;
+
+  Client *get_client(const K &cl, const T &item) {
+    unsigned c = classifier->get_class(cl, item);
+    typename Clients::iterator i = clients.find(Key(c, cl));
+    if (i == clients.end()) {
+      i = clients.insert(std::make_pair(Key(c, cl), Client())).first;
+      i->second.info = classifier->get_info(c);
+      if (i->second.info.weight <= 0)
+	i->second.info.weight = 1;
+    }
+    return &i->second;
+  }
+
+  template <class F>
+  void filter_clients(F f, std::list<T> *out) {
+    for (typename Clients::iterator i = clients.begin();
+	 i != clients.end();
+	 ) {
+      std::deque<Entry> &q = i->second.q;
+      for (typename std::deque<Entry>::iterator j = q.begin();
+	   j != q.end();
+	   ) {
+	if (f(i->first.second, j->item)) {
+	  if (j == q.begin())
+	    i->second.tagged = false;
+	  if (out)
+	    out->push_back(j->item);
+	  j = q.erase(j);
+	  --size;
+	} else {
+	  ++j;
+	}
+      }
+      if (q.empty())
+	clients.erase(i++);
+      else
+	++i;
+    }
+  }
+
+  template <class F>
+  void filter_strict(F f, std::list<T> *out) {
+    for (typename StrictQueues::iterator i = high_queue.begin();
+	 i != high_queue.end();
+	 ) {
+      for (typename StrictList::iterator j = i->second.begin();
+	   j != i->second.end();
+	   ) {
+	if (f(j->first, j->second)) {
+	  if (out)
+	    out->push_back(j->second);
+	  i->second.erase(j++);
+	  --size;
+	} else {
+	  ++j;
+	}
+      }
+      if (i->second.empty())
+	high_queue.erase(i++);
+      else
+	++i;
+    }
+  }
+
+  struct ItemFilter {
+    typename OpQueue<T, K>::Filter *f;
+    ItemFilter(typename OpQueue<T, K>::Filter *f) : f(f) {}
+    bool operator()(const K &k, const T &item) const {
+      return (*f)(item);
+    }
+  };
+  struct ClassFilter {
+    K k;
+    ClassFilter(K k) : k(k) {}
+    bool operator()(const K &cl, const T &item) const {
+      return cl == k;
+    }
+  };
+
+public:
+  MClockQueue(Classifier *c, clock_func_t clk = &default_clock)
+    : classifier(c), clock(clk), size(0),
+      served_by_reservation(0), served_by_weight(0) {}
+
+  unsigned length() const {
+    return size;
+  }
+
+  bool empty() const {
+    return size == 0;
+  }
+
+  void remove_by_filter(typename OpQueue<T, K>::Filter &f,
+			std::list<T> *removed = 0) {
+    // strict items are dequeued first, so report them first
+    std::list<T> strict;
+    filter_strict(ItemFilter(&f), removed ? &strict : 0);
+    filter_clients(ItemFilter(&f), removed);
+    if (removed)
+      removed->splice(removed->begin(), strict);
+  }
+
+  void remove_by_class(K k, std::list<T> *out = 0) {
+    std::list<T> strict;
+    filter_strict(ClassFilter(k), out ? &strict : 0);
+    filter_clients(ClassFilter(k), out);
+    if (out)
+      out->splice(out->begin(), strict);
+  }
+
+  void enqueue_strict(K cl, unsigned priority, T item) {
+    high_queue[priority].push_back(std::make_pair(cl, item));
+    ++size;
+  }
+
+  void enqueue_strict_front(K cl, unsigned priority, T item) {
+    high_queue[priority].push_front(std::make_pair(cl, item));
+    ++size;
+  }
+
+  void enqueue(K cl, unsigned priority, unsigned cost, T item) {
+    get_client(cl, item)->q.push_back(Entry(item, clock()));
+    ++size;
+  }
+
+  void enqueue_front(K cl, unsigned priority, unsigned cost, T item) {
+    // requeued items keep their place ahead of the sender's other items
+    Client *c = get_client(cl, item);
+    double arrival = c->q.empty() ? clock() : c->q.front().arrival;
+    c->q.push_front(Entry(item, arrival));
+    c->tagged = false;
+    ++size;
+  }
+
+  T dequeue() {
+    assert(!empty());
+
+    if (!high_queue.empty()) {
+      T ret = high_queue.rbegin()->second.front().second;
+      high_queue.rbegin()->second.pop_front();
+      if (high_queue.rbegin()->second.empty())
+	high_queue.erase(high_queue.rbegin()->first);
+      --size;
+      return ret;
+    }
+
+    double now = clock();
+    typename Clients::iterator best = clients.end();
+    typename Clients::iterator best_p = clients.end();
+    typename Clients::iterator best_any = clients.end();
+    for (typename Clients::iterator i = clients.begin();
+	 i != clients.end();
+	 ++i) {
+      Client &c = i->second;
+      assert(!c.q.empty());
+      c.tag();
+      if (c.r <= now && (best == clients.end() || c.r < best->second.r))
+	best = i;
+      if (c.l <= now && (best_p == clients.end() || c.p < best_p->second.p))
+	best_p = i;
+      if (best_any == clients.end() || c.p < best_any->second.p)
+	best_any = i;
+    }
+
+    bool by_reservation = true;
+    if (best == clients.end()) {
+      by_reservation = false;
+      best = best_p != clients.end() ? best_p : best_any;
+    }
+    assert(best != clients.end());
+    if (by_reservation)
+      ++served_by_reservation;
+    else
+      ++served_by_weight;
+
+    T ret = best->second.pop(by_reservation);
+    if (best->second.q.empty())
+      clients.erase(best);
+    --size;
+    return ret;
+  }
+
+  void dump(Formatter *f) const {
+    f->dump_int("size", size);
+    f->dump_int("num_clients", clients.size());
+    f->dump_unsigned("served_by_reservation", served_by_reservation);
+    f->dump_unsigned("served_by_weight", served_by_weight);
+    f->open_array_section("high_queues");
+    for (typename StrictQueues::const_iterator p = high_queue.begin();
+	 p != high_queue.end();
+	 ++p) {
+      f->open_object_section("subqueue");
+      f->dump_int("priority", p->first);
+      f->dump_int("size", p->second.size());
+      f->close_section();
+    }
+    f->close_section();
+    f->open_array_section("clients");
+    for (typename Clients::const_iterator p = clients.begin();
+	 p != clients.end();
+	 ++p) {
+      f->open_object_section("client");
+      f->dump_int("class", p->first.first);
+      f->dump_int("size", p->second.q.size());
+      if (p->second.tagged) {
+	f->dump_float("r_tag", p->second.r);
+	f->dump_float("p_tag", p->second.p);
+	f->dump_float("l_tag", p->second.l);
+      }
+      f->close_section();
+    }
+    f->close_section();
+  }
+};
+
+#endif
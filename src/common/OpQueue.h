@@ -0,0 +1,50 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef OP_QUEUE_H
+#define OP_QUEUE_H
+
+#include "common/Formatter.h"
+
+#include <list>
+
+/**
+ * Abstract scheduler for the items of an op queue.
+ *
+ * Items of type T are queued on behalf of a class of type K (e.g. the
+ * entity_inst_t of the sender). Strict items are always dequeued before
+ * normal ones, highest priority first; how normal items are ordered is up
+ * to the implementation.
+ */
+template <typename T, typename K>
+class OpQueue {
+public:
+  /// predicate for remove_by_filter()
+  struct Filter {
+    virtual bool operator()(const T &item) = 0;
+    virtual ~Filter() {}
+  };
+
+  virtual unsigned length() const = 0;
+  virtual bool empty() const = 0;
+
+  /// remove all items matching f, appending them in queue order to removed
+  virtual void remove_by_filter(Filter &f, std::list<T> *removed = 0) = 0;
+  /// remove all items queued by class k, appending them in queue order to out
+  virtual void remove_by_class(K k, std::list<T> *out = 0) = 0;
+
+  virtual void enqueue_strict(K cl, unsigned priority, T item) = 0;
+  virtual void enqueue_strict_front(K cl, unsigned priority, T item) = 0;
+  virtual void enqueue(K cl, unsigned priority, unsigned cost, T item) = 0;
+  virtual void enqueue_front(K cl, unsigned priority, unsigned cost,
+			     T item) = 0;
+
+  /// return the next item; the queue must not be empty
+  virtual T dequeue() = 0;
+
+  virtual void dump(Formatter *f) const = 0;
+
+  virtual ~OpQueue() {}
+};
+
+#endif
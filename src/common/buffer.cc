@@ -502,6 +502,100 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
     }
   };
 
+  class buffer::page_pool {
+  public:
+    static const int NUM_CLASSES = 11;  // one page to 1024 pages
+
+  private:
+    atomic_t nref;
+    simple_spinlock_t lock;
+    vector<char*> free_bufs[NUM_CLASSES];
+    size_t max_cached, cached;
+
+    ~page_pool() {
+      for (int c = 0; c < NUM_CLASSES; ++c) {
+	for (vector<char*>::iterator p = free_bufs[c].begin();
+	     p != free_bufs[c].end();
+	     ++p)
+	  ::free(*p);
+      }
+    }
+
+  public:
+    explicit page_pool(size_t m)
+      : nref(1), lock(SIMPLE_SPINLOCK_INITIALIZER), max_cached(m), cached(0) {}
+
+    void get() {
+      nref.inc();
+    }
+    void put() {
+      if (nref.dec() == 0)
+	delete this;
+    }
+
+    static size_t class_size(int c) {
+      return (size_t)CEPH_PAGE_SIZE << c;
+    }
+    /// @return the smallest class holding len, or -1 if there is none
+    static int get_class(unsigned len) {
+      for (int c = 0; c < NUM_CLASSES; ++c) {
+	if (len <= class_size(c))
+	  return c;
+      }
+      return -1;
+    }
+
+    char *alloc(int c) {
+      char *p = NULL;
+      simple_spin_lock(&lock);
+      if (!free_bufs[c].empty()) {
+	p = free_bufs[c].back();
+	free_bufs[c].pop_back();
+	cached -= class_size(c);
+      }
+      simple_spin_unlock(&lock);
+      if (!p) {
+	int r = ::posix_memalign((void**)(void*)&p, CEPH_PAGE_SIZE,
+				 class_size(c));
+	if (r || !p)
+	  throw bad_alloc();
+      }
+      return p;
+    }
+    void release(char *p, int c) {
+      simple_spin_lock(&lock);
+      if (cached + class_size(c) <= max_cached) {
+	free_bufs[c].push_back(p);
+	cached += class_size(c);
+	p = NULL;
+      }
+      simple_spin_unlock(&lock);
+      if (p)
+	::free(p);
+    }
+  };
+
+  class buffer::raw_pooled : public buffer::raw {
+    page_pool *pool;
+    int cls;
+  public:
+    raw_pooled(unsigned l, page_pool *p, int c) : raw(l), pool(p), cls(c) {
+      data = pool->alloc(cls);
+      pool->get();
+      inc_total_alloc(len);
+      bdout << "raw_pooled " << this << " alloc " << (void *)data << " " << l << " " << buffer::get_total_alloc() << bendl;
+    }
+    ~raw_pooled() {
+      pool->release(data, cls);
+      pool->put();
+      dec_total_alloc(len);
+      bdout << "raw_pooled " << this << " free " << (void *)data << " " << buffer::get_total_alloc() << bendl;
+    }
+    raw* clone_empty() {
+      return create_page_aligned(len);
+    }
+  };
+
   class buffer::raw_unshareable : public buffer::raw {
   public:
     raw_unshareable(unsigned l) : raw(l) {
@@ -616,6 +710,18 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
   buffer::raw* buffer::create_page_aligned(unsigned len) {
     return create_aligned(len, CEPH_PAGE_SIZE);
   }
+  buffer::raw* buffer::create_page_aligned(unsigned len, page_pool *pool) {
+    int c = pool ? page_pool::get_class(len) : -1;
+    if (c < 0)
+      return create_page_aligned(len);
+    return new raw_pooled(len, pool, c);
+  }
+  buffer::page_pool *buffer::create_page_pool(size_t max_cached) {
+    return new page_pool(max_cached);
+  }
+  void buffer::put_page_pool(page_pool *pool) {
+    pool->put();
+  }
 
   buffer::raw* buffer::create_zero_copy(unsigned len, int fd, int64_t *offset) {
 #ifdef CEPH_HAVE_SPLICE
@@ -143,6 +143,9 @@ OPTION(ms_die_on_unhandled_msg, OPT_BOOL, false)
 OPTION(ms_die_on_old_message, OPT_BOOL, false)     // assert if we get a dup incoming message and shouldn't have (may be triggered by pre-541cd3c64be0dfa04e8a2df39422e0eb9541a428 code)
 OPTION(ms_die_on_skipped_message, OPT_BOOL, false)  // assert if we skip a seq (kernel client does this intentionally)
 OPTION(ms_dispatch_throttle_bytes, OPT_U64, 100 << 20)
+OPTION(ms_compress_min_size, OPT_U64, 0)  // compress front/data segments at least this big for peers that support it; 0 to disable
+OPTION(ms_compress_msg_types, OPT_STR, "osd_repop osd_sub_op MOSDPGPush MOSDECSubOpWrite MOSDECSubOpReadReply") // message types to compress, as returned by Message::get_type_name(); empty for all
+OPTION(ms_dispatch_threads, OPT_INT, 1)  // simple messenger dispatch shards; concurrent only if all dispatchers are reentrant
 OPTION(ms_bind_ipv6, OPT_BOOL, false)
 OPTION(ms_bind_port_min, OPT_INT, 6800)
 OPTION(ms_bind_port_max, OPT_INT, 7300)
@@ -160,14 +163,16 @@ OPTION(ms_inject_delay_probability, OPT_DOUBLE, 0) // range [0, 1]
 OPTION(ms_inject_internal_delays, OPT_DOUBLE, 0)   // seconds
 OPTION(ms_dump_on_send, OPT_BOOL, false)           // hexdump msg to log on send
 OPTION(ms_dump_corrupt_message_level, OPT_INT, 1)  // debug level to hexdump undecodeable messages at
-OPTION(ms_async_op_threads, OPT_INT, 2)
+OPTION(ms_async_op_threads, OPT_INT, 2)   // 0 for one worker per online core
 OPTION(ms_async_set_affinity, OPT_BOOL, true)
 // example: ms_async_affinity_cores = 0,1
 // The number of coreset is expected to equal to ms_async_op_threads, otherwise
 // extra op threads will loop ms_async_affinity_cores again.
 // If ms_async_affinity_cores is empty, all threads will be bind to current running
-// core
+// core, unless ms_async_op_threads is 0, in which case worker i is bound to core i
 OPTION(ms_async_affinity_cores, OPT_STR, "")
+OPTION(ms_async_send_batch_bytes, OPT_U64, 256 << 10) // queued messages coalesced into one sendmsg, 0 to send each on its own
+OPTION(ms_async_rx_buffer_pool_bytes, OPT_U64, 64 << 20) // per worker cache of message data buffers, 0 to disable
 
 OPTION(inject_early_sigterm, OPT_BOOL, false)
 
@@ -566,15 +571,31 @@ OPTION(osd_op_threads, OPT_INT, 2)    // 0 == no threading
 OPTION(osd_peering_wq_batch_size, OPT_U64, 20)
 OPTION(osd_op_pq_max_tokens_per_priority, OPT_U64, 4194304)
 OPTION(osd_op_pq_min_cost, OPT_U64, 65536)
+OPTION(osd_op_queue, OPT_STR, "prio") // op scheduler for the sharded op queue: prio, mclock
+// mclock reservation (ops/sec, 0 for none), weight and limit (ops/sec, 0 for
+// none) applied per sender of each class of op
+OPTION(osd_op_queue_mclock_client_op_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_client_op_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_client_op_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_osd_subop_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_osd_subop_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_osd_subop_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_recov_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_recov_wgt, OPT_DOUBLE, 10.0)
+OPTION(osd_op_queue_mclock_recov_lim, OPT_DOUBLE, 0.0)
 OPTION(osd_disk_threads, OPT_INT, 1)
 OPTION(osd_disk_thread_ioprio_class, OPT_STR, "") // rt realtime be best effort idle
 OPTION(osd_disk_thread_ioprio_priority, OPT_INT, -1) // 0-7
 OPTION(osd_recovery_threads, OPT_INT, 1)
+OPTION(osd_load_pgs_threads, OPT_INT, 4) // threads reading pg info/log at startup, <= 1 is serial
 OPTION(osd_recover_clone_overlap, OPT_BOOL, true)   // preserve clone_overlap during recovery/migration
 OPTION(osd_op_num_threads_per_shard, OPT_INT, 2)
 OPTION(osd_op_num_shards, OPT_INT, 5)
+OPTION(osd_op_shard_steal_threshold, OPT_U64, 8) // idle shard threads steal a pg from a shard with this many queued ops, 0 to disable
 
 OPTION(osd_read_eio_on_bad_digest, OPT_BOOL, true) // return EIO if object digest is bad
+OPTION(osd_fast_read, OPT_BOOL, false) // serve simple reads on quiescent pgs without the pg lock
+OPTION(osd_repop_reply_nolock, OPT_BOOL, true) // count replica acks without the pg lock until an op completes
 
 // Only use clone_overlap for recovery if there are fewer than
 // osd_recover_clone_overlap_limit entries in the overlap set
@@ -590,6 +611,9 @@ OPTION(osd_recovery_sleep, OPT_FLOAT, 0)         // seconds to sleep between rec
 OPTION(osd_snap_trim_thread_timeout, OPT_INT, 60*60*1)
 OPTION(osd_snap_trim_thread_suicide_timeout, OPT_INT, 60*60*10)
 OPTION(osd_snap_trim_sleep, OPT_FLOAT, 0)
+OPTION(osd_snap_trim_ops_per_sec, OPT_U64, 0)   // objects trimmed per second per osd (0 = unlimited)
+OPTION(osd_snap_trim_prefetch, OPT_U64, 64)   // snap mapper entries read ahead per pg while trimming
+OPTION(osd_snap_trim_batch, OPT_U64, 8)   // heads whose clones are trimmed in one transaction
 OPTION(osd_scrub_thread_timeout, OPT_INT, 60)
 OPTION(osd_scrub_thread_suicide_timeout, OPT_INT, 60)
 OPTION(osd_scrub_finalize_thread_timeout, OPT_INT, 60*10)
@@ -616,6 +640,8 @@ OPTION(osd_mon_report_interval_max, OPT_INT, 120)
 OPTION(osd_mon_report_interval_min, OPT_INT, 5)  // pg stats, failures, up_thru, boot.
 OPTION(osd_pg_stat_report_interval_max, OPT_INT, 500)  // report pg stats for any given pg at least this often
 OPTION(osd_mon_ack_timeout, OPT_INT, 30) // time out a mon if it doesn't ack stats
+OPTION(osd_mon_report_max_in_flight, OPT_INT, 2)  // unacked pg stat reports before we hold off
+OPTION(osd_pg_stat_delta, OPT_BOOL, true)  // report pg stats as deltas against the last acked ones
 OPTION(osd_default_data_pool_replay_window, OPT_INT, 45)
 OPTION(osd_preserve_trimmed_log, OPT_BOOL, false)
 OPTION(osd_auto_mark_unfound_lost, OPT_BOOL, false)
@@ -627,6 +653,8 @@ OPTION(osd_copyfrom_max_chunk, OPT_U64, 8<<20)   // max size of a COPYFROM chunk
 OPTION(osd_push_per_object_cost, OPT_U64, 1000)  // push cost per object
 OPTION(osd_max_push_cost, OPT_U64, 8<<20)  // max size of push message
 OPTION(osd_max_push_objects, OPT_U64, 10)  // max objects in single push op
+OPTION(osd_recovery_push_pipeline, OPT_INT, 4)  // chunks of one object pushed ahead of their acks
+OPTION(osd_recovery_delta, OPT_BOOL, true)  // push only the extents a peer missed when the pg log allows it
 OPTION(osd_recovery_forget_lost_objects, OPT_BOOL, false)   // off for now
 OPTION(osd_max_scrubs, OPT_INT, 1)
 OPTION(osd_scrub_begin_hour, OPT_INT, 0)
@@ -640,6 +668,9 @@ OPTION(osd_scrub_chunk_max, OPT_INT, 25)
 OPTION(osd_scrub_sleep, OPT_FLOAT, 0)   // sleep between [deep]scrub ops
 OPTION(osd_deep_scrub_interval, OPT_FLOAT, 60*60*24*7) // once a week
 OPTION(osd_deep_scrub_stride, OPT_INT, 524288)
+OPTION(osd_deep_scrub_threads, OPT_INT, 4)   // threads deep scrubbing the objects of a chunk (<= 1 scrubs inline)
+OPTION(osd_deep_scrub_bytes_per_sec, OPT_U64, 0)   // deep scrub read budget per osd (0 = unlimited)
+OPTION(osd_deep_scrub_ops_per_sec, OPT_U64, 0)   // deep scrub objects per second per osd (0 = unlimited)
 OPTION(osd_deep_scrub_update_digest_min_age, OPT_INT, 2*60*60)   // objects must be this old (seconds) before we update the whole-object digest on scrub
 OPTION(osd_scan_list_ping_tp_interval, OPT_U64, 100)
 OPTION(osd_class_dir, OPT_STR, CEPH_LIBDIR "/rados-classes") // where rados plugins are stored
@@ -681,7 +712,8 @@ OPTION(osd_target_transaction_size, OPT_INT, 30)     // to adjust various transa
 OPTION(osd_failsafe_full_ratio, OPT_FLOAT, .97) // what % full makes an OSD "full" (failsafe)
 OPTION(osd_failsafe_nearfull_ratio, OPT_FLOAT, .90) // what % full makes an OSD near full (failsafe)
 
-OPTION(osd_pg_object_context_cache_count, OPT_INT, 64)
+OPTION(osd_pg_object_context_cache_bytes, OPT_U64, 1<<20)  // per pg; 0 for no byte limit
+OPTION(osd_pg_object_context_cache_count, OPT_INT, 0)  // per pg; 0 for no count limit
 
 // determines whether PGLog::check() compares written out log to stored log
 OPTION(osd_debug_pg_log_writeout, OPT_BOOL, false)
@@ -749,6 +781,7 @@ OPTION(osd_bench_max_block_size, OPT_U64, 64 << 20) // cap the block size at 64M
 OPTION(osd_bench_duration, OPT_U32, 30) // duration of 'osd bench', capped at 30s to avoid triggering timeouts
 
 OPTION(memstore_device_bytes, OPT_U64, 1024*1024*1024)
+OPTION(memstore_page_size, OPT_U64, 64 << 10) // object data is allocated and shared in units of this
 
 OPTION(filestore_omap_backend, OPT_STR, "leveldb")
 
@@ -779,6 +812,8 @@ OPTION(filestore_debug_inject_read_err, OPT_BOOL, false)
 
 OPTION(filestore_debug_omap_check, OPT_BOOL, 0) // Expensive debugging check on sync
 OPTION(filestore_omap_header_cache_size, OPT_INT, 1024)
+OPTION(filestore_omap_header_cache_shards, OPT_INT, 8) // split header cache (and its lock) by object hash
+OPTION(filestore_omap_seq_batch, OPT_INT, 64) // header seqs reserved per DBObjectMap state write
 
 // Use omap for xattrs for attrs over
 // filestore_max_inline_xattr_size or
@@ -815,6 +850,7 @@ OPTION(filestore_fadvise, OPT_BOOL, true)
 OPTION(filestore_xfs_extsize, OPT_BOOL, true)
 
 OPTION(filestore_journal_parallel, OPT_BOOL, false)
+OPTION(filestore_sequencer_parallel_apply, OPT_BOOL, false) // apply non-overlapping ops of a sequencer concurrently
 OPTION(filestore_journal_writeahead, OPT_BOOL, false)
 OPTION(filestore_journal_trailing, OPT_BOOL, false)
 OPTION(filestore_queue_max_ops, OPT_INT, 50)
@@ -828,10 +864,13 @@ OPTION(filestore_commit_timeout, OPT_FLOAT, 600)
 OPTION(filestore_fiemap_threshold, OPT_INT, 4096)
 OPTION(filestore_merge_threshold, OPT_INT, 10)
 OPTION(filestore_split_multiple, OPT_INT, 2)
+OPTION(filestore_split_incremental, OPT_BOOL, false) // split subdirs one child at a time rather than in one go
 OPTION(filestore_update_to, OPT_INT, 1000)
 OPTION(filestore_blackhole, OPT_BOOL, false)     // drop any new transactions on the floor
 OPTION(filestore_fd_cache_size, OPT_INT, 128)    // FD lru size
 OPTION(filestore_fd_cache_shards, OPT_INT, 16)   // FD number of shards
+OPTION(filestore_fd_cache_handles, OPT_BOOL, false) // reopen evicted FDs by file handle (needs CAP_DAC_READ_SEARCH)
+OPTION(filestore_fd_cache_handle_size, OPT_INT, 65536) // file handle lru size
 OPTION(filestore_dump_file, OPT_STR, "")         // file onto which store transaction dumps
 OPTION(filestore_kill_at, OPT_INT, 0)            // inject a failure at the n'th opportunity
 OPTION(filestore_inject_stall, OPT_INT, 0)       // artificially stall for N seconds in op queue thread
@@ -840,6 +879,7 @@ OPTION(filestore_debug_verify_split, OPT_BOOL, false)
 OPTION(journal_dio, OPT_BOOL, true)
 OPTION(journal_aio, OPT_BOOL, true)
 OPTION(journal_force_aio, OPT_BOOL, false)
+OPTION(journal_aio_max_inflight, OPT_INT, 128)  // max aios submitted to the journal device at once
 
 OPTION(keyvaluestore_queue_max_ops, OPT_INT, 50)
 OPTION(keyvaluestore_queue_max_bytes, OPT_INT, 100 << 20)
@@ -850,6 +890,7 @@ OPTION(keyvaluestore_op_thread_suicide_timeout, OPT_INT, 180)
 OPTION(keyvaluestore_default_strip_size, OPT_INT, 4096) // Only affect new object
 OPTION(keyvaluestore_max_expected_write_size, OPT_U64, 1ULL << 24) // bytes
 OPTION(keyvaluestore_header_cache_size, OPT_INT, 4096)    // Header cache size
+OPTION(keyvaluestore_strip_cache_size, OPT_U64, 64 << 20) // bytes of strip data cached, 0 to disable
 OPTION(keyvaluestore_backend, OPT_STR, "leveldb")
 
 // max bytes to search ahead in journal searching for corruption
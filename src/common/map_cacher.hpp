@@ -20,6 +20,7 @@
 #include "include/memory.h"
 #include <set>
 #include <map>
+#include <vector>
 #include <utility>
 #include <string>
 #include <errno.h>
@@ -69,6 +70,27 @@ public:
     pair<K, V> *next    ///< [out] first key after key
     ) = 0; ///< @return 0 on success, -ENOENT if there is no next
 
+  /// Returns up to max keys in (after, end), drivers may do it in one pass
+  virtual int get_next_range(
+    const K &after,             ///< [in] key after which to start
+    const K &end,               ///< [in] first key not to return
+    unsigned max,               ///< [in] max keys to return
+    vector<pair<K, V> > *out    ///< [out] keys in order
+    ) {
+    K pos = after;
+    while (out->size() < max) {
+      pair<K, V> next;
+      int r = get_next(pos, &next);
+      if (r == -ENOENT || (r == 0 && !(next.first < end)))
+	break;
+      if (r < 0)
+	return r;
+      pos = next.first;
+      out->push_back(next);
+    }
+    return 0;
+  } ///< @return error value, 0 on success
+
   virtual ~StoreDriver() {}
 };
 
@@ -130,6 +152,61 @@ public:
     return -EINVAL;
   } ///< @return error value, 0 on success, -ENOENT if no more entries
 
+  /**
+   * Fetch up to max key/value pairs in (after, end)
+   *
+   * Reads ahead from the store in a single pass rather than a lookup per
+   * key; in progress writes are applied on top.  Fewer than max keys means
+   * there are no more in the range.
+   */
+  int get_next_range(
+    K after,                    ///< [in] key after which to start
+    const K &end,               ///< [in] first key not to return
+    unsigned max,               ///< [in] max keys to return
+    vector<pair<K, V> > *out    ///< [out] keys in order
+    ) {
+    assert(max > 0);
+    while (true) {
+      // read the cache first: a write leaves it only once it is in the store
+      map<K, boost::optional<V> > cached;
+      pair<K, boost::optional<V> > next;
+      K pos = after;
+      while (in_progress.get_next(pos, &next) && next.first < end) {
+	cached.insert(next);
+	pos = next.first;
+      }
+
+      unsigned want = max - out->size();
+      vector<pair<K, V> > store;
+      int r = driver->get_next_range(after, end, want, &store);
+      if (r < 0)
+	return r;
+
+      // a full batch from the store says nothing about keys past its end
+      bool full = store.size() >= want;
+      map<K, boost::optional<V> > merged;
+      for (typename vector<pair<K, V> >::iterator i = store.begin();
+	   i != store.end();
+	   ++i)
+	merged[i->first] = i->second;
+      for (typename map<K, boost::optional<V> >::iterator i = cached.begin();
+	   i != cached.end() && !(full && store.back().first < i->first);
+	   ++i)
+	merged[i->first] = i->second;
+
+      for (typename map<K, boost::optional<V> >::iterator i = merged.begin();
+	   i != merged.end() && out->size() < max;
+	   ++i) {
+	if (i->second)
+	  out->push_back(make_pair(i->first, i->second.get()));
+      }
+      if (out->size() >= max || !full)
+	return 0;
+      // some of what we read was removed in progress, keep going
+      after = store.back().first;
+    }
+  } ///< @return error value, 0 on success
+
   /// Adds operation setting keys to Transaction
   void set_keys(
     const map<K, V> &keys,  ///< [in] keys/values to set
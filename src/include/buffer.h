@@ -138,6 +138,7 @@ private:
   class raw_char;
   class raw_pipe;
   class raw_unshareable; // diagnostic, unshareable char buffer
+  class raw_pooled;
 
   friend std::ostream& operator<<(std::ostream& out, const raw &r);
 
@@ -145,6 +146,17 @@ public:
   class xio_mempool;
   class xio_msg_buffer;
 
+  /*
+   * a cache of page aligned memory in power of two size classes, so that
+   * large buffers are reused rather than allocated (and faulted in) for
+   * each message.  buffers go back to the pool when their last reference
+   * goes away, from whatever thread; the pool is freed once its creator
+   * and all of its buffers are done with it.
+   */
+  class page_pool;
+  static page_pool *create_page_pool(size_t max_cached);
+  static void put_page_pool(page_pool *pool);
+
   /*
    * named constructors 
    */
@@ -156,6 +168,7 @@ public:
   static raw* create_static(unsigned len, char *buf);
   static raw* create_aligned(unsigned len, unsigned align);
   static raw* create_page_aligned(unsigned len);
+  static raw* create_page_aligned(unsigned len, page_pool *pool);
   static raw* create_zero_copy(unsigned len, int fd, int64_t *offset);
   static raw* create_unshareable(unsigned len);
 
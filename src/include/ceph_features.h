@@ -63,6 +63,9 @@
 #define CEPH_FEATURE_OSD_MIN_SIZE_RECOVERY (1ULL<<49)
 // duplicated since it was introduced at the same time as MIN_SIZE_RECOVERY
 #define CEPH_FEATURE_OSD_PROXY_FEATURES (1ULL<<49)  /* overlap w/ above */
+#define CEPH_FEATURE_OSD_DELTA_RECOVERY (1ULL<<50)
+#define CEPH_FEATURE_MON_PGSTAT_DELTA (1ULL<<51)
+#define CEPH_FEATURE_MSG_COMPRESS (1ULL<<52)
 
 #define CEPH_FEATURE_RESERVED2 (1ULL<<61)  /* slow down, we are almost out... */
 #define CEPH_FEATURE_RESERVED  (1ULL<<62)  /* DO NOT USE THIS ... last bit! */
@@ -148,6 +151,9 @@ static inline unsigned long long ceph_sanitize_features(unsigned long long f) {
 	 CEPH_FEATURE_MDS_QUOTA | \
          CEPH_FEATURE_CRUSH_V4 |	     \
          CEPH_FEATURE_OSD_MIN_SIZE_RECOVERY |		 \
+	 CEPH_FEATURE_OSD_DELTA_RECOVERY |	 \
+	 CEPH_FEATURE_MON_PGSTAT_DELTA |	 \
+	 CEPH_FEATURE_MSG_COMPRESS |	 \
 	 0ULL)
 
 #define CEPH_FEATURES_SUPPORTED_DEFAULT  CEPH_FEATURES_ALL
@@ -81,6 +81,9 @@
 /* Define to 1 if you have the `snappy' library (-lsnappy). */
 #cmakedefine HAVE_LIBSNAPPY 1
 
+/* Define if messages can be compressed with snappy */
+#cmakedefine HAVE_SNAPPY 1
+
 /* Define if you have tcmalloc */
 #cmakedefine HAVE_LIBTCMALLOC
 
@@ -19,6 +19,7 @@
 
 class MPGStatsAck : public Message {
 public:
+  /// reported (seq, epoch) per pg; (0, 0) if a delta could not be applied
   map<pg_t,pair<version_t,epoch_t> > pg_stat;
   
   MPGStatsAck() : Message(MSG_PGSTATSACK) {}
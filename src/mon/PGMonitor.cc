@@ -742,6 +742,42 @@ bool PGMonitor::pg_stats_have_changed(int from, const MPGStats *stats) const
   return false;
 }
 
+/**
+ * turn the pg_stat_delta of stats into full entries of pg_stat
+ *
+ * A delta is against the stats the osd last had acked for the pg, which
+ * is what we have pending or committed unless another report overtook
+ * it.  Deltas we have no base for are nacked with a (0, 0) ack so that
+ * the osd resends the full stats.
+ */
+void PGMonitor::expand_pg_stat_deltas(MPGStats *stats, set<pg_t> *rejected)
+{
+  for (map<pg_t,bufferlist>::iterator p = stats->pg_stat_delta.begin();
+       p != stats->pg_stat_delta.end();
+       ++p) {
+    pg_stat_t s;
+    if (pending_inc.pg_stat_updates.count(p->first))
+      s = pending_inc.pg_stat_updates[p->first];
+    else if (pg_map.pg_stat.count(p->first))
+      s = pg_map.pg_stat[p->first];
+    bool applied = false;
+    try {
+      bufferlist::iterator q = p->second.begin();
+      applied = s.apply_delta(q);
+    } catch (buffer::error& e) {
+      dout(0) << " malformed pg stat delta for " << p->first << dendl;
+    }
+    if (applied) {
+      stats->pg_stat[p->first] = s;
+    } else {
+      dout(15) << " no base for " << p->first << " delta, requesting full stats"
+	       << dendl;
+      rejected->insert(p->first);
+    }
+  }
+  stats->pg_stat_delta.clear();
+}
+
 bool PGMonitor::prepare_pg_stats(MPGStats *stats) 
 {
   dout(10) << "prepare_pg_stats " << *stats << " from " << stats->get_orig_source() << dendl;
@@ -762,6 +798,9 @@ bool PGMonitor::prepare_pg_stats(MPGStats *stats)
     stats->put();
     return false;
   }
+
+  set<pg_t> rejected;
+  expand_pg_stat_deltas(stats, &rejected);
       
   if (!pg_stats_have_changed(from, stats)) {
     dout(10) << " message contains no new osd|pg stats" << dendl;
@@ -772,6 +811,8 @@ bool PGMonitor::prepare_pg_stats(MPGStats *stats)
 	 ++p) {
       ack->pg_stat[p->first] = make_pair(p->second.reported_seq, p->second.reported_epoch);
     }
+    for (set<pg_t>::iterator p = rejected.begin(); p != rejected.end(); ++p)
+      ack->pg_stat[*p] = make_pair(0, 0);
     mon->send_reply(stats, ack);
     stats->put();
     return false;
@@ -792,6 +833,8 @@ bool PGMonitor::prepare_pg_stats(MPGStats *stats)
   // pg stats
   MPGStatsAck *ack = new MPGStatsAck;
   ack->set_tid(stats->get_tid());
+  for (set<pg_t>::iterator p = rejected.begin(); p != rejected.end(); ++p)
+    ack->pg_stat[*p] = make_pair(0, 0);
   for (map<pg_t,pg_stat_t>::iterator p = stats->pg_stat.begin();
        p != stats->pg_stat.end();
        ++p) {
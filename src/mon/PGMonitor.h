@@ -79,6 +79,7 @@ private:
 
   bool preprocess_pg_stats(MPGStats *stats);
   bool pg_stats_have_changed(int from, const MPGStats *stats) const;
+  void expand_pg_stat_deltas(MPGStats *stats, set<pg_t> *rejected);
   bool prepare_pg_stats(MPGStats *stats);
   void _updated_stats(MPGStats *req, MPGStatsAck *ack);
 
@@ -62,6 +62,14 @@ public:
    * fast dispatch; false otherwise.
    */
   virtual bool ms_can_fast_dispatch_any() const { return false; }
+  /**
+   * This function determines whether ms_dispatch() and the ms_handle_*
+   * callbacks may be called from several dispatch threads at once.
+   * Messages and events of a single Connection are still delivered in
+   * order, one at a time.
+   * @returns True if the Dispatcher is reentrant; false otherwise.
+   */
+  virtual bool ms_can_dispatch_concurrently() const { return false; }
   /**
    * Perform a "fast dispatch" on a given message. See
    * ms_can_fast_dispatch() for the requirements.
@@ -14,6 +14,9 @@ using namespace std;
 #include "global/global_context.h"
 
 #include "Message.h"
+#include "Messenger.h"
+#include "MessageCompressor.h"
+#include "common/errno.h"
 
 #include "messages/MPGStats.h"
 
@@ -176,6 +179,28 @@ using namespace std;
 
 void Message::encode(uint64_t features, int crcflags)
 {
+  MessageCompressor *compressor = NULL;
+  if (connection)
+    compressor = connection->get_messenger()->compressor;
+
+  // segments compressed for an earlier send are put back if the payload
+  // is about to be re-encoded or the new peer can't take them
+  if ((footer.flags & (CEPH_MSG_FOOTER_FRONT_COMPRESSED |
+		       CEPH_MSG_FOOTER_DATA_COMPRESSED)) &&
+      (empty_payload() || !(features & CEPH_FEATURE_MSG_COMPRESS))) {
+    if (footer.flags & CEPH_MSG_FOOTER_FRONT_COMPRESSED) {
+      if (!empty_payload())
+	set_payload(uncompressed_payload);
+      uncompressed_payload.clear();
+    }
+    if (footer.flags & CEPH_MSG_FOOTER_DATA_COMPRESSED) {
+      set_data(uncompressed_data);
+      uncompressed_data.clear();
+    }
+    footer.flags &= ~(CEPH_MSG_FOOTER_FRONT_COMPRESSED |
+		      CEPH_MSG_FOOTER_DATA_COMPRESSED);
+  }
+
   // encode and copy out of *m
   if (empty_payload()) {
     encode_payload(features);
@@ -185,6 +210,8 @@ void Message::encode(uint64_t features, int crcflags)
     if (header.compat_version == 0)
       header.compat_version = header.version;
   }
+  if (compressor)
+    compressor->compress(this, features);
   if (crcflags & MSG_CRC_HEADER)
     calc_front_crc();
 
@@ -195,7 +222,9 @@ void Message::encode(uint64_t features, int crcflags)
   if (crcflags & MSG_CRC_HEADER)
     calc_header_crc();
 
-  footer.flags = CEPH_MSG_FOOTER_COMPLETE;
+  footer.flags = CEPH_MSG_FOOTER_COMPLETE |
+    (footer.flags & (CEPH_MSG_FOOTER_FRONT_COMPRESSED |
+		     CEPH_MSG_FOOTER_DATA_COMPRESSED));
 
   if (crcflags & MSG_CRC_DATA) {
     calc_data_crc();
@@ -294,6 +323,18 @@ Message *decode_message(CephContext *cct, int crcflags,
     }
   }
 
+  if (footer.flags & (CEPH_MSG_FOOTER_FRONT_COMPRESSED |
+		      CEPH_MSG_FOOTER_DATA_COMPRESSED)) {
+    int r = MessageCompressor::decompress(
+      cct ? MessageCompressor::get(cct) : NULL, footer, front, data);
+    if (r < 0) {
+      if (cct)
+	ldout(cct, 0) << "failed to decompress message of type " << header.type
+		      << ": " << cpp_strerror(r) << dendl;
+      return 0;
+    }
+  }
+
   // make message
   Message *m = 0;
   int type = header.type;
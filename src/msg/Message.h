@@ -208,6 +208,12 @@ protected:
   bufferlist       middle;   // "middle" unaligned blob
   bufferlist       data;     // data payload (page-alignment will be preserved where possible)
 
+  // payload and data as they were before MessageCompressor replaced them,
+  // for a re-encode or a resend to a peer without compression
+  bufferlist       uncompressed_payload;
+  bufferlist       uncompressed_data;
+  friend class MessageCompressor;
+
   /* recv_stamp is set when the Messenger starts reading the
    * Message off the wire */
   utime_t recv_stamp;
@@ -0,0 +1,199 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <errno.h>
+#include "acconfig.h"
+#ifdef HAVE_SNAPPY
+#include <snappy-c.h>
+#endif
+
+#include "MessageCompressor.h"
+#include "Message.h"
+#include "include/ceph_features.h"
+#include "include/str_list.h"
+#include "common/Clock.h"
+#include "common/perf_counters.h"
+
+enum {
+  l_msgc_first = 540100,
+  l_msgc_compress,
+  l_msgc_compress_in_bytes,
+  l_msgc_compress_out_bytes,
+  l_msgc_compress_lat,
+  l_msgc_decompress,
+  l_msgc_decompress_in_bytes,
+  l_msgc_decompress_out_bytes,
+  l_msgc_decompress_lat,
+  l_msgc_last,
+};
+
+#ifdef HAVE_SNAPPY
+static int compress_bl(bufferlist &in, bufferlist *out)
+{
+  size_t len = in.length();
+  size_t olen = snappy_max_compressed_length(len);
+  bufferptr bp = buffer::create(olen);
+  if (snappy_compress(in.c_str(), len, bp.c_str(), &olen) != SNAPPY_OK)
+    return -EIO;
+  if (olen >= len)
+    return -ENOSPC;  // incompressible, not worth it
+  // copy out rather than trimming bp; the message may sit in the out/sent
+  // queue until acked and would otherwise pin the worst-case allocation
+  out->push_back(buffer::copy(bp.c_str(), olen));
+  return 0;
+}
+
+static int decompress_bl(bufferlist &in, bufferlist *out, bool page_aligned)
+{
+  size_t olen;
+  if (snappy_uncompressed_length(in.c_str(), in.length(), &olen) != SNAPPY_OK)
+    return -EIO;
+  // snappy expands by less than 22x; don't let a corrupt length make us
+  // allocate more than that
+  if (olen > (size_t)in.length() * 32)
+    return -EIO;
+  bufferptr bp = page_aligned ? buffer::create_page_aligned(olen) :
+    buffer::create(olen);
+  if (snappy_uncompress(in.c_str(), in.length(), bp.c_str(), &olen) !=
+      SNAPPY_OK)
+    return -EIO;
+  out->push_back(bp);
+  return 0;
+}
+#else
+static int compress_bl(bufferlist &in, bufferlist *out)
+{
+  return -EOPNOTSUPP;
+}
+
+static int decompress_bl(bufferlist &in, bufferlist *out, bool page_aligned)
+{
+  return -EOPNOTSUPP;
+}
+#endif
+
+uint64_t MessageCompressor::get_unsupported_features()
+{
+#ifdef HAVE_SNAPPY
+  return 0;
+#else
+  return CEPH_FEATURE_MSG_COMPRESS;
+#endif
+}
+
+MessageCompressor::MessageCompressor(CephContext *cct)
+  : cct(cct), logger(NULL)
+{
+  get_str_set(cct->_conf->ms_compress_msg_types, types);
+
+  PerfCountersBuilder b(cct, "msg_compressor", l_msgc_first, l_msgc_last);
+  b.add_u64_counter(l_msgc_compress, "compress", "Segments compressed");
+  b.add_u64_counter(l_msgc_compress_in_bytes, "compress_in_bytes",
+		    "Bytes before compression");
+  b.add_u64_counter(l_msgc_compress_out_bytes, "compress_out_bytes",
+		    "Bytes after compression");
+  b.add_time_avg(l_msgc_compress_lat, "compress_lat",
+		 "Compression latency, including incompressible segments");
+  b.add_u64_counter(l_msgc_decompress, "decompress", "Segments decompressed");
+  b.add_u64_counter(l_msgc_decompress_in_bytes, "decompress_in_bytes",
+		    "Bytes before decompression");
+  b.add_u64_counter(l_msgc_decompress_out_bytes, "decompress_out_bytes",
+		    "Bytes after decompression");
+  b.add_time_avg(l_msgc_decompress_lat, "decompress_lat",
+		 "Decompression latency");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+}
+
+MessageCompressor::~MessageCompressor()
+{
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+}
+
+bool MessageCompressor::wants(Message *m, unsigned len) const
+{
+  uint64_t min_size = cct->_conf->ms_compress_min_size;
+  if (!min_size || len < min_size)
+    return false;
+  return types.empty() || types.count(m->get_type_name());
+}
+
+void MessageCompressor::compress(Message *m, uint64_t features)
+{
+  ceph_msg_footer &footer = m->get_footer();
+  features &= ~get_unsupported_features();
+  if (!(features & CEPH_FEATURE_MSG_COMPRESS) ||
+      (footer.flags & (CEPH_MSG_FOOTER_FRONT_COMPRESSED |
+		       CEPH_MSG_FOOTER_DATA_COMPRESSED)))
+    return;
+
+  utime_t start = ceph_clock_now(cct);
+  bool tried = false;
+  if (wants(m, m->get_payload().length())) {
+    tried = true;
+    bufferlist out;
+    unsigned len = m->get_payload().length();
+    if (compress_bl(m->get_payload(), &out) == 0) {
+      logger->inc(l_msgc_compress);
+      logger->inc(l_msgc_compress_in_bytes, len);
+      logger->inc(l_msgc_compress_out_bytes, out.length());
+      m->uncompressed_payload = m->get_payload();
+      m->set_payload(out);
+      footer.flags |= CEPH_MSG_FOOTER_FRONT_COMPRESSED;
+    }
+  }
+  if (wants(m, m->get_data().length())) {
+    tried = true;
+    bufferlist out;
+    unsigned len = m->get_data().length();
+    if (compress_bl(m->get_data(), &out) == 0) {
+      logger->inc(l_msgc_compress);
+      logger->inc(l_msgc_compress_in_bytes, len);
+      logger->inc(l_msgc_compress_out_bytes, out.length());
+      m->uncompressed_data = m->get_data();
+      m->set_data(out);
+      footer.flags |= CEPH_MSG_FOOTER_DATA_COMPRESSED;
+    }
+  }
+  if (tried)
+    logger->tinc(l_msgc_compress_lat, ceph_clock_now(cct) - start);
+}
+
+int MessageCompressor::decompress(MessageCompressor *c,
+				  ceph_msg_footer &footer,
+				  bufferlist &front, bufferlist &data)
+{
+  utime_t start;
+  if (c)
+    start = ceph_clock_now(c->cct);
+  if ((footer.flags & CEPH_MSG_FOOTER_FRONT_COMPRESSED) && front.length()) {
+    bufferlist out;
+    int r = decompress_bl(front, &out, false);
+    if (r < 0)
+      return r;
+    if (c) {
+      c->logger->inc(l_msgc_decompress);
+      c->logger->inc(l_msgc_decompress_in_bytes, front.length());
+      c->logger->inc(l_msgc_decompress_out_bytes, out.length());
+    }
+    front.claim(out);
+  }
+  if ((footer.flags & CEPH_MSG_FOOTER_DATA_COMPRESSED) && data.length()) {
+    bufferlist out;
+    int r = decompress_bl(data, &out, true);
+    if (r < 0)
+      return r;
+    if (c) {
+      c->logger->inc(l_msgc_decompress);
+      c->logger->inc(l_msgc_decompress_in_bytes, data.length());
+      c->logger->inc(l_msgc_decompress_out_bytes, out.length());
+    }
+    data.claim(out);
+  }
+  footer.flags &= ~(CEPH_MSG_FOOTER_FRONT_COMPRESSED |
+		    CEPH_MSG_FOOTER_DATA_COMPRESSED);
+  if (c)
+    c->logger->tinc(l_msgc_decompress_lat, ceph_clock_now(c->cct) - start);
+  return 0;
+}
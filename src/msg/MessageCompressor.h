@@ -0,0 +1,67 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_MSG_MESSAGECOMPRESSOR_H
+#define CEPH_MSG_MESSAGECOMPRESSOR_H
+
+#include <set>
+#include <string>
+
+#include "include/types.h"
+#include "common/ceph_context.h"
+
+class Message;
+class PerfCounters;
+
+/**
+ * MessageCompressor - snappy compression of message segments on the wire
+ *
+ * Message::encode() hands each message to the compressor of its
+ * messenger's context, which compresses the front and/or data segment
+ * in place when the peer has CEPH_FEATURE_MSG_COMPRESS, the segment is
+ * at least ms_compress_min_size bytes, the message type is listed in
+ * ms_compress_msg_types (or the list is empty), and it actually shrinks.
+ * Compressed segments are marked in the footer flags and the crcs cover
+ * the compressed bytes; decode_message() undoes it on the receiving end.
+ * The message keeps its uncompressed segments so that Message::encode()
+ * can put them back for a re-encode or a peer without the feature.
+ *
+ * Without snappy (--with-snappy) nothing is compressed, and the feature
+ * is not advertised so that peers don't compress what we send.
+ */
+class MessageCompressor : public CephContext::AssociatedSingletonObject {
+  CephContext *cct;
+  PerfCounters *logger;
+  std::set<std::string> types;  ///< empty for all types
+
+  bool wants(Message *m, unsigned len) const;
+
+public:
+  explicit MessageCompressor(CephContext *cct);
+  ~MessageCompressor();
+
+  static MessageCompressor *get(CephContext *cct) {
+    MessageCompressor *c;
+    cct->lookup_or_create_singleton_object<MessageCompressor>(
+      c, "msg_compressor");
+    return c;
+  }
+
+  /// features to mask out of what we advertise
+  static uint64_t get_unsupported_features();
+
+  /// compress the segments of m for a peer with the given features
+  void compress(Message *m, uint64_t features);
+
+  /**
+   * undo compression of a received message
+   *
+   * @param c compressor to account to, may be NULL
+   * @return 0 on success, negative error code for a corrupt segment or
+   *         -EOPNOTSUPP if built without snappy
+   */
+  static int decompress(MessageCompressor *c, ceph_msg_footer &footer,
+			bufferlist &front, bufferlist &data);
+};
+
+#endif
@@ -22,6 +22,7 @@ using namespace std;
 
 #include "Message.h"
 #include "Dispatcher.h"
+#include "MessageCompressor.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "include/Context.h"
@@ -59,6 +60,7 @@ public:
    */
   CephContext *cct;
   int crcflags;
+  MessageCompressor *compressor;
 
   /**
    * A Policy describes the rules of a Connection. Is there a limit on how
@@ -92,14 +94,16 @@ public:
       : lossy(false), server(false), standby(false), resetcheck(true),
 	throttler_bytes(NULL),
 	throttler_messages(NULL),
-	features_supported(CEPH_FEATURES_SUPPORTED_DEFAULT),
+	features_supported(CEPH_FEATURES_SUPPORTED_DEFAULT &
+			   ~MessageCompressor::get_unsupported_features()),
 	features_required(0) {}
   private:
     Policy(bool l, bool s, bool st, bool r, uint64_t sup, uint64_t req)
       : lossy(l), server(s), standby(st), resetcheck(r),
 	throttler_bytes(NULL),
 	throttler_messages(NULL),
-	features_supported(sup | CEPH_FEATURES_SUPPORTED_DEFAULT),
+	features_supported((sup | CEPH_FEATURES_SUPPORTED_DEFAULT) &
+			   ~MessageCompressor::get_unsupported_features()),
 	features_required(req) {}
 
   public:
@@ -134,7 +138,8 @@ public:
       magic(0),
       socket_priority(-1),
       cct(cct_),
-      crcflags(get_default_crc_flags(cct->_conf))
+      crcflags(get_default_crc_flags(cct->_conf)),
+      compressor(MessageCompressor::get(cct_))
   {
     my_inst.name = w;
   }
@@ -524,6 +529,20 @@ public:
     return false;
   }
 
+  /**
+   * Determine whether normal dispatch may run in several threads at
+   * once, which requires every Dispatcher to be reentrant.
+   */
+  bool ms_can_dispatch_concurrently() {
+    for (list<Dispatcher*>::iterator p = dispatchers.begin();
+	 p != dispatchers.end();
+	 ++p) {
+      if (!(*p)->ms_can_dispatch_concurrently())
+	return false;
+    }
+    return true;
+  }
+
   /**
    * Deliver a single Message via "fast dispatch".
    *
@@ -20,6 +20,7 @@
 
 #include "include/Context.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
 #include "AsyncMessenger.h"
 #include "AsyncConnection.h"
 
@@ -150,7 +151,8 @@ class C_clean_handler : public EventCallback {
   }
 };
 
-static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
+static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off,
+                                 buffer::page_pool *pool)
 {
   // create a buffer to read into that matches the data alignment
   unsigned left = len;
@@ -164,7 +166,7 @@ static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
   }
   unsigned middle = left & CEPH_PAGE_MASK;
   if (middle > 0) {
-    bufferptr bp = buffer::create_page_aligned(middle);
+    bufferptr bp = buffer::create_page_aligned(middle, pool);
     data.push_back(bp);
     left -= middle;
   }
@@ -174,13 +176,16 @@ static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
   }
 }
 
-AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, EventCenter *c)
+AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, EventCenter *c,
+                                 buffer::page_pool *rx_pool)
   : Connection(cct, m), async_msgr(m), global_seq(0), connect_seq(0), peer_global_seq(0),
     out_seq(0), in_seq(0), in_seq_acked(0), state(STATE_NONE), state_after_send(0), sd(-1),
-    port(-1), lock("AsyncConnection::lock"), open_write(false), keepalive(false), recv_buf(NULL),
+    port(-1), lock("AsyncConnection::lock"), open_write(false), keepalive(false), cork_pending(false),
+    send_msgs(0), send_batches(0), send_max_batch(0), send_max_depth(0), recv_buf(NULL),
     recv_max_prefetch(MIN(msgr->cct->_conf->ms_tcp_prefetch_max_size, TCP_PREFETCH_MIN_SIZE)),
     recv_start(0), recv_end(0), got_bad_auth(false), authorizer(NULL), replacing(false),
-    is_reset_from_peer(false), once_ready(false), state_buffer(NULL), state_offset(0), net(cct), center(c)
+    is_reset_from_peer(false), once_ready(false), state_buffer(NULL), state_offset(0), net(cct), center(c),
+    rx_pool(rx_pool)
 {
   read_handler.reset(new C_handle_read(this));
   write_handler.reset(new C_handle_write(this));
@@ -327,7 +332,7 @@ int AsyncConnection::_try_send(bufferlist send_bl, bool send)
       size--;
     }
 
-    int r = do_sendmsg(msg, msglen, false);
+    int r = do_sendmsg(msg, msglen, left_pbrs > 0);
     if (r < 0)
       return r;
 
@@ -725,7 +730,7 @@ void AsyncConnection::process()
               data_blp = data_buf.begin();
             } else {
               ldout(async_msgr->cct,20) << __func__ << " allocating new rx buffer at offset " << data_off << dendl;
-              alloc_aligned_buffer(data_buf, data_len, data_off);
+              alloc_aligned_buffer(data_buf, data_len, data_off, rx_pool);
               data_blp = data_buf.begin();
             }
           }
@@ -1924,13 +1929,28 @@ int AsyncConnection::send_message(Message *m)
     m->set_priority(async_msgr->get_default_send_priority());
 
   Mutex::Locker l(lock);
-  if (!is_queued() && state >= STATE_OPEN && state <= STATE_OPEN_TAG_CLOSE) {
+  bool corking = async_msgr->cct->_conf->ms_async_send_batch_bytes &&
+                 center->get_owner() == pthread_self();
+  if (corking && sd >= 0 && state >= STATE_OPEN && state <= STATE_OPEN_TAG_CLOSE) {
+    // we are on our own worker: cork the message until the worker is done
+    // with this pass of its event loop, so that whatever else gets sent
+    // meanwhile goes out with it in one sendmsg
+    ldout(async_msgr->cct, 10) << __func__ << " cork msg " << m << dendl;
+    out_q[m->get_priority()].push_back(m);
+    async_msgr->logger->inc(l_msgr_send_corked);
+    if (!cork_pending && !open_write) {
+      cork_pending = true;
+      center->dispatch_event_external(write_handler);
+    }
+  } else if (!is_queued() && state >= STATE_OPEN && state <= STATE_OPEN_TAG_CLOSE) {
     ldout(async_msgr->cct, 10) << __func__ << " try send msg " << m << dendl;
     int r = _send(m);
     if (r < 0) {
       ldout(async_msgr->cct, 1) << __func__ << " send msg failed" << dendl;
       // we want to handle fault within internal thread
       center->dispatch_event_external(write_handler);
+    } else {
+      _account_send_batch(1);
     }
   } else if (state == STATE_CLOSED) {
     ldout(async_msgr->cct, 10) << __func__ << " connection closed."
@@ -2127,6 +2147,7 @@ void AsyncConnection::_stop()
   if (sd >= 0)
     center->delete_file_event(sd, EVENT_READABLE|EVENT_WRITABLE);
 
+  _flush_send_stats();
   discard_out_queue();
   async_msgr->unregister_conn(this);
 
@@ -2145,7 +2166,7 @@ void AsyncConnection::_stop()
   center->dispatch_event_external(EventCallbackRef(new C_clean_handler(this)));
 }
 
-int AsyncConnection::_send(Message *m)
+int AsyncConnection::_send(Message *m, bool more)
 {
   m->set_seq(++out_seq);
   if (!policy.lossy) {
@@ -2195,7 +2216,7 @@ int AsyncConnection::_send(Message *m)
 
   ldout(async_msgr->cct, 20) << __func__ << " sending " << m->get_seq()
                        << " " << m << dendl;
-  int rc = write_message(header, footer, blist);
+  int rc = write_message(header, footer, blist, more);
 
   if (rc < 0) {
     ldout(async_msgr->cct, 1) << __func__ << " error sending " << m << ", "
@@ -2211,7 +2232,7 @@ int AsyncConnection::_send(Message *m)
 }
 
 int AsyncConnection::write_message(const ceph_msg_header& header, const ceph_msg_footer& footer,
-                                  bufferlist& blist)
+                                  bufferlist& blist, bool more)
 {
   bufferlist bl;
   int ret;
@@ -2259,13 +2280,51 @@ int AsyncConnection::write_message(const ceph_msg_header& header, const ceph_msg
   }
 
   // send
-  ret = _try_send(bl);
+  ret = _try_send(bl, !more);
   if (ret < 0)
     return ret;
 
   return ret;
 }
 
+void AsyncConnection::_account_send_batch(uint64_t batch)
+{
+  ++send_batches;
+  send_msgs += batch;
+  if (batch > send_max_batch)
+    send_max_batch = batch;
+
+  PerfCounters *logger = async_msgr->logger;
+  logger->inc(l_msgr_send_batches);
+  logger->inc(l_msgr_send_msgs, batch);
+  logger->inc(l_msgr_send_batch_size, batch);
+  // connections on other workers may race with us here, which can only
+  // leave the max lower than it should be
+  if (batch > logger->get(l_msgr_send_max_batch))
+    logger->set(l_msgr_send_max_batch, batch);
+}
+
+void AsyncConnection::_account_send_queue_depth(uint64_t depth)
+{
+  if (depth > send_max_depth)
+    send_max_depth = depth;
+
+  PerfCounters *logger = async_msgr->logger;
+  logger->inc(l_msgr_send_queue_depth, depth);
+  if (depth > logger->get(l_msgr_send_max_queue_depth))
+    logger->set(l_msgr_send_max_queue_depth, depth);
+}
+
+void AsyncConnection::_flush_send_stats()
+{
+  if (!send_msgs)
+    return;
+  ldout(async_msgr->cct, 10) << __func__ << " sent " << send_msgs << " msgs in "
+                             << send_batches << " batches, max batch " << send_max_batch
+                             << ", max queue depth " << send_max_depth << dendl;
+  send_msgs = send_batches = send_max_batch = send_max_depth = 0;
+}
+
 void AsyncConnection::handle_ack(uint64_t seq)
 {
   ldout(async_msgr->cct, 15) << __func__ << " got ack seq " << seq << dendl;
@@ -2329,19 +2388,32 @@ void AsyncConnection::handle_write()
   Mutex::Locker l(lock);
   bufferlist bl;
   int r = 0;
+  cork_pending = false;
   if (state >= STATE_OPEN && state <= STATE_OPEN_TAG_CLOSE) {
     if (keepalive) {
       _send_keepalive_or_ack();
       keepalive = false;
     }
 
+    // coalesce queued messages into as few sendmsg calls as the batch
+    // budget allows; 0 sends each message on its own
+    uint64_t batch_bytes = async_msgr->cct->_conf->ms_async_send_batch_bytes;
+    _account_send_queue_depth(get_out_q_depth());
+    uint64_t batch = 0;
     while (1) {
       Message *m = _get_next_outgoing();
       if (!m)
         break;
 
       ldout(async_msgr->cct, 10) << __func__ << " try send msg " << m << dendl;
-      r = _send(m);
+      r = _send(m, true);
+      ++batch;
+      if (r >= 0 && (outcoming_bl.length() >= batch_bytes ||
+                     outcoming_bl.buffers().size() >= IOV_MAX)) {
+        r = _try_send(bl);
+        _account_send_batch(batch);
+        batch = 0;
+      }
       if (r < 0) {
         ldout(async_msgr->cct, 1) << __func__ << " send msg failed" << dendl;
         goto fail;
@@ -2349,6 +2421,10 @@ void AsyncConnection::handle_write()
         break;
       }
     }
+    if (batch) {
+      // the rest goes out below, along with the ack if there is one
+      _account_send_batch(batch);
+    }
 
     if (in_seq > in_seq_acked) {
       ceph_le64 s;
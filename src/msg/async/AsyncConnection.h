@@ -48,7 +48,8 @@ class AsyncConnection : public Connection {
   // if "send" is false, it will only append bl to send buffer
   // the main usage is avoid error happen outside messenger threads
   int _try_send(bufferlist bl, bool send=true);
-  int _send(Message *m);
+  // if "more" is true, the message is only appended to the send buffer
+  int _send(Message *m, bool more=false);
   int read_until(uint64_t needed, char *p);
   int _process_connection();
   void _connect();
@@ -63,7 +64,11 @@ class AsyncConnection : public Connection {
   int randomize_out_seq();
   void handle_ack(uint64_t seq);
   void _send_keepalive_or_ack(bool ack=false, utime_t *t=NULL);
-  int write_message(const ceph_msg_header& header, const ceph_msg_footer& footer, bufferlist& blist);
+  int write_message(const ceph_msg_header& header, const ceph_msg_footer& footer, bufferlist& blist,
+                    bool more=false);
+  void _account_send_batch(uint64_t batch);
+  void _account_send_queue_depth(uint64_t depth);
+  void _flush_send_stats();
   int _reply_accept(char tag, ceph_msg_connect &connect, ceph_msg_connect_reply &reply,
                     bufferlist authorizer_reply) {
     bufferlist reply_bl;
@@ -82,7 +87,7 @@ class AsyncConnection : public Connection {
     return 0;
   }
   bool is_queued() {
-    return !out_q.empty() || outcoming_bl.length();
+    return !out_q.empty() || outcoming_bl.length() || keepalive;
   }
   void shutdown_socket() {
     if (sd >= 0)
@@ -101,8 +106,15 @@ class AsyncConnection : public Connection {
     }
     return m;
   }
+  uint64_t get_out_q_depth() {
+    uint64_t n = 0;
+    for (map<int, list<Message*> >::iterator p = out_q.begin(); p != out_q.end(); ++p)
+      n += p->second.size();
+    return n;
+  }
  public:
-  AsyncConnection(CephContext *cct, AsyncMessenger *m, EventCenter *c);
+  AsyncConnection(CephContext *cct, AsyncMessenger *m, EventCenter *c,
+                  buffer::page_pool *rx_pool);
   ~AsyncConnection();
 
   ostream& _conn_prefix(std::ostream *_dout);
@@ -227,6 +239,13 @@ class AsyncConnection : public Connection {
   EventCallbackRef local_deliver_handler;
   EventCallbackRef wakeup_handler;
   bool keepalive;
+  bool cork_pending;       // write_handler queued to flush corked messages
+  // send side stats of this connection, logged when it is stopped; the
+  // messenger's perf counters sum them over all connections
+  uint64_t send_msgs;      // messages written
+  uint64_t send_batches;   // sendmsg batches they were coalesced into
+  uint64_t send_max_batch; // most messages in one batch
+  uint64_t send_max_depth; // deepest out_q seen when draining it
   struct iovec msgvec[IOV_MAX];
   char *recv_buf;
   uint32_t recv_max_prefetch;
@@ -268,6 +287,7 @@ class AsyncConnection : public Connection {
   bufferlist outcoming_bl;
   NetHandler net;
   EventCenter *center;
+  buffer::page_pool *rx_pool;  ///< owned by our worker, may be NULL
   ceph::shared_ptr<AuthSessionHandler> session_security;
 
  public:
@@ -17,6 +17,7 @@
 #include "acconfig.h"
 
 #include <errno.h>
+#include <unistd.h>
 #include <iostream>
 #include <fstream>
 
@@ -27,6 +28,7 @@
 #include "common/config.h"
 #include "common/Timer.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
 #include "auth/Crypto.h"
 #include "include/Spinlock.h"
 
@@ -318,8 +320,16 @@ WorkerPool::WorkerPool(CephContext *c): cct(c), seq(0), started(false),
                                         barrier_lock("WorkerPool::WorkerPool::barrier_lock"),
                                         barrier_count(0)
 {
-  assert(cct->_conf->ms_async_op_threads > 0);
-  for (int i = 0; i < cct->_conf->ms_async_op_threads; ++i) {
+  assert(cct->_conf->ms_async_op_threads >= 0);
+  int num_workers = cct->_conf->ms_async_op_threads;
+  bool per_core = num_workers == 0;
+  if (per_core) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = n > 0 ? n : 1;
+    ldout(cct, 10) << __func__ << " one worker per core, " << num_workers
+                   << " workers" << dendl;
+  }
+  for (int i = 0; i < num_workers; ++i) {
     Worker *w = new Worker(cct, this, i);
     workers.push_back(w);
   }
@@ -334,6 +344,11 @@ WorkerPool::WorkerPool(CephContext *c): cct(c), seq(0), started(false),
     else
       lderr(cct) << __func__ << " failed to parse " << *it << " in " << cct->_conf->ms_async_affinity_cores << dendl;
   }
+  if (per_core && coreids.empty()) {
+    // worker i owns core i
+    for (int i = 0; i < num_workers; ++i)
+      coreids.push_back(i);
+  }
 }
 
 WorkerPool::~WorkerPool()
@@ -386,11 +401,31 @@ AsyncMessenger::AsyncMessenger(CephContext *cct, entity_name_t name,
     lock("AsyncMessenger::lock"),
     nonce(_nonce), need_addr(true), did_bind(false),
     global_seq(0), deleted_lock("AsyncMessenger::deleted_lock"),
-    cluster_protocol(0), stopped(true)
+    cluster_protocol(0), stopped(true), logger(NULL)
 {
   ceph_spin_init(&global_seq_lock);
+
+  PerfCountersBuilder b(cct, "AsyncMessenger::" + mname, l_msgr_first,
+                        l_msgr_last);
+  b.add_u64_counter(l_msgr_send_msgs, "send_msgs", "Messages sent");
+  b.add_u64_counter(l_msgr_send_batches, "send_batches",
+                    "Batches of queued messages written together");
+  b.add_u64_avg(l_msgr_send_batch_size, "send_batch_size",
+                "Messages per batch");
+  b.add_u64(l_msgr_send_max_batch, "send_max_batch",
+            "Most messages in one batch");
+  b.add_u64_avg(l_msgr_send_queue_depth, "send_queue_depth",
+                "Connection send queue depth when drained");
+  b.add_u64(l_msgr_send_max_queue_depth, "send_max_queue_depth",
+            "Deepest connection send queue drained");
+  b.add_u64_counter(l_msgr_send_corked, "send_corked",
+                    "Messages held back to go out with the rest of an event loop pass");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+
   cct->lookup_or_create_singleton_object<WorkerPool>(pool, WorkerPool::name);
-  local_connection = new AsyncConnection(cct, this, &pool->get_worker()->center);
+  Worker *w = pool->get_worker();
+  local_connection = new AsyncConnection(cct, this, &w->center, w->rx_pool);
   init_local_connection();
 }
 
@@ -402,6 +437,8 @@ AsyncMessenger::~AsyncMessenger()
 {
   assert(!did_bind); // either we didn't bind or we shut down the Processor
   local_connection->mark_down();
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
 }
 
 void AsyncMessenger::ready()
@@ -516,7 +553,7 @@ AsyncConnectionRef AsyncMessenger::add_accept(int sd)
 {
   lock.Lock();
   Worker *w = pool->get_worker();
-  AsyncConnectionRef conn = new AsyncConnection(cct, this, &w->center);
+  AsyncConnectionRef conn = new AsyncConnection(cct, this, &w->center, w->rx_pool);
   conn->accept(sd);
   accepting_conns.insert(conn);
   lock.Unlock();
@@ -533,7 +570,7 @@ AsyncConnectionRef AsyncMessenger::create_connect(const entity_addr_t& addr, int
 
   // create connection
   Worker *w = pool->get_worker();
-  AsyncConnectionRef conn = new AsyncConnection(cct, this, &w->center);
+  AsyncConnectionRef conn = new AsyncConnection(cct, this, &w->center, w->rx_pool);
   conn->connect(addr, type);
   assert(!conns.count(addr));
   conns[addr] = conn;
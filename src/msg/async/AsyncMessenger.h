@@ -40,6 +40,19 @@ using namespace std;
 
 class AsyncMessenger;
 class WorkerPool;
+class PerfCounters;
+
+enum {
+  l_msgr_first = 94000,
+  l_msgr_send_msgs,
+  l_msgr_send_batches,
+  l_msgr_send_batch_size,
+  l_msgr_send_max_batch,
+  l_msgr_send_queue_depth,
+  l_msgr_send_max_queue_depth,
+  l_msgr_send_corked,
+  l_msgr_last,
+};
 
 class Worker : public Thread {
   static const uint64_t InitEventNumber = 5000;
@@ -51,9 +64,18 @@ class Worker : public Thread {
 
  public:
   EventCenter center;
+  /// recycled page aligned buffers for message data read on this worker
+  buffer::page_pool *rx_pool;
   Worker(CephContext *c, WorkerPool *p, int i)
-    : cct(c), pool(p), done(false), id(i), center(c) {
+    : cct(c), pool(p), done(false), id(i), center(c), rx_pool(NULL) {
     center.init(InitEventNumber);
+    if (cct->_conf->ms_async_rx_buffer_pool_bytes)
+      rx_pool = buffer::create_page_pool(
+	cct->_conf->ms_async_rx_buffer_pool_bytes);
+  }
+  ~Worker() {
+    if (rx_pool)
+      buffer::put_page_pool(rx_pool);
   }
   void *entry();
   void stop();
@@ -217,7 +239,7 @@ public:
   Connection *create_anon_connection() {
     Mutex::Locker l(lock);
     Worker *w = pool->get_worker();
-    return new AsyncConnection(cct, this, &w->center);
+    return new AsyncConnection(cct, this, &w->center, w->rx_pool);
   }
 
   /**
@@ -369,6 +391,9 @@ public:
   /// con used for sending messages to ourselves
   ConnectionRef local_connection;
 
+  /// send side stats of all our connections
+  PerfCounters *logger;
+
   /**
    * @defgroup AsyncMessenger internals
    * @{
@@ -343,6 +343,11 @@ int EventCenter::process_events(int timeout_microseconds)
       tv.tv_usec = timeout_microseconds % 1000000;
     }
   }
+  if (!local_events.empty()) {
+    // we queued work for ourselves, just poll
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+  }
 
   ldout(cct, 10) << __func__ << " wait second " << tv.tv_sec << " usec " << tv.tv_usec << dendl;
   vector<FiredFileEvent> fired_events;
@@ -375,25 +380,32 @@ int EventCenter::process_events(int timeout_microseconds)
   if (trigger_time)
     numevents += process_time_events();
 
+  // what we queued for ourselves goes ahead of the external events, so
+  // that an external event queued after it (e.g. WorkerPool::barrier())
+  // can't overtake it; whatever these queue goes to the next pass
+  deque<EventCallbackRef> cur_process;
+  cur_process.swap(local_events);
   external_lock.Lock();
-  if (external_events.empty()) {
-    external_lock.Unlock();
-  } else {
-    deque<EventCallbackRef> cur_process;
-    cur_process.swap(external_events);
-    external_lock.Unlock();
-    while (!cur_process.empty()) {
-      EventCallbackRef e = cur_process.front();
-      if (e)
-        e->do_request(0);
-      cur_process.pop_front();
-    }
+  cur_process.insert(cur_process.end(), external_events.begin(),
+                     external_events.end());
+  external_events.clear();
+  external_lock.Unlock();
+  while (!cur_process.empty()) {
+    EventCallbackRef e = cur_process.front();
+    if (e)
+      e->do_request(0);
+    cur_process.pop_front();
   }
   return numevents;
 }
 
 void EventCenter::dispatch_event_external(EventCallbackRef e)
 {
+  if (owner == pthread_self()) {
+    // a connection handing work to its own worker, no need for the pipe
+    local_events.push_back(e);
+    return;
+  }
   external_lock.Lock();
   external_events.push_back(e);
   external_lock.Unlock();
@@ -104,6 +104,7 @@ class EventCenter {
   // Used only to external event
   Mutex external_lock, file_lock, time_lock;
   deque<EventCallbackRef> external_events;
+  deque<EventCallbackRef> local_events;  ///< queued by the owner, unlocked
   FileEvent *file_events;
   EventDriver *driver;
   map<utime_t, list<TimeEvent> > time_events;
@@ -152,7 +153,7 @@ class EventCenter {
   int process_events(int timeout_microseconds);
   void wakeup();
 
-  // Used by external thread
+  // Used by external thread; from the owner it neither locks nor wakes up
   void dispatch_event_external(EventCallbackRef e);
 };
 
@@ -29,11 +29,15 @@
 #define dout_prefix *_dout << "-- " << msgr->get_myaddr() << " "
 
 double DispatchQueue::get_max_age(utime_t now) const {
-  Mutex::Locker l(lock);
-  if (marrival.empty())
-    return 0;
-  else
-    return (now - marrival.begin()->first);
+  double max_age = 0;
+  for (vector<Shard*>::const_iterator p = shards.begin();
+       p != shards.end();
+       ++p) {
+    Mutex::Locker l((*p)->lock);
+    if (!(*p)->marrival.empty())
+      max_age = MAX(max_age, now - (*p)->marrival.begin()->first);
+  }
+  return max_age;
 }
 
 uint64_t DispatchQueue::pre_dispatch(Message *m)
@@ -79,18 +83,23 @@ void DispatchQueue::fast_preprocess(Message *m)
 
 void DispatchQueue::enqueue(Message *m, int priority, uint64_t id)
 {
-
-  Mutex::Locker l(lock);
   ldout(cct,20) << "queue " << m << " prio " << priority << dendl;
-  add_arrival(m);
+  _enqueue(m, priority, id);
+}
+
+void DispatchQueue::_enqueue(Message *m, int priority, uint64_t id)
+{
+  Shard *s = get_shard(m->get_connection().get());
+  Mutex::Locker l(s->lock);
+  s->add_arrival(m);
   if (priority >= CEPH_MSG_PRIO_LOW) {
-    mqueue.enqueue_strict(
+    s->mqueue.enqueue_strict(
         id, priority, QueueItem(m));
   } else {
-    mqueue.enqueue(
+    s->mqueue.enqueue(
         id, priority, m->get_cost(), QueueItem(m));
   }
-  cond.Signal();
+  s->cond.Signal();
 }
 
 void DispatchQueue::local_delivery(Message *m, int priority)
@@ -123,22 +132,45 @@ void DispatchQueue::run_local_delivery()
     if (can_fast_dispatch(m)) {
       fast_dispatch(m);
     } else {
-      Mutex::Locker l(lock);
-      add_arrival(m);
-      if (priority >= CEPH_MSG_PRIO_LOW) {
-        mqueue.enqueue_strict(
-            0, priority, QueueItem(m));
-      } else {
-        mqueue.enqueue(
-            0, priority, m->get_cost(), QueueItem(m));
-      }
-      cond.Signal();
+      _enqueue(m, priority, 0);
     }
     local_delivery_lock.Lock();
   }
   local_delivery_lock.Unlock();
 }
 
+void DispatchQueue::deliver(QueueItem &qitem)
+{
+  if (qitem.is_code()) {
+    switch (qitem.get_code()) {
+    case D_BAD_REMOTE_RESET:
+      msgr->ms_deliver_handle_remote_reset(qitem.get_connection());
+      break;
+    case D_CONNECT:
+      msgr->ms_deliver_handle_connect(qitem.get_connection());
+      break;
+    case D_ACCEPT:
+      msgr->ms_deliver_handle_accept(qitem.get_connection());
+      break;
+    case D_BAD_RESET:
+      msgr->ms_deliver_handle_reset(qitem.get_connection());
+      break;
+    default:
+      assert(0);
+    }
+  } else {
+    Message *m = qitem.get_message();
+    if (stop) {
+      ldout(cct,10) << " stop flag set, discarding " << m << " " << *m << dendl;
+      m->put();
+    } else {
+      uint64_t msize = pre_dispatch(m);
+      msgr->ms_deliver_dispatch(m);
+      post_dispatch(m, msize);
+    }
+  }
+}
+
 /*
  * This function delivers incoming messages to the Messenger.
  * Pipes with messages are kept in queues; when beginning a message
@@ -147,84 +179,73 @@ void DispatchQueue::run_local_delivery()
  * has remaining messages at that priority level, it is re-placed on to the
  * end of the queue. If the queue is empty; it's removed.
  * The message is then delivered and the process starts again.
+ *
+ * Each shard runs this loop in its own thread; a Connection's items
+ * all land in one shard, so they are never delivered concurrently.
  */
-void DispatchQueue::entry()
+void DispatchQueue::entry(int shard)
 {
-  lock.Lock();
+  Shard *s = shards[shard];
+  s->lock.Lock();
   while (true) {
-    while (!mqueue.empty()) {
-      QueueItem qitem = mqueue.dequeue();
+    while (!s->mqueue.empty()) {
+      QueueItem qitem = s->mqueue.dequeue();
       if (!qitem.is_code())
-	remove_arrival(qitem.get_message());
-      lock.Unlock();
-
-      if (qitem.is_code()) {
-	switch (qitem.get_code()) {
-	case D_BAD_REMOTE_RESET:
-	  msgr->ms_deliver_handle_remote_reset(qitem.get_connection());
-	  break;
-	case D_CONNECT:
-	  msgr->ms_deliver_handle_connect(qitem.get_connection());
-	  break;
-	case D_ACCEPT:
-	  msgr->ms_deliver_handle_accept(qitem.get_connection());
-	  break;
-	case D_BAD_RESET:
-	  msgr->ms_deliver_handle_reset(qitem.get_connection());
-	  break;
-	default:
-	  assert(0);
-	}
+	s->remove_arrival(qitem.get_message());
+      s->lock.Unlock();
+
+      if (shards.size() > 1 && !msgr->ms_can_dispatch_concurrently()) {
+	Mutex::Locker l(dispatch_lock);
+	deliver(qitem);
       } else {
-	Message *m = qitem.get_message();
-	if (stop) {
-	  ldout(cct,10) << " stop flag set, discarding " << m << " " << *m << dendl;
-	  m->put();
-	} else {
-	  uint64_t msize = pre_dispatch(m);
-	  msgr->ms_deliver_dispatch(m);
-	  post_dispatch(m, msize);
-	}
+	deliver(qitem);
       }
 
-      lock.Lock();
+      s->lock.Lock();
     }
     if (stop)
       break;
 
     // wait for something to be put on queue
-    cond.Wait(lock);
+    s->cond.Wait(s->lock);
   }
-  lock.Unlock();
+  s->lock.Unlock();
 }
 
 void DispatchQueue::discard_queue(uint64_t id) {
-  Mutex::Locker l(lock);
-  list<QueueItem> removed;
-  mqueue.remove_by_class(id, &removed);
-  for (list<QueueItem>::iterator i = removed.begin();
-       i != removed.end();
-       ++i) {
-    assert(!(i->is_code())); // We don't discard id 0, ever!
-    Message *m = i->get_message();
-    remove_arrival(m);
-    msgr->dispatch_throttle_release(m->get_dispatch_throttle_size());
-    m->put();
+  // the pipe's messages are all in the shard of its connection, but we
+  // only know the pipe id here
+  for (vector<Shard*>::iterator p = shards.begin(); p != shards.end(); ++p) {
+    Shard *s = *p;
+    Mutex::Locker l(s->lock);
+    list<QueueItem> removed;
+    s->mqueue.remove_by_class(id, &removed);
+    for (list<QueueItem>::iterator i = removed.begin();
+	 i != removed.end();
+	 ++i) {
+      assert(!(i->is_code())); // We don't discard id 0, ever!
+      Message *m = i->get_message();
+      s->remove_arrival(m);
+      msgr->dispatch_throttle_release(m->get_dispatch_throttle_size());
+      m->put();
+    }
   }
 }
 
 void DispatchQueue::start()
 {
   assert(!stop);
-  assert(!dispatch_thread.is_started());
-  dispatch_thread.create();
+  assert(!is_started());
+  for (vector<Shard*>::iterator p = shards.begin(); p != shards.end(); ++p)
+    (*p)->dispatch_thread.create();
   local_delivery_thread.create();
 }
 
 void DispatchQueue::wait()
 {
   local_delivery_thread.join();
-  dispatch_thread.join();
+  for (vector<Shard*>::iterator p = shards.begin(); p != shards.end(); ++p)
+    (*p)->dispatch_thread.join();
 }
 
 void DispatchQueue::shutdown()
@@ -235,9 +256,10 @@ void DispatchQueue::shutdown()
   local_delivery_cond.Signal();
   local_delivery_lock.Unlock();
 
-  // stop my dispatch thread
-  lock.Lock();
-  stop = true;
-  cond.Signal();
-  lock.Unlock();
+  // stop my dispatch threads
+  for (vector<Shard*>::iterator p = shards.begin(); p != shards.end(); ++p) {
+    Mutex::Locker l((*p)->lock);
+    stop = true;
+    (*p)->cond.Signal();
+  }
 }
@@ -24,6 +24,7 @@
 #include "common/Cond.h"
 #include "common/Thread.h"
 #include "common/PrioritizedQueue.h"
+#include "include/hash.h"
 
 class CephContext;
 class DispatchQueue;
@@ -37,6 +38,12 @@ struct Connection;
  * they want to be dispatched, carefully organized by Message priority
  * and permitted to deliver in a round-robin fashion.
  * See SimpleMessenger::dispatch_entry for details.
+ *
+ * The queue is split into ms_dispatch_threads shards, each with its own
+ * lock and dispatch thread, and every Connection always maps to the same
+ * shard, so its messages and events are still delivered in order and one
+ * at a time.  Unless all Dispatchers declare that they can be called
+ * concurrently, deliveries from different shards are serialized.
  */
 class DispatchQueue {
   class QueueItem {
@@ -65,45 +72,78 @@ class DispatchQueue {
     
   CephContext *cct;
   SimpleMessenger *msgr;
-  mutable Mutex lock;
-  Cond cond;
-
-  PrioritizedQueue<QueueItem, uint64_t> mqueue;
-
-  set<pair<double, Message*> > marrival;
-  map<Message *, set<pair<double, Message*> >::iterator> marrival_map;
-  void add_arrival(Message *m) {
-    marrival_map.insert(
-      make_pair(
-	m,
-	marrival.insert(make_pair(m->get_recv_stamp(), m)).first
-	)
-      );
-  }
-  void remove_arrival(Message *m) {
-    map<Message *, set<pair<double, Message*> >::iterator>::iterator i =
-      marrival_map.find(m);
-    assert(i != marrival_map.end());
-    marrival.erase(i->second);
-    marrival_map.erase(i);
-  }
-
-  uint64_t next_pipe_id;
-    
-  enum { D_CONNECT = 1, D_ACCEPT, D_BAD_REMOTE_RESET, D_BAD_RESET, D_NUM_CODES };
 
   /**
-   * The DispatchThread runs dispatch_entry to empty out the dispatch_queue.
+   * The DispatchThread runs dispatch_entry to empty out its shard.
    */
   class DispatchThread : public Thread {
     DispatchQueue *dq;
+    int shard;
   public:
-    DispatchThread(DispatchQueue *dq) : dq(dq) {}
+    DispatchThread(DispatchQueue *dq, int shard) : dq(dq), shard(shard) {}
     void *entry() {
-      dq->entry();
+      dq->entry(shard);
       return 0;
     }
-  } dispatch_thread;
+  };
+
+  struct Shard {
+    mutable Mutex lock;
+    Cond cond;
+    PrioritizedQueue<QueueItem, uint64_t> mqueue;
+    set<pair<double, Message*> > marrival;
+    map<Message *, set<pair<double, Message*> >::iterator> marrival_map;
+    DispatchThread dispatch_thread;
+
+    Shard(DispatchQueue *dq, int i)
+      : lock("SimpleMessenger::DispatchQueue::lock"),
+	mqueue(dq->cct->_conf->ms_pq_max_tokens_per_priority,
+	       dq->cct->_conf->ms_pq_min_cost),
+	dispatch_thread(dq, i) {}
+
+    void add_arrival(Message *m) {
+      marrival_map.insert(
+	make_pair(
+	  m,
+	  marrival.insert(make_pair(m->get_recv_stamp(), m)).first
+	  )
+	);
+    }
+    void remove_arrival(Message *m) {
+      map<Message *, set<pair<double, Message*> >::iterator>::iterator i =
+	marrival_map.find(m);
+      assert(i != marrival_map.end());
+      marrival.erase(i->second);
+      marrival_map.erase(i);
+    }
+  };
+  vector<Shard*> shards;
+  /// held across deliveries unless every Dispatcher is reentrant
+  Mutex dispatch_lock;
+
+  Shard *get_shard(Connection *con) {
+    if (shards.size() == 1)
+      return shards[0];
+    rjhash<uint64_t> H;
+    return shards[H((uint64_t)(uintptr_t)con) % shards.size()];
+  }
+  void enqueue_code(int code, Connection *con) {
+    Shard *s = get_shard(con);
+    Mutex::Locker l(s->lock);
+    if (stop)
+      return;
+    s->mqueue.enqueue_strict(
+      0,
+      CEPH_MSG_PRIO_HIGHEST,
+      QueueItem(code, con));
+    s->cond.Signal();
+  }
+  void _enqueue(Message *m, int priority, uint64_t id);
+  void deliver(QueueItem &qitem);
+
+  atomic64_t next_pipe_id;
+    
+  enum { D_CONNECT = 1, D_ACCEPT, D_BAD_REMOTE_RESET, D_BAD_RESET, D_NUM_CODES };
 
   Mutex local_delivery_lock;
   Cond local_delivery_cond;
@@ -130,49 +170,27 @@ class DispatchQueue {
   double get_max_age(utime_t now) const;
 
   int get_queue_len() const {
-    Mutex::Locker l(lock);
-    return mqueue.length();
+    int len = 0;
+    for (vector<Shard*>::const_iterator p = shards.begin();
+	 p != shards.end();
+	 ++p) {
+      Mutex::Locker l((*p)->lock);
+      len += (*p)->mqueue.length();
+    }
+    return len;
   }
     
   void queue_connect(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_CONNECT, con));
-    cond.Signal();
+    enqueue_code(D_CONNECT, con);
   }
   void queue_accept(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_ACCEPT, con));
-    cond.Signal();
+    enqueue_code(D_ACCEPT, con);
   }
   void queue_remote_reset(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_BAD_REMOTE_RESET, con));
-    cond.Signal();
+    enqueue_code(D_BAD_REMOTE_RESET, con);
   }
   void queue_reset(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_BAD_RESET, con));
-    cond.Signal();
+    enqueue_code(D_BAD_RESET, con);
   }
 
   bool can_fast_dispatch(Message *m) const;
@@ -181,27 +199,31 @@ class DispatchQueue {
   void enqueue(Message *m, int priority, uint64_t id);
   void discard_queue(uint64_t id);
   uint64_t get_id() {
-    Mutex::Locker l(lock);
-    return next_pipe_id++;
+    return next_pipe_id.inc();
   }
   void start();
-  void entry();
+  void entry(int shard);
   void wait();
   void shutdown();
-  bool is_started() const {return dispatch_thread.is_started();}
+  bool is_started() const {return shards[0]->dispatch_thread.is_started();}
 
   DispatchQueue(CephContext *cct, SimpleMessenger *msgr)
     : cct(cct), msgr(msgr),
-      lock("SimpleMessenger::DispatchQueue::lock"),
-      mqueue(cct->_conf->ms_pq_max_tokens_per_priority,
-	     cct->_conf->ms_pq_min_cost),
-      next_pipe_id(1),
-      dispatch_thread(this),
+      dispatch_lock("SimpleMessenger::DispatchQueue::dispatch_lock"),
+      next_pipe_id(0),
       local_delivery_lock("SimpleMessenger::DispatchQueue::local_delivery_lock"),
       stop_local_delivery(false),
       local_delivery_thread(this),
       stop(false)
-    {}
+    {
+      int n = MAX(1, cct->_conf->ms_dispatch_threads);
+      for (int i = 0; i < n; ++i)
+	shards.push_back(new Shard(this, i));
+    }
+  ~DispatchQueue() {
+    for (vector<Shard*>::iterator p = shards.begin(); p != shards.end(); ++p)
+      delete *p;
+  }
 };
 
 #endif
@@ -29,7 +29,8 @@ extern "C" {
 #include "auth/AuthSessionHandler.h"
 
 #define XIO_ALL_FEATURES (CEPH_FEATURES_ALL & \
-			  ~CEPH_FEATURE_MSGR_KEEPALIVE2)
+			  ~CEPH_FEATURE_MSGR_KEEPALIVE2 & \
+			  ~MessageCompressor::get_unsupported_features())
 
 #define XIO_NOP_TAG_MARKDOWN 0x0001
 
@@ -709,6 +709,42 @@ int DBObjectMap::rm_keys(const ghobject_t &oid,
   return db->submit_transaction(t);
 }
 
+int DBObjectMap::rm_key_range(const ghobject_t &oid,
+			      const string &first,
+			      const string &last,
+			      const SequencerPosition *spos)
+{
+  {
+    MapHeaderLock hl(this, oid);
+    Header header = lookup_map_header(hl, oid);
+    if (!header)
+      return -ENOENT;
+    if (check_spos(oid, header, spos))
+      return 0;
+    if (!header->parent) {
+      // all of the keys are ours, drop the range in the db directly;
+      // record spos with it so a replay can't remove keys set later
+      KeyValueDB::Transaction t = db->get_transaction();
+      t->rm_range_keys(user_prefix(header), first, last);
+      if (spos) {
+	header->spos = *spos;
+	set_map_header(hl, oid, *header, t);
+      }
+      return db->submit_transaction(t);
+    }
+  }
+
+  // some keys may only live in the parent; rm_keys copies up around them
+  set<string> to_clear;
+  {
+    ObjectMapIterator iter = get_iterator(oid);
+    for (iter->lower_bound(first); iter->valid() && iter->key() < last;
+	 iter->next())
+      to_clear.insert(iter->key());
+  }
+  return rm_keys(oid, to_clear, spos);
+}
+
 int DBObjectMap::clear_keys_header(const ghobject_t &oid,
 				   const SequencerPosition *spos)
 {
@@ -1026,6 +1062,7 @@ int DBObjectMap::init(bool do_upgrade)
     state.v = 2;
     state.seq = 1;
   }
+  seq_reserved = state.seq;
   dout(20) << "(init)dbobjectmap: seq is " << state.seq << dendl;
   return 0;
 }
@@ -1062,10 +1099,13 @@ int DBObjectMap::sync(const ghobject_t *oid,
 
 int DBObjectMap::write_state(KeyValueDB::Transaction _t) {
   assert(header_lock.is_locked_by_me());
-  dout(20) << "dbobjectmap: seq is " << state.seq << dendl;
+  dout(20) << "dbobjectmap: seq is " << state.seq
+	   << " reserved " << seq_reserved << dendl;
   KeyValueDB::Transaction t = _t ? _t : db->get_transaction();
+  State to_write_state = state;
+  to_write_state.seq = MAX(state.seq, seq_reserved);
   bufferlist bl;
-  state.encode(bl);
+  to_write_state.encode(bl);
   map<string, bufferlist> to_write;
   to_write[GLOBAL_STATE_KEY] = bl;
   t->set(SYS_PREFIX, to_write);
@@ -1080,13 +1120,10 @@ DBObjectMap::Header DBObjectMap::_lookup_map_header(
   assert(l.get_locked() == oid);
 
   _Header *header = new _Header();
-  {
-    Mutex::Locker l(cache_lock);
-    if (caches.lookup(oid, header)) {
-      assert(!in_use.count(header->seq));
-      in_use.insert(header->seq);
-      return Header(header, RemoveOnDelete(this));
-    }
+  if (get_cache(oid).lookup(oid, header)) {
+    assert(!in_use.count(header->seq));
+    in_use.insert(header->seq);
+    return Header(header, RemoveOnDelete(this));
   }
 
   map<string, bufferlist> out;
@@ -1101,10 +1138,7 @@ DBObjectMap::Header DBObjectMap::_lookup_map_header(
   Header ret(header, RemoveOnDelete(this));
   bufferlist::iterator iter = out.begin()->second.begin();
   ret->decode(iter);
-  {
-    Mutex::Locker l(cache_lock);
-    caches.add(oid, *ret);
-  }
+  get_cache(oid).add(oid, *ret);
 
   assert(!in_use.count(header->seq));
   in_use.insert(header->seq);
@@ -1116,6 +1150,11 @@ DBObjectMap::Header DBObjectMap::_generate_new_header(const ghobject_t &oid,
 {
   Header header = Header(new _Header(), RemoveOnDelete(this));
   header->seq = state.seq++;
+  if (state.seq > seq_reserved) {
+    // persist a whole batch of seqs at once rather than one per header
+    seq_reserved = state.seq + MAX(g_conf->filestore_omap_seq_batch, 1) - 1;
+    write_state();
+  }
   if (parent) {
     header->parent = parent->seq;
     header->spos = parent->spos;
@@ -1124,8 +1163,6 @@ DBObjectMap::Header DBObjectMap::_generate_new_header(const ghobject_t &oid,
   header->oid = oid;
   assert(!in_use.count(header->seq));
   in_use.insert(header->seq);
-
-  write_state();
   return header;
 }
 
@@ -1134,6 +1171,14 @@ DBObjectMap::Header DBObjectMap::lookup_parent(Header input)
   Mutex::Locker l(header_lock);
   while (in_use.count(input->parent))
     header_cond.Wait(header_lock);
+  Header header = Header(new _Header(), RemoveOnDelete(this));
+  if (parent_cache.lookup(input->parent, header.get())) {
+    dout(20) << "lookup_parent: parent " << input->parent
+	     << " for seq " << input->seq << " (cached)" << dendl;
+    in_use.insert(header->seq);
+    return header;
+  }
+
   map<string, bufferlist> out;
   set<string> keys;
   keys.insert(HEADER_KEY);
@@ -1150,10 +1195,10 @@ DBObjectMap::Header DBObjectMap::lookup_parent(Header input)
     return Header();
   }
 
-  Header header = Header(new _Header(), RemoveOnDelete(this));
   header->seq = input->parent;
   bufferlist::iterator iter = out.begin()->second.begin();
   header->decode(iter);
+  parent_cache.add(input->parent, *header);
   dout(20) << "lookup_parent: parent seq is " << header->seq << " with parent "
        << header->parent << dendl;
   in_use.insert(header->seq);
@@ -1184,6 +1229,7 @@ void DBObjectMap::clear_header(Header header, KeyValueDB::Transaction t)
   set<string> keys;
   keys.insert(header_key(header->seq));
   t->rmkeys(USER_PREFIX, keys);
+  parent_cache.clear(header->seq);
 }
 
 void DBObjectMap::set_header(Header header, KeyValueDB::Transaction t)
@@ -1192,6 +1238,7 @@ void DBObjectMap::set_header(Header header, KeyValueDB::Transaction t)
   map<string, bufferlist> to_write;
   header->encode(to_write[HEADER_KEY]);
   t->set(sys_prefix(header), to_write);
+  parent_cache.add(header->seq, *header);
 }
 
 void DBObjectMap::remove_map_header(
@@ -1206,10 +1253,7 @@ void DBObjectMap::remove_map_header(
   set<string> to_remove;
   to_remove.insert(map_header_key(oid));
   t->rmkeys(HOBJECT_TO_SEQ, to_remove);
-  {
-    Mutex::Locker l(cache_lock);
-    caches.clear(oid);
-  }
+  get_cache(oid).clear(oid);
 }
 
 void DBObjectMap::set_map_header(
@@ -1224,10 +1268,7 @@ void DBObjectMap::set_map_header(
   map<string, bufferlist> to_set;
   header.encode(to_set[map_header_key(oid)]);
   t->set(HOBJECT_TO_SEQ, to_set);
-  {
-    Mutex::Locker l(cache_lock);
-    caches.add(oid, header);
-  }
+  get_cache(oid).add(oid, header);
 }
 
 bool DBObjectMap::check_spos(const ghobject_t &oid,
@@ -114,9 +114,21 @@ public:
   };
 
   DBObjectMap(KeyValueDB *db) : db(db), header_lock("DBOBjectMap"),
-                                cache_lock("DBObjectMap::CacheLock"),
-                                caches(g_conf->filestore_omap_header_cache_size)
-    {}
+                                seq_reserved(0),
+                                parent_cache(g_conf->filestore_omap_header_cache_size)
+    {
+      int shards = MAX(g_conf->filestore_omap_header_cache_shards, 1);
+      int size = MAX(g_conf->filestore_omap_header_cache_size / shards, 1);
+      for (int i = 0; i < shards; ++i)
+	caches.push_back(new SimpleLRU<ghobject_t, _Header>(size));
+    }
+
+  ~DBObjectMap() {
+    for (vector<SimpleLRU<ghobject_t, _Header>*>::iterator i = caches.begin();
+	 i != caches.end();
+	 ++i)
+      delete *i;
+  }
 
   int set_keys(
     const ghobject_t &oid,
@@ -151,6 +163,13 @@ public:
     const SequencerPosition *spos=0
     );
 
+  int rm_key_range(
+    const ghobject_t &oid,
+    const string &first,
+    const string &last,
+    const SequencerPosition *spos=0
+    );
+
   int get(
     const ghobject_t &oid,
     bufferlist *header,
@@ -268,6 +287,13 @@ public:
     }
   } state;
 
+  /**
+   * Seqs below seq_reserved may have been handed out without their own
+   * state write; the persisted state always covers them.  Protected by
+   * header_lock.
+   */
+  uint64_t seq_reserved;
+
   struct _Header {
     uint64_t seq;
     uint64_t parent;
@@ -326,8 +352,20 @@ public:
 private:
   /// Implicit lock on Header->seq
   typedef ceph::shared_ptr<_Header> Header;
-  Mutex cache_lock;
-  SimpleLRU<ghobject_t, _Header> caches;
+
+  /**
+   * Map headers by object, kept coherent by updating them under the
+   * MapHeaderLock in the same place the header is written to the
+   * transaction.  Sharded by object hash so lookups on different
+   * objects do not serialize on one lock.
+   */
+  vector<SimpleLRU<ghobject_t, _Header>*> caches;
+  SimpleLRU<ghobject_t, _Header> &get_cache(const ghobject_t &oid) {
+    return *caches[oid.hobj.get_hash() % caches.size()];
+  }
+
+  /// Parent headers by seq, updated wherever they are written or cleared
+  SimpleLRU<uint64_t, _Header> parent_cache;
 
   string map_header_key(const ghobject_t &oid);
   string header_key(uint64_t seq);
@@ -17,16 +17,25 @@
 
 #include <memory>
 #include <errno.h>
+#include <fcntl.h>
 #include <cstdio>
 #include "common/hobject.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/shared_cache.hpp"
+#include "common/simple_cache.hpp"
+#include "include/atomic.h"
+#include "include/buffer.h"
 #include "include/compat.h"
 #include "include/intarith.h"
 
 /**
  * FD Cache
+ *
+ * Besides the open fds, optionally (filestore_fd_cache_handles) keeps
+ * a much larger cache of kernel file handles for recently opened
+ * objects, so that an object whose fd was evicted can be reopened with
+ * open_by_handle_at(2) instead of walking the collection index again.
  */
 class FDCache : public md_config_obs_t {
 public:
@@ -54,9 +63,36 @@ private:
   const int registry_shards;
   SharedLRU<ghobject_t, FD> *registry;
 
+  /// encoded struct file_handle per object, sharded like registry
+  vector<SimpleLRU<ghobject_t, bufferptr>*> handles;
+  atomic_t use_handles;  ///< cleared from op threads if the kernel refuses
+  int handle_mount_fd;  ///< any fd on the store's file system, -1 if unmounted
+  int handle_mount_id;  ///< mount id of handle_mount_fd
+
+#ifdef MAX_HANDLE_SZ
+  void save_handle(const ghobject_t &hoid, int fd) {
+    bufferptr bp(sizeof(struct file_handle) + MAX_HANDLE_SZ);
+    struct file_handle *fh = (struct file_handle *)bp.c_str();
+    fh->handle_bytes = MAX_HANDLE_SZ;
+    int mount_id;
+    if (::name_to_handle_at(fd, "", fh, &mount_id, AT_EMPTY_PATH) < 0)
+      return;
+    // open_by_handle_at() can only resolve handles of handle_mount_fd's mount
+    if (mount_id != handle_mount_id)
+      return;
+    int registry_id = hoid.hobj.get_hash() % registry_shards;
+    handles[registry_id]->clear(hoid);
+    handles[registry_id]->add(
+      hoid,
+      buffer::copy(bp.c_str(), sizeof(struct file_handle) + fh->handle_bytes));
+  }
+#endif
+
 public:
   FDCache(CephContext *cct) : cct(cct),
-  registry_shards(cct->_conf->filestore_fd_cache_shards) {
+  registry_shards(cct->_conf->filestore_fd_cache_shards),
+  use_handles(cct->_conf->filestore_fd_cache_handles),
+  handle_mount_fd(-1), handle_mount_id(-1) {
     assert(cct);
     cct->_conf->add_observer(this);
     registry = new SharedLRU<ghobject_t, FD>[registry_shards];
@@ -64,11 +100,15 @@ public:
       registry[i].set_cct(cct);
       registry[i].set_size(
           MAX((cct->_conf->filestore_fd_cache_size / registry_shards), 1));
+      handles.push_back(new SimpleLRU<ghobject_t, bufferptr>(
+          MAX((cct->_conf->filestore_fd_cache_handle_size / registry_shards), 1)));
     }
   }
   ~FDCache() {
     cct->_conf->remove_observer(this);
     delete[] registry;
+    for (int i = 0; i < registry_shards; ++i)
+      delete handles[i];
   }
   typedef ceph::shared_ptr<FD> FDRef;
 
@@ -79,6 +119,10 @@ public:
 
   FDRef add(const ghobject_t &hoid, int fd, bool *existed) {
     int registry_id = hoid.hobj.get_hash() % registry_shards;
+#ifdef MAX_HANDLE_SZ
+    if (use_handles.read() && handle_mount_fd >= 0)
+      save_handle(hoid, fd);
+#endif
     return registry[registry_id].add(hoid, new FD(fd), existed);
   }
 
@@ -86,12 +130,85 @@ public:
   void clear(const ghobject_t &hoid) {
     int registry_id = hoid.hobj.get_hash() % registry_shards;
     registry[registry_id].purge(hoid);
+    handles[registry_id]->clear(hoid);
+  }
+
+  /// forget the file handle of hoid, the name may now refer to another file
+  void clear_handle(const ghobject_t &hoid) {
+    int registry_id = hoid.hobj.get_hash() % registry_shards;
+    handles[registry_id]->clear(hoid);
+  }
+
+  /**
+   * set the fd open_by_handle() resolves handles against
+   *
+   * Must be set at mount, before any op thread uses the cache, and
+   * reset to -1 on umount; resetting drops all cached handles.
+   */
+  void set_handle_mount_fd(int fd) {
+    handle_mount_fd = fd;
+    handle_mount_id = -1;
+    if (fd >= 0)
+      use_handles.set(cct->_conf->filestore_fd_cache_handles);
+#ifdef MAX_HANDLE_SZ
+    if (fd >= 0 && use_handles.read()) {
+      char buf[sizeof(struct file_handle) + MAX_HANDLE_SZ];
+      struct file_handle *fh = (struct file_handle *)buf;
+      fh->handle_bytes = MAX_HANDLE_SZ;
+      if (::name_to_handle_at(fd, "", fh, &handle_mount_id,
+			      AT_EMPTY_PATH) < 0) {
+	// file system can't do handles at all
+	use_handles.set(0);
+	handle_mount_id = -1;
+      }
+    }
+#endif
+    if (fd < 0) {
+      for (int i = 0; i < registry_shards; ++i)
+	handles[i]->set_size(0);
+      for (int i = 0; i < registry_shards; ++i)
+	handles[i]->set_size(
+	  MAX((cct->_conf->filestore_fd_cache_handle_size / registry_shards), 1));
+    }
+  }
+
+  /**
+   * reopen hoid from its cached file handle
+   *
+   * @returns new fd, or -errno if there is no (valid) handle for hoid,
+   * in which case the caller has to go through the collection index
+   */
+  int open_by_handle(const ghobject_t &hoid, int flags) {
+#ifdef MAX_HANDLE_SZ
+    if (!use_handles.read() || handle_mount_fd < 0)
+      return -ENOENT;
+    int registry_id = hoid.hobj.get_hash() % registry_shards;
+    bufferptr bp;
+    if (!handles[registry_id]->lookup(hoid, &bp))
+      return -ENOENT;
+    int fd = ::open_by_handle_at(handle_mount_fd,
+				 (struct file_handle *)bp.c_str(), flags);
+    if (fd < 0) {
+      int r = -errno;
+      handles[registry_id]->clear(hoid);
+      if (r == -EPERM || r == -ENOTSUP || r == -EOPNOTSUPP) {
+	// needs CAP_DAC_READ_SEARCH and file system support; don't
+	// bother trying again
+	use_handles.set(0);
+      }
+      return r;
+    }
+    return fd;
+#else
+    return -ENOTSUP;
+#endif
   }
 
   /// md_config_obs_t
   const char** get_tracked_conf_keys() const {
     static const char* KEYS[] = {
       "filestore_fd_cache_size",
+      "filestore_fd_cache_handle_size",
       NULL
     };
     return KEYS;
@@ -103,6 +220,11 @@ public:
         registry[i].set_size(
               MAX((conf->filestore_fd_cache_size / registry_shards), 1));
     }
+    if (changed.count("filestore_fd_cache_handle_size")) {
+      for (int i = 0; i < registry_shards; ++i)
+        handles[i]->set_size(
+              MAX((conf->filestore_fd_cache_handle_size / registry_shards), 1));
+    }
   }
 
 };
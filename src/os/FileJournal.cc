@@ -96,7 +96,8 @@ int FileJournal::_open(bool forwrite, bool create)
 #ifdef HAVE_LIBAIO
   if (aio) {
     aio_ctx = 0;
-    ret = io_setup(128, &aio_ctx);
+    aio_max_inflight = MAX(g_conf->journal_aio_max_inflight, 1);
+    ret = io_setup(aio_max_inflight, &aio_ctx);
     if (ret < 0) {
       ret = errno;
       derr << "FileJournal::_open: unable to setup io_context " << cpp_strerror(ret) << dendl;
@@ -1255,7 +1256,16 @@ void FileJournal::write_thread_entry()
       // but should be fine given that we will have plenty of aios in
       // flight if we hit this limit to ensure we keep the device
       // saturated.
+      //
+      // regardless of the pending bytes, never have more than
+      // journal_aio_max_inflight aios outstanding on the device.
       while (aio_num > 0) {
+	if (aio_num >= aio_max_inflight) {
+	  dout(20) << "write_thread_entry deferring until more aios complete: "
+		   << aio_num << " aios in flight >= max " << aio_max_inflight << dendl;
+	  aio_cond.Wait(aio_lock);
+	  continue;
+	}
 	int exp = MIN(aio_num * 2, 24);
 	long unsigned min_new = 1ull << exp;
 	long unsigned cur = throttle_bytes.get_current();
@@ -1391,6 +1401,9 @@ void FileJournal::do_aio_write(bufferlist& bl)
     }
   }
 
+  // header and both halves of a wrapped write go down in one io_submit
+  submit_aio_pending();
+
   write_pos = pos;
   if (write_pos == header.max_size)
     write_pos = get_top();
@@ -1398,7 +1411,10 @@ void FileJournal::do_aio_write(bufferlist& bl)
 }
 
 /**
- * write a buffer using aio
+ * prepare aio(s) to write a buffer
+ *
+ * The aios are only queued on aio_pending; submit_aio_pending() hands
+ * them to the kernel.
  *
  * @param seq seq to trigger when this aio completes.  if 0, do not update any state
  * on completion.
@@ -1439,31 +1455,72 @@ int FileJournal::write_aio_bl(off64_t& pos, bufferlist& bl, uint64_t seq)
     aio_num++;
     aio_bytes += aio.len;
 
-    iocb *piocb = &aio.iocb;
-    int attempts = 10;
-    do {
-      int r = io_submit(aio_ctx, 1, &piocb);
-      if (r < 0) {
-	derr << "io_submit to " << aio.off << "~" << aio.len
-	     << " got " << cpp_strerror(r) << dendl;
-	if (r == -EAGAIN && attempts-- > 0) {
-	  usleep(500);
-	  continue;
-	}
-	assert(0 == "io_submit got unexpected error");
-      }
-    } while (false);
+    aio_pending.push_back(&aio.iocb);
     pos += aio.len;
   }
-  write_finish_cond.Signal();
   return 0;
 }
+
+/**
+ * submit all aios prepared by write_aio_bl() with as few io_submit
+ * calls as the kernel lets us.
+ */
+void FileJournal::submit_aio_pending()
+{
+  Mutex::Locker locker(aio_lock);
+  if (aio_pending.empty())
+    return;
+
+  dout(20) << "submit_aio_pending " << aio_pending.size() << " aios" << dendl;
+  if (logger) {
+    logger->inc(l_os_j_aio_submit_batch, aio_pending.size());
+    logger->set(l_os_j_aio_inflight, aio_num);
+  }
+
+  // a single large write can prepare more aios than the context was set
+  // up for; never hand the kernel more than aio_max_inflight at once, and
+  // wait for the reaper to retire some when it won't take any more.
+  size_t done = 0;
+  while (done < aio_pending.size()) {
+    int room = aio_max_inflight - aio_in_kernel;
+    if (room <= 0) {
+      dout(20) << "submit_aio_pending " << aio_in_kernel
+	       << " aios in kernel, waiting for completions" << dendl;
+      aio_cond.Wait(aio_lock);
+      continue;
+    }
+    int n = MIN((int)(aio_pending.size() - done), room);
+    int r = io_submit(aio_ctx, n, &aio_pending[done]);
+    if (r == -EAGAIN || r == 0) {
+      dout(10) << "submit_aio_pending io_submit got " << cpp_strerror(r)
+	       << " with " << aio_in_kernel << " aios in kernel" << dendl;
+      if (aio_in_kernel > 0)
+	aio_cond.Wait(aio_lock);
+      else
+	aio_cond.WaitInterval(g_ceph_context, aio_lock, utime_t(0, 500000));
+      continue;
+    }
+    if (r < 0) {
+      aio_info *ai = (aio_info *)aio_pending[done];
+      derr << "io_submit to " << ai->off << "~" << ai->len
+	   << " got " << cpp_strerror(r) << dendl;
+      assert(0 == "io_submit got unexpected error");
+    }
+    // the kernel may take only part of the batch if its ring is full
+    done += r;
+    aio_in_kernel += r;
+    write_finish_cond.Signal();
+  }
+  aio_pending.clear();
+}
 #endif
 
 void FileJournal::write_finish_thread_entry()
 {
 #ifdef HAVE_LIBAIO
   dout(10) << "write_finish_thread_entry enter" << dendl;
+  // reap as many completions as could possibly be in flight at once
+  vector<io_event> event(MAX(aio_max_inflight, 1));
   while (true) {
     {
       Mutex::Locker locker(aio_lock);
@@ -1477,8 +1534,7 @@ void FileJournal::write_finish_thread_entry()
     }
     
     dout(20) << "write_finish_thread_entry waiting for aio(s)" << dendl;
-    io_event event[16];
-    int r = io_getevents(aio_ctx, 1, 16, event, NULL);
+    int r = io_getevents(aio_ctx, 1, event.size(), &event[0], NULL);
     if (r < 0) {
       if (r == -EINTR) {
 	dout(0) << "io_getevents got " << cpp_strerror(r) << dendl;
@@ -1501,7 +1557,13 @@ void FileJournal::write_finish_thread_entry()
 		 << "~" << ai->len << " done" << dendl;
 	ai->done = true;
       }
+      aio_in_kernel -= r;
+      if (logger)
+	logger->inc(l_os_j_aio_reap_batch, r);
       check_aio_completion();
+      // completions out of order may not retire anything from aio_queue,
+      // but they still free room for submit_aio_pending()
+      aio_cond.Signal();
     }
   }
   dout(10) << "write_finish_thread_entry exit" << dendl;
@@ -1553,6 +1615,8 @@ void FileJournal::check_aio_completion()
     }
   }
   if (signal) {
+    if (logger)
+      logger->set(l_os_j_aio_inflight, aio_num);
     // maybe write queue was waiting for aio count to drop?
     aio_cond.Signal();
   }
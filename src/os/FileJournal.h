@@ -255,7 +255,12 @@ private:
   io_context_t aio_ctx;
   list<aio_info> aio_queue;
   int aio_num, aio_bytes;
+  /// aios handed to io_submit and not yet reaped
+  int aio_in_kernel;
+  /// aios prepared by write_aio_bl() but not yet handed to io_submit
+  vector<iocb*> aio_pending;
   /// End protected by aio_lock
+  int aio_max_inflight;
 #endif
 
   uint64_t last_committed_seq;
@@ -318,6 +323,7 @@ private:
   void check_aio_completion();
   void do_aio_write(bufferlist& bl);
   int write_aio_bl(off64_t& pos, bufferlist& bl, uint64_t seq);
+  void submit_aio_pending();
 
 
   void align_bl(off64_t pos, bufferlist& bl);
@@ -376,7 +382,8 @@ private:
 #ifdef HAVE_LIBAIO
     aio_lock("FileJournal::aio_lock"),
     aio_ctx(0),
-    aio_num(0), aio_bytes(0),
+    aio_num(0), aio_bytes(0), aio_in_kernel(0),
+    aio_max_inflight(0),
 #endif
     last_committed_seq(0), 
     journaled_since_start(0),
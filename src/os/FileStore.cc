@@ -265,6 +265,20 @@ int FileStore::lfn_open(coll_t cid,
       }
       return 0;
     }
+
+    // fd was evicted, but we may still know the file handle
+    fd = fdcache.open_by_handle(oid, flags & ~O_CREAT);
+    if (fd >= 0) {
+      bool existed;
+      *outfd = fdcache.add(oid, fd, &existed);
+      if (existed) {
+	TEMP_FAILURE_RETRY(::close(fd));
+      }
+      if (need_lock) {
+        ((*index).index)->access_lock.put_write();
+      }
+      return 0;
+    }
   }
 
 
@@ -451,6 +465,9 @@ int FileStore::lfn_unlink(coll_t cid, const ghobject_t& o,
   assert(NULL != index.index);
   RWLock::WLocker l((index.index)->access_lock);
 
+  // the name may be reused for a different file from here on
+  fdcache.clear_handle(o);
+
   {
     IndexedPath path;
     int exist;
@@ -543,6 +560,7 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, osflagbit
   m_filestore_min_sync_interval(g_conf->filestore_min_sync_interval),
   m_filestore_fail_eio(g_conf->filestore_fail_eio),
   m_filestore_fadvise(g_conf->filestore_fadvise),
+  m_filestore_sequencer_parallel_apply(g_conf->filestore_sequencer_parallel_apply),
   do_update(do_update),
   m_journal_dio(g_conf->journal_dio),
   m_journal_aio(g_conf->journal_aio),
@@ -595,12 +613,17 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, osflagbit
   plb.add_u64(l_os_oq_bytes, "op_queue_bytes", "Size of writing to FS queue");
   plb.add_u64_counter(l_os_bytes, "bytes", "Data written to store");
   plb.add_time_avg(l_os_apply_lat, "apply_latency", "Apply latency");
+  plb.add_u64_counter(l_os_parallel_apply, "parallel_apply",
+		      "Ops applied while an earlier op of their sequencer was");
   plb.add_u64(l_os_committing, "committing", "Is currently committing");
 
   plb.add_u64_counter(l_os_commit, "commitcycle", "Commit cycles");
   plb.add_time_avg(l_os_commit_len, "commitcycle_interval", "Average interval between commits");
   plb.add_time_avg(l_os_commit_lat, "commitcycle_latency", "Average latency of commit");
   plb.add_u64_counter(l_os_j_full, "journal_full", "Journal writes while full");
+  plb.add_u64(l_os_j_aio_inflight, "journal_aio_inflight", "Journal aios in flight");
+  plb.add_u64_avg(l_os_j_aio_submit_batch, "journal_aio_submit_batch", "Journal aios per io_submit");
+  plb.add_u64_avg(l_os_j_aio_reap_batch, "journal_aio_reap_batch", "Journal aio completions per io_getevents");
   plb.add_time_avg(l_os_queue_lat, "queue_transaction_latency_avg", "Store operation queue latency");
 
   logger = plb.create_perf_counters();
@@ -1428,6 +1451,7 @@ int FileStore::mount()
   }
 
   assert(current_fd >= 0);
+  fdcache.set_handle_mount_fd(current_fd);
 
   op_fd = read_op_seq(&initial_op_seq);
   if (op_fd < 0) {
@@ -1616,6 +1640,7 @@ int FileStore::mount()
   return 0;
 
 close_current_fd:
+  fdcache.set_handle_mount_fd(-1);
   VOID_TEMP_FAILURE_RETRY(::close(current_fd));
   current_fd = -1;
 close_basedir_fd:
@@ -1659,6 +1684,7 @@ int FileStore::umount()
     op_fd = -1;
   }
   if (current_fd >= 0) {
+    fdcache.set_handle_mount_fd(-1);
     VOID_TEMP_FAILURE_RETRY(::close(current_fd));
     current_fd = -1;
   }
@@ -1709,6 +1735,31 @@ FileStore::Op *FileStore::build_op(list<Transaction*>& tls,
   o->ops = ops;
   o->bytes = bytes;
   o->osd_op = osd_op;
+  o->barrier = false;
+  o->claimed = false;
+  o->applied = false;
+  if (m_filestore_sequencer_parallel_apply) {
+    for (list<Transaction*>::iterator p = o->tls.begin();
+	 p != o->tls.end();
+	 ++p) {
+      if (!(*p)->get_touched_objects(&o->objects)) {
+	// conflicts with everything anyway; defer nothing
+	o->barrier = true;
+	o->objects.clear();
+	break;
+      }
+    }
+    // one entry per object, keys_only if it is in every transaction
+    sort(o->objects.begin(), o->objects.end(), TouchedObjectLess());
+    size_t n = 0;
+    for (size_t k = 0; k < o->objects.size(); ++k) {
+      if (n && *o->objects[n - 1].oid == *o->objects[k].oid)
+	o->objects[n - 1].keys_only &= o->objects[k].keys_only;
+      else
+	o->objects[n++] = o->objects[k];
+    }
+    o->objects.erase(o->objects.begin() + n, o->objects.end());
+  }
   return o;
 }
 
@@ -1798,6 +1849,38 @@ void FileStore::_do_op(OpSequencer *osr, ThreadPool::TPHandle &handle)
     dout(5) << "_do_op done stalling" << dendl;
   }
 
+  if (m_filestore_sequencer_parallel_apply) {
+    // start our op before waiting on conflicts so that a commit can't
+    // slip in ahead of it while later ops of this sequencer apply.
+    // apply_lock keeps ops starting in queue order, so whatever we wait
+    // for has already started and can't be held up by that commit.
+    osr->apply_lock.Lock();
+    Op *o = osr->claim_op();
+    apply_manager.op_apply_start(o->op);
+    osr->apply_lock.Unlock();
+    dout(5) << "_do_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent
+	    << " waiting for conflicts (" << o->objects.size() << " objects"
+	    << (o->barrier ? ", barrier" : "") << ")" << dendl;
+    handle.suspend_tp_timeout();
+    bool concurrent = osr->wait_for_conflicts(o);
+    handle.reset_tp_timeout();
+    if (concurrent)
+      logger->inc(l_os_parallel_apply);
+    dout(5) << "_do_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << " start" << dendl;
+    int r = _do_transactions(o->tls, o->op, &handle, o);
+    if (!o->deferred.empty()) {
+      handle.suspend_tp_timeout();
+      osr->wait_for_key_order(o);
+      handle.reset_tp_timeout();
+      _do_deferred_omap(o);
+    }
+    apply_manager.op_apply_finish(o->op);
+    dout(10) << "_do_op " << o << " seq " << o->op << " r = " << r
+	     << ", finisher " << o->onreadable << " " << o->onreadable_sync << dendl;
+    osr->mark_applied(o);
+    return;
+  }
+
   osr->apply_lock.Lock();
   Op *o = osr->peek_queue();
   apply_manager.op_apply_start(o->op);
@@ -1811,11 +1894,35 @@ void FileStore::_do_op(OpSequencer *osr, ThreadPool::TPHandle &handle)
 void FileStore::_finish_op(OpSequencer *osr)
 {
   list<Context*> to_queue;
+
+  if (m_filestore_sequencer_parallel_apply) {
+    // complete whatever prefix of the queue is applied by now; ops
+    // applied out of order are completed by a later _finish_op
+    list<Op*> ops;
+    osr->dequeue_applied(&ops, &to_queue);
+    for (list<Op*>::iterator p = ops.begin(); p != ops.end(); ++p) {
+      dout(10) << "_finish_op " << *p << " seq " << (*p)->op << " " << *osr << "/" << osr->parent << dendl;
+      _complete_op(*p);
+    }
+    if (!to_queue.empty()) {
+      op_finisher.queue(to_queue);
+    }
+    return;
+  }
+
   Op *o = osr->dequeue(&to_queue);
   
   dout(10) << "_finish_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << dendl;
   osr->apply_lock.Unlock();  // locked in _do_op
 
+  _complete_op(o);
+  if (!to_queue.empty()) {
+    op_finisher.queue(to_queue);
+  }
+}
+
+void FileStore::_complete_op(Op *o)
+{
   // called with tp lock held
   op_queue_release_throttle(o);
 
@@ -1829,9 +1936,6 @@ void FileStore::_finish_op(OpSequencer *osr)
   if (o->onreadable) {
     op_finisher.queue(o->onreadable);
   }
-  if (!to_queue.empty()) {
-    op_finisher.queue(to_queue);
-  }
   delete o;
 }
 
@@ -1996,7 +2100,8 @@ void FileStore::_journaled_ahead(OpSequencer *osr, Op *o, Context *ondisk)
 int FileStore::_do_transactions(
   list<Transaction*> &tls,
   uint64_t op_seq,
-  ThreadPool::TPHandle *handle)
+  ThreadPool::TPHandle *handle,
+  Op *defer_to)
 {
   int r = 0;
   int trans_num = 0;
@@ -2004,7 +2109,7 @@ int FileStore::_do_transactions(
   for (list<Transaction*>::iterator p = tls.begin();
        p != tls.end();
        ++p, trans_num++) {
-    r = _do_transaction(**p, op_seq, trans_num, handle);
+    r = _do_transaction(**p, op_seq, trans_num, handle, defer_to);
     if (r < 0)
       break;
     if (handle)
@@ -2272,7 +2377,7 @@ int FileStore::_check_replay_guard(int fd, const SequencerPosition& spos)
 
 unsigned FileStore::_do_transaction(
   Transaction& t, uint64_t op_seq, int trans_num,
-  ThreadPool::TPHandle *handle)
+  ThreadPool::TPHandle *handle, Op *defer_to)
 {
   dout(10) << "_do_transaction on " << &t << dendl;
 
@@ -2607,6 +2712,16 @@ unsigned FileStore::_do_transaction(
         ghobject_t oid = i.get_oid(op->oid);
         map<string, bufferlist> aset;
         i.decode_attrset(aset);
+        if (defer_to && defer_to->is_keys_only(oid)) {
+          defer_to->deferred.push_back(DeferredOmapOp());
+          DeferredOmapOp &d = defer_to->deferred.back();
+          d.op = op->op;
+          d.cid = cid;
+          d.oid = oid;
+          d.spos = spos;
+          d.aset.swap(aset);
+          break;
+        }
         tracepoint(objectstore, omap_setkeys_enter, osr_name);
         r = _omap_setkeys(cid, oid, aset, spos);
         tracepoint(objectstore, omap_setkeys_exit, r);
@@ -2618,6 +2733,16 @@ unsigned FileStore::_do_transaction(
         ghobject_t oid = i.get_oid(op->oid);
         set<string> keys;
         i.decode_keyset(keys);
+        if (defer_to && defer_to->is_keys_only(oid)) {
+          defer_to->deferred.push_back(DeferredOmapOp());
+          DeferredOmapOp &d = defer_to->deferred.back();
+          d.op = op->op;
+          d.cid = cid;
+          d.oid = oid;
+          d.spos = spos;
+          d.keys.swap(keys);
+          break;
+        }
         tracepoint(objectstore, omap_rmkeys_enter, osr_name);
         r = _omap_rmkeys(cid, oid, keys, spos);
         tracepoint(objectstore, omap_rmkeys_exit, r);
@@ -2776,6 +2901,29 @@ unsigned FileStore::_do_transaction(
   return 0;  // FIXME count errors
 }
 
+void FileStore::_do_deferred_omap(Op *o)
+{
+  dout(10) << "_do_deferred_omap " << o << " seq " << o->op << " "
+	   << o->deferred.size() << " omap updates" << dendl;
+  for (list<DeferredOmapOp>::iterator p = o->deferred.begin();
+       p != o->deferred.end();
+       ++p) {
+    int r;
+    if (p->op == Transaction::OP_OMAP_SETKEYS)
+      r = _omap_setkeys(p->cid, p->oid, p->aset, p->spos);
+    else
+      r = _omap_rmkeys(p->cid, p->oid, p->keys, p->spos);
+    // same as _do_transaction: ENOENT and ENODATA are normally okay
+    if (r < 0 && r != -ENOENT && r != -ENODATA) {
+      derr << "_do_deferred_omap error " << cpp_strerror(r)
+	   << " not handled on " << p->cid << "/" << p->oid
+	   << " (" << p->spos << ")" << dendl;
+      assert(0 == "unexpected error");
+    }
+  }
+  o->deferred.clear();
+}
+
   /*********************************************/
 
 
@@ -5119,17 +5267,21 @@ int FileStore::_omap_rmkeyrange(coll_t cid, const ghobject_t &hoid,
 				const string& first, const string& last,
 				const SequencerPosition &spos) {
   dout(15) << __func__ << " " << cid << "/" << hoid << " [" << first << "," << last << "]" << dendl;
-  set<string> keys;
+  Index index;
+  int r = get_index(cid, &index);
+  if (r < 0)
+    return r;
   {
-    ObjectMap::ObjectMapIterator iter = get_omap_iterator(cid, hoid);
-    if (!iter)
-      return -ENOENT;
-    for (iter->lower_bound(first); iter->valid() && iter->key() < last;
-	 iter->next()) {
-      keys.insert(iter->key());
-    }
+    assert(NULL != index.index);
+    RWLock::RLocker l((index.index)->access_lock);
+    r = lfn_find(hoid, index);
+    if (r < 0)
+      return r;
   }
-  return _omap_rmkeys(cid, hoid, keys, spos);
+  r = object_map->rm_key_range(hoid, first, last, &spos);
+  if (r < 0 && r != -ENOENT)
+    return r;
+  return 0;
 }
 
 int FileStore::_omap_setheader(coll_t cid, const ghobject_t &hoid,
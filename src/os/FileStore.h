@@ -175,6 +175,21 @@ private:
   } sync_thread;
 
   // -- op workqueue --
+  /// an omap key update held back until earlier ops are applied
+  struct DeferredOmapOp {
+    int op;  ///< Transaction::OP_OMAP_SETKEYS or OP_OMAP_RMKEYS
+    coll_t cid;
+    ghobject_t oid;
+    SequencerPosition spos;
+    map<string, bufferlist> aset;
+    set<string> keys;
+  };
+  struct TouchedObjectLess {
+    bool operator()(const Transaction::touched_object_t &l,
+		    const Transaction::touched_object_t &r) const {
+      return *l.oid < *r.oid;
+    }
+  };
   struct Op {
     utime_t start;
     uint64_t op;
@@ -182,6 +197,51 @@ private:
     Context *onreadable, *onreadable_sync;
     uint64_t ops, bytes;
     TrackedOpRef osd_op;
+
+    // parallel apply state, see filestore_sequencer_parallel_apply
+    /// objects touched by tls, sorted by oid, one entry per object
+    vector<Transaction::touched_object_t> objects;
+    bool barrier;             ///< tls touch whole collections; conflicts with everything
+    bool claimed;             ///< picked up by an op thread
+    bool applied;             ///< tls applied, waiting for earlier ops to complete
+    /// omap key updates to keys_only objects, applied in queue order
+    list<DeferredOmapOp> deferred;
+
+    enum {
+      OVERLAP_NONE,     ///< no object in common
+      OVERLAP_KEYS,     ///< only objects both just update omap keys of
+      OVERLAP_CONFLICT, ///< must not apply concurrently
+    };
+    /// how the objects touched by o overlap with ours
+    int overlap(const Op &o) const {
+      if (barrier || o.barrier)
+	return OVERLAP_CONFLICT;
+      int r = OVERLAP_NONE;
+      vector<Transaction::touched_object_t>::const_iterator p = objects.begin();
+      vector<Transaction::touched_object_t>::const_iterator q = o.objects.begin();
+      while (p != objects.end() && q != o.objects.end()) {
+	if (*p->oid < *q->oid) {
+	  ++p;
+	} else if (*q->oid < *p->oid) {
+	  ++q;
+	} else {
+	  if (!p->keys_only || !q->keys_only)
+	    return OVERLAP_CONFLICT;
+	  r = OVERLAP_KEYS;
+	  ++p;
+	  ++q;
+	}
+      }
+      return r;
+    }
+    /// true if oid is only the target of omap key updates in tls
+    bool is_keys_only(const ghobject_t &oid) const {
+      vector<Transaction::touched_object_t>::const_iterator p =
+	lower_bound(objects.begin(), objects.end(),
+		    Transaction::touched_object_t(&oid, false),
+		    TouchedObjectLess());
+      return p != objects.end() && *p->oid == oid && p->keys_only;
+    }
   };
   class OpSequencer : public Sequencer_impl {
     Mutex qlock; // to protect q, for benefit of flush (peek/dequeue also protected by lock)
@@ -189,9 +249,22 @@ private:
     list<uint64_t> jq;
     list<pair<uint64_t, Context*> > flush_commit_waiters;
     Cond cond;
+    Cond apply_cond;  // parallel apply: an op was applied
+
+    /// true if an earlier op in q that is not yet applied overlaps o by at least level
+    bool _has_overlap(Op *o, int level) {
+      assert(qlock.is_locked());
+      list<Op*>::iterator p;
+      for (p = q.begin(); p != q.end() && *p != o; ++p) {
+	if (!(*p)->applied && (*p)->overlap(*o) >= level)
+	  return true;
+      }
+      assert(p != q.end());
+      return false;
+    }
   public:
     Sequencer *parent;
-    Mutex apply_lock;  // for apply mutual exclusion
+    Mutex apply_lock;  // for apply mutual exclusion (op start order if parallel)
     
     /// get_max_uncompleted
     bool _get_max_uncompleted(
@@ -273,6 +346,70 @@ private:
       return o;
     }
 
+    /*
+     * Parallel apply: ops are claimed by op threads in queue order, but
+     * an op only has to wait for earlier ops that touch the same
+     * objects.  Objects that ops only update omap keys of (the pg meta
+     * object) don't count; those updates are deferred and applied in
+     * queue order once the rest of the op is.  Ops leave the queue (and
+     * complete) strictly in order, once they and every op before them
+     * has been applied.
+     */
+
+    /// claim the oldest op not yet picked up by an op thread
+    Op *claim_op() {
+      Mutex::Locker l(qlock);
+      for (list<Op*>::iterator p = q.begin(); p != q.end(); ++p) {
+	if (!(*p)->claimed) {
+	  (*p)->claimed = true;
+	  return *p;
+	}
+      }
+      assert(0 == "no unclaimed op in queue");
+      return NULL;
+    }
+    /**
+     * block until no earlier, unapplied op conflicts with o
+     *
+     * @returns true if earlier ops are still being applied, i.e. o is
+     * applied concurrently with them
+     */
+    bool wait_for_conflicts(Op *o) {
+      Mutex::Locker l(qlock);
+      while (_has_overlap(o, Op::OVERLAP_CONFLICT))
+	apply_cond.Wait(qlock);
+      for (list<Op*>::iterator p = q.begin(); *p != o; ++p) {
+	if (!(*p)->applied)
+	  return true;
+      }
+      return false;
+    }
+    /// block until every earlier op updating the same omap keys objects is applied
+    void wait_for_key_order(Op *o) {
+      Mutex::Locker l(qlock);
+      while (_has_overlap(o, Op::OVERLAP_KEYS))
+	apply_cond.Wait(qlock);
+    }
+    void mark_applied(Op *o) {
+      Mutex::Locker l(qlock);
+      o->applied = true;
+      apply_cond.SignalAll();
+    }
+    /// dequeue all applied ops at the front of the queue
+    void dequeue_applied(list<Op*> *ops, list<Context*> *to_queue) {
+      assert(ops);
+      assert(to_queue);
+      Mutex::Locker l(qlock);
+      while (!q.empty() && q.front()->applied) {
+	ops->push_back(q.front());
+	q.pop_front();
+      }
+      if (!ops->empty()) {
+	cond.Signal();
+	_wake_flush_waiters(to_queue);
+      }
+    }
+
     void flush() {
       Mutex::Locker l(qlock);
 
@@ -367,6 +504,7 @@ private:
 
   void _do_op(OpSequencer *o, ThreadPool::TPHandle &handle);
   void _finish_op(OpSequencer *o);
+  void _complete_op(Op *o);
   Op *build_op(list<Transaction*>& tls,
 	       Context *onreadable, Context *onreadable_sync,
 	       TrackedOpRef osd_op);
@@ -459,13 +597,14 @@ public:
 
   int _do_transactions(
     list<Transaction*> &tls, uint64_t op_seq,
-    ThreadPool::TPHandle *handle);
+    ThreadPool::TPHandle *handle, Op *defer_to = NULL);
   int do_transactions(list<Transaction*> &tls, uint64_t op_seq) {
     return _do_transactions(tls, op_seq, 0);
   }
   unsigned _do_transaction(
     Transaction& t, uint64_t op_seq, int trans_num,
-    ThreadPool::TPHandle *handle);
+    ThreadPool::TPHandle *handle, Op *defer_to = NULL);
+  void _do_deferred_omap(Op *o);
 
   int queue_transactions(Sequencer *osr, list<Transaction*>& tls,
 			 TrackedOpRef op = TrackedOpRef(),
@@ -700,6 +839,7 @@ private:
   double m_filestore_min_sync_interval;
   bool m_filestore_fail_eio;
   bool m_filestore_fadvise;
+  bool m_filestore_sequencer_parallel_apply;
   int do_update;
   bool m_journal_dio, m_journal_aio, m_journal_force_aio;
   std::string m_osd_rollback_to_cluster_snap;
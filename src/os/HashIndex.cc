@@ -230,6 +230,9 @@ int HashIndex::_split(
   uint32_t bits,
   CollectionIndex* dest) {
   assert(collection_version() == dest->collection_version());
+  int r = continue_split(true);
+  if (r < 0)
+    return r;
   unsigned mkdirred = 0;
   return col_split_level(
     *this,
@@ -260,10 +263,18 @@ int HashIndex::_created(const vector<string> &path,
   if (r < 0)
     return r;
 
-  if (must_split(info)) {
+  if (split_in_progress) {
+    // only one split at a time; this one can wait for the next _created
+    return continue_split(false);
+  } else if (must_split(info)) {
     int r = initiate_split(path, info);
     if (r < 0)
       return r;
+    if (split_incremental) {
+      split_in_progress = true;
+      split_path = path;
+      return continue_split(false);
+    }
     return complete_split(path, info);
   } else {
     return 0;
@@ -285,6 +296,10 @@ int HashIndex::_remove(const vector<string> &path,
   r = set_info(path, info);
   if (r < 0)
     return r;
+  if (split_in_progress) {
+    // don't merge what we are splitting, we'll get another chance
+    return 0;
+  }
   if (must_merge(info)) {
     r = initiate_merge(path, info);
     if (r < 0)
@@ -341,6 +356,9 @@ int HashIndex::_collection_list_partial(const ghobject_t &start,
 }
 
 int HashIndex::prep_delete() {
+  int r = continue_split(true);
+  if (r < 0)
+    return r;
   return recursive_remove(vector<string>());
 }
 
@@ -624,10 +642,39 @@ int HashIndex::initiate_split(const vector<string> &path, subdir_info_s info) {
 }
 
 int HashIndex::complete_split(const vector<string> &path, subdir_info_s info) {
+  bool done;
+  return split_children(path, info, false, &done);
+}
+
+int HashIndex::continue_split(bool all) {
+  if (!split_in_progress)
+    return 0;
+  bool done = false;
+  while (!done) {
+    subdir_info_s info;
+    int r = get_info(split_path, &info);
+    if (r < 0)
+      return r;
+    r = split_children(split_path, info, !all, &done);
+    if (r < 0)
+      return r;
+    if (!all)
+      break;
+  }
+  if (done) {
+    split_in_progress = false;
+    split_path.clear();
+  }
+  return 0;
+}
+
+int HashIndex::split_children(const vector<string> &path, subdir_info_s info,
+			      bool one_child, bool *done) {
   int level = info.hash_level;
   map<string, ghobject_t> objects;
   vector<string> dst = path;
   int r;
+  *done = false;
   dst.push_back("");
   r = list_objects(path, 0, 0, &objects);
   if (r < 0)
@@ -639,6 +686,7 @@ int HashIndex::complete_split(const vector<string> &path, subdir_info_s info) {
   map<string, map<string, ghobject_t> > mapped;
   map<string, ghobject_t> moved;
   int num_moved = 0;
+  bool more = false;
   for (map<string, ghobject_t>::iterator i = objects.begin();
        i != objects.end();
        ++i) {
@@ -675,6 +723,12 @@ int HashIndex::complete_split(const vector<string> &path, subdir_info_s info) {
       continue;
     }
 
+    if (one_child && num_moved > 0) {
+      // leave the rest for the next step
+      more = true;
+      break;
+    }
+
     // Subdir doesn't yet exist
     if (!subdirs.count(i->first)) {
       info.subdirs += 1;
@@ -721,6 +775,9 @@ int HashIndex::complete_split(const vector<string> &path, subdir_info_s info) {
   r = fsync_dir(path);
   if (r < 0)
     return r;
+  if (more)
+    return 0;
+  *done = true;
   return end_split_or_merge(path);
 }
 
@@ -66,6 +66,18 @@ private:
   int merge_threshold;
   int split_multiplier;
 
+  /**
+   * With incremental splitting, a subdir that must split is split one
+   * child subdir at a time: each later _created moves the objects of
+   * one more child out of it, until all children are done.  Since a
+   * child is populated completely (and its info set) before any of its
+   * objects are removed from the parent, lookups and listings never
+   * need to look at more than one layout per hash prefix.
+   */
+  bool split_incremental;
+  bool split_in_progress;         ///< incremental split on split_path
+  vector<string> split_path;
+
   /// Encodes current subdir state for determining when to split/merge.
   struct subdir_info_s {
     uint64_t objs;       ///< Objects in subdir.
@@ -138,10 +150,13 @@ public:
     int merge_at,          ///< [in] Merge threshhold.
     int split_multiple,	   ///< [in] Split threshhold.
     uint32_t index_version,///< [in] Index version
-    double retry_probability=0) ///< [in] retry probability
+    double retry_probability=0, ///< [in] retry probability
+    bool split_incremental=false) ///< [in] split one subdir at a time
     : LFNIndex(collection, base_path, index_version, retry_probability),
       merge_threshold(merge_at),
-      split_multiplier(split_multiple) {}
+      split_multiplier(split_multiple),
+      split_incremental(split_incremental),
+      split_in_progress(false) {}
 
   /// @see CollectionIndex
   uint32_t collection_version() { return index_version; }
@@ -271,6 +286,19 @@ private:
     subdir_info_s info	       ///< [in] Info attached to path
     ); /// @return Error Code, 0 on success
 
+  /// Moves objects from path into its child subdirs
+  int split_children(
+    const vector<string> &path, ///< [in] Subdir to split
+    subdir_info_s info,	        ///< [in] Info attached to path
+    bool one_child,             ///< [in] stop after populating one child
+    bool *done                  ///< [out] split completed and tag removed
+    ); /// @return Error Code, 0 on success
+
+  /// Does the next step of an incremental split in progress, if any
+  int continue_split(
+    bool all ///< [in] finish the split rather than do one step
+    ); /// @return Error Code, 0 on success
+
   /// Determine path components from hoid hash
   void get_path_components(
     const ghobject_t &oid, ///< [in] Object for which to get path components
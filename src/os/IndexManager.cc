@@ -115,7 +115,8 @@ int IndexManager::build_index(coll_t c, const char *path, CollectionIndex **inde
     *index = new HashIndex(c, path, g_conf->filestore_merge_threshold,
 				 g_conf->filestore_split_multiple,
 				 CollectionIndex::HOBJECT_WITH_POOL,
-				 g_conf->filestore_index_retry_probability);
+				 g_conf->filestore_index_retry_probability,
+				 g_conf->filestore_split_incremental);
     return 0;
   }
 }
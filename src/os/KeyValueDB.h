@@ -60,6 +60,13 @@ public:
       const string &prefix ///< [in] Prefix by which to remove keys
       ) = 0;
 
+    /// Removes keys in [start, end) under prefix
+    virtual void rm_range_keys(
+      const string &prefix,    ///< [in] Prefix by which to remove keys
+      const string &start,     ///< [in] First key to remove
+      const string &end        ///< [in] Key to stop at (not removed)
+      ) = 0;
+
     virtual ~TransactionImpl() {}
   };
   typedef ceph::shared_ptr< TransactionImpl > Transaction;
@@ -290,6 +290,127 @@ int StripObjectMap::get_with_header(const StripObjectHeaderRef header,
   return 0;
 }
 
+// ========= KeyValueStore::StripCache Implementation ============
+
+void KeyValueStore::StripCache::_erase(
+  map<key_t, lru_t::iterator>::iterator i)
+{
+  bytes -= i->second->second.length();
+  lru.erase(i->second);
+  contents.erase(i);
+}
+
+void KeyValueStore::StripCache::_insert(const key_t &k, const bufferlist &bl)
+{
+  map<key_t, lru_t::iterator>::iterator i = contents.find(k);
+  if (i != contents.end())
+    _erase(i);
+  if (bl.length() > max_bytes)
+    return;
+  lru.push_front(make_pair(k, bl));
+  contents[k] = lru.begin();
+  bytes += bl.length();
+  _trim();
+}
+
+void KeyValueStore::StripCache::_trim()
+{
+  while (bytes > max_bytes && !lru.empty())
+    _erase(contents.find(lru.back().first));
+}
+
+void KeyValueStore::StripCache::set_max_bytes(uint64_t max)
+{
+  Mutex::Locker l(lock);
+  max_bytes = max;
+  _trim();
+}
+
+uint64_t KeyValueStore::StripCache::get_epoch()
+{
+  Mutex::Locker l(lock);
+  return epoch;
+}
+
+bool KeyValueStore::StripCache::lookup(uint64_t seq, const string &key,
+                                       bufferlist *out)
+{
+  Mutex::Locker l(lock);
+  map<key_t, lru_t::iterator>::iterator i = contents.find(make_pair(seq, key));
+  if (i == contents.end())
+    return false;
+  lru.splice(lru.begin(), lru, i->second);
+  *out = i->second->second;
+  return true;
+}
+
+void KeyValueStore::StripCache::add(uint64_t seq, const string &key,
+                                    const bufferlist &bl, uint64_t seen)
+{
+  Mutex::Locker l(lock);
+  // a commit since the backend read may have changed this strip
+  if (seen != epoch)
+    return;
+  _insert(make_pair(seq, key), bl);
+}
+
+void KeyValueStore::StripCache::update(uint64_t seq, const string &key,
+                                       const bufferlist &bl)
+{
+  Mutex::Locker l(lock);
+  ++epoch;
+  _insert(make_pair(seq, key), bl);
+}
+
+void KeyValueStore::StripCache::invalidate(uint64_t seq, const string &key)
+{
+  Mutex::Locker l(lock);
+  ++epoch;
+  map<key_t, lru_t::iterator>::iterator i = contents.find(make_pair(seq, key));
+  if (i != contents.end())
+    _erase(i);
+}
+
+void KeyValueStore::StripCache::clear()
+{
+  Mutex::Locker l(lock);
+  ++epoch;
+  lru.clear();
+  contents.clear();
+  bytes = 0;
+}
+
+int KeyValueStore::get_strip_values(StripObjectMap::StripObjectHeaderRef header,
+                                    const set<string> &keys,
+                                    map<string, bufferlist> *out)
+{
+  uint64_t seq = header->header->seq;
+  uint64_t epoch = strip_cache.get_epoch();
+  set<string> need_lookup;
+
+  for (set<string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+    bufferlist bl;
+    if (strip_cache.lookup(seq, *it, &bl))
+      (*out)[*it].swap(bl);
+    else
+      need_lookup.insert(*it);
+  }
+  if (need_lookup.empty())
+    return 0;
+
+  map<string, bufferlist> got;
+  int r = backend->get_values_with_header(header, OBJECT_STRIP_PREFIX,
+                                          need_lookup, &got);
+  if (r < 0)
+    return r;
+  for (map<string, bufferlist>::iterator it = got.begin(); it != got.end();
+       ++it) {
+    strip_cache.add(seq, it->first, it->second, epoch);
+    (*out)[it->first].swap(it->second);
+  }
+  return 0;
+}
+
 // ========= KeyValueStore::BufferTransaction Implementation ============
 
 int KeyValueStore::BufferTransaction::lookup_cached_header(
@@ -357,8 +478,12 @@ int KeyValueStore::BufferTransaction::get_buffer_keys(
   }
 
   if (!need_lookup.empty()) {
-    int r = store->backend->get_values_with_header(strip_header, prefix,
-                                                   need_lookup, out);
+    int r;
+    if (prefix == OBJECT_STRIP_PREFIX)
+      r = store->get_strip_values(strip_header, need_lookup, out);
+    else
+      r = store->backend->get_values_with_header(strip_header, prefix,
+                                                 need_lookup, out);
     if (r < 0) {
       dout(10) << __func__  << " " << strip_header->cid << "/"
                << strip_header->oid << " " << " r = " << r << dendl;
@@ -373,9 +498,18 @@ void KeyValueStore::BufferTransaction::set_buffer_keys(
      StripObjectMap::StripObjectHeaderRef strip_header,
      const string &prefix, map<string, bufferlist> &values)
 {
-  store->backend->set_keys(strip_header->header, prefix, values, t);
-
   uniq_id uid = make_pair(strip_header->cid, strip_header->oid);
+  if (prefix == OBJECT_STRIP_PREFIX) {
+    pair<StripObjectMap::StripObjectHeaderRef, map<string, bufferlist> > &d =
+      dirty_strips[uid];
+    d.first = strip_header;
+    for (map<string, bufferlist>::iterator iter = values.begin();
+         iter != values.end(); ++iter)
+      d.second[iter->first] = iter->second;
+  } else {
+    store->backend->set_keys(strip_header->header, prefix, values, t);
+  }
+
   for (map<string, bufferlist>::iterator iter = values.begin();
        iter != values.end(); ++iter) {
     buffers[uid][make_pair(prefix, iter->first)].swap(iter->second);
@@ -394,6 +528,19 @@ int KeyValueStore::BufferTransaction::remove_buffer_keys(
     }
   }
 
+  if (prefix == OBJECT_STRIP_PREFIX) {
+    map< uniq_id, pair<StripObjectMap::StripObjectHeaderRef,
+                       map<string, bufferlist> > >::iterator d =
+      dirty_strips.find(uid);
+    for (set<string>::iterator iter = keys.begin(); iter != keys.end(); ++iter) {
+      if (d != dirty_strips.end())
+        d->second.second.erase(*iter);
+      pair<uint64_t, string> k = make_pair(strip_header->header->seq, *iter);
+      strip_cache_updates.erase(k);
+      strip_cache_removals.insert(k);
+    }
+  }
+
   return store->backend->rm_keys(strip_header->header, prefix, keys, t);
 }
 
@@ -415,6 +562,7 @@ int KeyValueStore::BufferTransaction::clear_buffer(
      StripObjectMap::StripObjectHeaderRef strip_header)
 {
   strip_header->deleted = true;
+  dirty_strips.erase(make_pair(strip_header->cid, strip_header->oid));
 
   InvalidateCacheContext *c = new InvalidateCacheContext(store, strip_header->cid, strip_header->oid);
   finishes.push_back(c);
@@ -428,6 +576,10 @@ void KeyValueStore::BufferTransaction::clone_buffer(
   // Remove target ahead to avoid dead lock
   strip_headers.erase(make_pair(cid, oid));
 
+  // Pending strips must land under the origin seq before it becomes the
+  // shared parent
+  flush_strips(make_pair(old_header->cid, old_header->oid));
+
   StripObjectMap::StripObjectHeaderRef new_target_header;
 
   store->backend->clone_wrap(old_header, cid, oid, t, &new_target_header);
@@ -445,6 +597,7 @@ void KeyValueStore::BufferTransaction::rename_buffer(
   // FIXME: Lacking of lock for origin header, it will cause other operation
   // can get the origin header while submitting transactions
   StripObjectMap::StripObjectHeaderRef new_header;
+  flush_strips(make_pair(old_header->cid, old_header->oid));
   store->backend->rename_wrap(old_header, cid, oid, t, &new_header);
 
   InvalidateCacheContext *c = new InvalidateCacheContext(store, old_header->cid, old_header->oid);
@@ -452,10 +605,36 @@ void KeyValueStore::BufferTransaction::rename_buffer(
   strip_headers[make_pair(cid, oid)] = new_header;
 }
 
+void KeyValueStore::BufferTransaction::flush_strips(const uniq_id &uid)
+{
+  map< uniq_id, pair<StripObjectMap::StripObjectHeaderRef,
+                     map<string, bufferlist> > >::iterator d =
+    dirty_strips.find(uid);
+  if (d == dirty_strips.end())
+    return;
+
+  StripObjectMap::StripObjectHeaderRef header = d->second.first;
+  map<string, bufferlist> &values = d->second.second;
+  if (!values.empty()) {
+    uint64_t seq = header->header->seq;
+    for (map<string, bufferlist>::iterator iter = values.begin();
+         iter != values.end(); ++iter) {
+      pair<uint64_t, string> k = make_pair(seq, iter->first);
+      strip_cache_removals.erase(k);
+      strip_cache_updates[k] = iter->second;
+    }
+    store->backend->set_keys(header->header, OBJECT_STRIP_PREFIX, values, t);
+  }
+  dirty_strips.erase(d);
+}
+
 int KeyValueStore::BufferTransaction::submit_transaction()
 {
   int r = 0;
 
+  while (!dirty_strips.empty())
+    flush_strips(dirty_strips.begin()->first);
+
   for (StripHeaderMap::iterator header_iter = strip_headers.begin();
        header_iter != strip_headers.end(); ++header_iter) {
     StripObjectMap::StripObjectHeaderRef header = header_iter->second;
@@ -474,6 +653,16 @@ int KeyValueStore::BufferTransaction::submit_transaction()
   }
 
   r = store->backend->submit_transaction_sync(t);
+  if (r == 0) {
+    for (set< pair<uint64_t, string> >::iterator it =
+           strip_cache_removals.begin();
+         it != strip_cache_removals.end(); ++it)
+      store->strip_cache.invalidate(it->first, it->second);
+    for (map< pair<uint64_t, string>, bufferlist>::iterator it =
+           strip_cache_updates.begin();
+         it != strip_cache_updates.end(); ++it)
+      store->strip_cache.update(it->first.first, it->first.second, it->second);
+  }
   for (list<Context*>::iterator it = finishes.begin(); it != finishes.end(); ++it) {
     (*it)->complete(r);
   }
@@ -525,6 +714,7 @@ KeyValueStore::KeyValueStore(const std::string &base,
   backend(NULL),
   ondisk_finisher(g_ceph_context),
   lock("KeyValueStore::lock"),
+  strip_cache(g_conf->keyvaluestore_strip_cache_size),
   default_osr("default"),
   op_queue_len(0), op_queue_bytes(0),
   op_throttle_lock("KeyValueStore::op_throttle_lock"),
@@ -978,6 +1168,7 @@ int KeyValueStore::umount()
   }
 
   backend.reset();
+  strip_cache.clear();
 
   // nothing
   return 0;
@@ -1656,7 +1847,7 @@ int KeyValueStore::_generic_read(StripObjectMap::StripObjectHeaderRef header,
   }
 
 
-  int r = backend->get_values_with_header(header, OBJECT_STRIP_PREFIX, keys, &out);
+  int r = get_strip_values(header, keys, &out);
   if (r < 0) {
     dout(10) << __func__ << " " << header->cid << "/" << header->oid << " "
              << offset << "~" << len << " = " << r << dendl;
@@ -3062,6 +3253,7 @@ const char** KeyValueStore::get_tracked_conf_keys() const
     "keyvaluestore_queue_max_ops",
     "keyvaluestore_queue_max_bytes",
     "keyvaluestore_strip_size",
+    "keyvaluestore_strip_cache_size",
     NULL
   };
   return KEYS;
@@ -3081,6 +3273,9 @@ void KeyValueStore::handle_conf_change(const struct md_config_t *conf,
     m_keyvaluestore_strip_size = conf->keyvaluestore_default_strip_size;
     default_strip_size = m_keyvaluestore_strip_size;
   }
+  if (changed.count("keyvaluestore_strip_cache_size")) {
+    strip_cache.set_max_bytes(conf->keyvaluestore_strip_cache_size);
+  }
 }
 
 void KeyValueStore::dump_transactions(list<ObjectStore::Transaction*>& ls, uint64_t seq, OpSequencer *osr)
@@ -233,6 +233,42 @@ class KeyValueStore : public ObjectStore,
     return ghobject_t(hobject_t(sobject_t(col.to_str(), CEPH_NOSNAP)));
   }
 
+  // Cache of committed strip data keyed by (header seq, strip key). A seq is
+  // never reused once its object is removed or cloned away, so entries only
+  // need explicit invalidation when a strip is removed from a live header.
+  class StripCache {
+    typedef pair<uint64_t, string> key_t;
+    typedef list<pair<key_t, bufferlist> > lru_t;
+
+    Mutex lock;
+    uint64_t max_bytes, bytes;
+    uint64_t epoch; // bumped by every committed change, see add()
+    lru_t lru;
+    map<key_t, lru_t::iterator> contents;
+
+    void _erase(map<key_t, lru_t::iterator>::iterator i);
+    void _insert(const key_t &k, const bufferlist &bl);
+    void _trim();
+
+   public:
+    StripCache(uint64_t max)
+      : lock("KeyValueStore::StripCache::lock"), max_bytes(max), bytes(0),
+        epoch(0) {}
+
+    void set_max_bytes(uint64_t max);
+    uint64_t get_epoch();
+    bool lookup(uint64_t seq, const string &key, bufferlist *out);
+    /// fill from a backend read; dropped if a change committed since @seen
+    void add(uint64_t seq, const string &key, const bufferlist &bl,
+             uint64_t seen);
+    void update(uint64_t seq, const string &key, const bufferlist &bl);
+    void invalidate(uint64_t seq, const string &key);
+    void clear();
+  } strip_cache;
+
+  int get_strip_values(StripObjectMap::StripObjectHeaderRef header,
+                       const set<string> &keys, map<string, bufferlist> *out);
+
   // Each transaction has side effect which may influent the following
   // operations, we need to make it visible for the following within
   // transaction by caching middle result.
@@ -249,6 +285,15 @@ class KeyValueStore : public ObjectStore,
     StripHeaderMap strip_headers;
     map< uniq_id, map<pair<string, string>, bufferlist> > buffers;  // pair(prefix, key),to buffer updated data in one transaction
 
+    // Strip writes are coalesced here and only reach the backend
+    // transaction in flush_strips(), so a strip rewritten several times in
+    // one batch is encoded once.
+    map< uniq_id, pair<StripObjectMap::StripObjectHeaderRef,
+                       map<string, bufferlist> > > dirty_strips;
+    // Strip cache changes applied once the batch commits
+    map< pair<uint64_t, string>, bufferlist> strip_cache_updates;
+    set< pair<uint64_t, string> > strip_cache_removals;
+
     list<Context*> finishes;
 
     KeyValueStore *store;
@@ -272,6 +317,7 @@ class KeyValueStore : public ObjectStore,
                       const coll_t &cid, const ghobject_t &oid);
     void rename_buffer(StripObjectMap::StripObjectHeaderRef old_header,
                        const coll_t &cid, const ghobject_t &oid);
+    void flush_strips(const uniq_id &uid);
     int submit_transaction();
 
     BufferTransaction(KeyValueStore *store): store(store) {
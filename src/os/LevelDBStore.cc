@@ -191,6 +191,20 @@ void LevelDBStore::LevelDBTransactionImpl::rmkeys_by_prefix(const string &prefix
   }
 }
 
+void LevelDBStore::LevelDBTransactionImpl::rm_range_keys(const string &prefix,
+						 const string &start,
+						 const string &end)
+{
+  KeyValueDB::Iterator it = db->get_iterator(prefix);
+  for (it->lower_bound(start);
+       it->valid() && it->key() < end;
+       it->next()) {
+    string key = combine_strings(prefix, it->key());
+    keys.push_back(key);
+    bat.Delete(*(keys.rbegin()));
+  }
+}
+
 int LevelDBStore::get(
     const string &prefix,
     const std::set<string> &keys,
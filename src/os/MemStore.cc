@@ -40,6 +40,236 @@ bool operator>(const MemStore::CollectionRef& l,
 }
 
 
+MemStore::MemStore(CephContext *cct, const string& path)
+  : ObjectStore(path),
+    cct(cct),
+    pool(MAX(cct->_conf->memstore_page_size, 1)),
+    memstore_logger(NULL),
+    coll_lock("MemStore::coll_lock"),
+    apply_lock("MemStore::apply_lock"),
+    finisher(cct),
+    sharded(false)
+{
+  PerfCountersBuilder plb(cct, "memstore", l_memstore_first, l_memstore_last);
+  plb.add_u64(l_memstore_bytes, "bytes", "Bytes allocated for object data");
+  plb.add_u64_counter(l_memstore_pages_cow, "pages_cow",
+		      "Shared pages copied on write");
+  plb.add_u64_counter(l_memstore_pages_shared, "pages_shared",
+		      "Pages shared by clone instead of copied");
+  memstore_logger = plb.create_perf_counters();
+  cct->get_perfcounters_collection()->add(memstore_logger);
+}
+
+MemStore::~MemStore()
+{
+  cct->get_perfcounters_collection()->remove(memstore_logger);
+  delete memstore_logger;
+}
+
+void MemStore::_update_perf_counters()
+{
+  memstore_logger->set(l_memstore_bytes, pool.bytes.read());
+  memstore_logger->set(l_memstore_pages_cow, pool.cow_pages);
+  memstore_logger->set(l_memstore_pages_shared, pool.shared_pages);
+}
+
+bool MemStore::_have_pages(uint64_t n)
+{
+  uint64_t want = pool.bytes.read() + n * pool.page_size;
+  if (want <= cct->_conf->memstore_device_bytes)
+    return true;
+  dout(1) << __func__ << " " << n << " pages would use " << want
+	  << " > memstore_device_bytes "
+	  << cct->_conf->memstore_device_bytes << dendl;
+  return false;
+}
+
+// -- Object --
+
+uint64_t MemStore::Object::pages_needed(uint64_t offset, uint64_t len) const
+{
+  if (!len)
+    return 0;
+  const uint64_t page_size = pool->page_size;
+  uint64_t first = offset / page_size;
+  uint64_t last = (offset + len - 1) / page_size;
+  uint64_t n = last - first + 1;
+  // pages we have to ourselves are written in place
+  for (map<uint64_t,PageRef>::const_iterator p = pages.lower_bound(first);
+       p != pages.end() && p->first <= last;
+       ++p) {
+    if (p->second.use_count() == 1 && p->second->data.raw_nref() == 1)
+      --n;
+  }
+  return n;
+}
+
+void MemStore::Object::read(uint64_t offset, uint64_t len,
+			    bufferlist *bl) const
+{
+  const uint64_t page_size = pool->page_size;
+  uint64_t end = offset + len;
+  map<uint64_t,PageRef>::const_iterator p = pages.lower_bound(offset / page_size);
+  while (offset < end) {
+    uint64_t index = offset / page_size;
+    uint64_t page_off = offset % page_size;
+    uint64_t n = MIN(page_size - page_off, end - offset);
+    if (p != pages.end() && p->first == index) {
+      bl->append(p->second->data, page_off, n);
+      ++p;
+    } else {
+      // hole; zero up to the next page we have
+      if (p != pages.end())
+	n = MIN(p->first * page_size, end) - offset;
+      else
+	n = end - offset;
+      bl->append_zero(n);
+    }
+    offset += n;
+  }
+}
+
+void MemStore::Object::write(uint64_t offset, const bufferlist &bl)
+{
+  const uint64_t page_size = pool->page_size;
+  uint64_t pos = offset;
+  for (list<bufferptr>::const_iterator i = bl.buffers().begin();
+       i != bl.buffers().end();
+       ++i) {
+    const char *src = i->c_str();
+    uint64_t left = i->length();
+    while (left) {
+      uint64_t index = pos / page_size;
+      uint64_t page_off = pos % page_size;
+      uint64_t n = MIN(page_size - page_off, left);
+      map<uint64_t,PageRef>::iterator p = pages.find(index);
+      if (p == pages.end() || p->second.use_count() > 1 ||
+	  p->second->data.raw_nref() > 1) {
+	// missing or shared with a clone or reader: a whole page
+	// overwrite needs a fresh page, anything less a private copy
+	PageRef page;
+	if (n == page_size)
+	  page.reset(new Page(pool, false));
+	else if (p == pages.end())
+	  page.reset(new Page(pool));
+	else {
+	  page.reset(new Page(pool, *p->second));
+	  ++pool->cow_pages;
+	}
+	pages[index] = page;
+	memcpy(page->data.c_str() + page_off, src, n);
+      } else {
+	memcpy(p->second->data.c_str() + page_off, src, n);
+      }
+      src += n;
+      left -= n;
+      pos += n;
+    }
+  }
+  if (pos > data_len)
+    data_len = pos;
+}
+
+void MemStore::Object::zero(uint64_t offset, uint64_t len)
+{
+  const uint64_t page_size = pool->page_size;
+  uint64_t end = offset + len;
+  uint64_t pos = offset;
+  while (pos < end) {
+    uint64_t index = pos / page_size;
+    uint64_t page_off = pos % page_size;
+    uint64_t n = MIN(page_size - page_off, end - pos);
+    map<uint64_t,PageRef>::iterator p = pages.find(index);
+    if (p != pages.end()) {
+      if (n == page_size) {
+	pages.erase(p);   // becomes a hole
+      } else {
+	bufferlist z;
+	z.append_zero(n);
+	write(pos, z);
+      }
+    }
+    pos += n;
+  }
+  if (end > data_len)
+    data_len = end;
+}
+
+void MemStore::Object::truncate(uint64_t size)
+{
+  const uint64_t page_size = pool->page_size;
+  if (size < data_len) {
+    pages.erase(pages.lower_bound((size + page_size - 1) / page_size),
+		pages.end());
+    uint64_t tail = size % page_size;
+    if (tail && pages.count(size / page_size)) {
+      // later extension must read zeros past the new end
+      bufferlist z;
+      z.append_zero(page_size - tail);
+      write(size, z);
+    }
+  }
+  data_len = size;
+}
+
+void MemStore::Object::clone_range(const Object &src, uint64_t srcoff,
+				   uint64_t len, uint64_t dstoff)
+{
+  const uint64_t page_size = pool->page_size;
+  uint64_t done = 0;
+  while (done < len) {
+    uint64_t s = srcoff + done;
+    uint64_t d = dstoff + done;
+    if (s % page_size == 0 && d % page_size == 0 && len - done >= page_size) {
+      map<uint64_t,PageRef>::const_iterator p = src.pages.find(s / page_size);
+      if (p == src.pages.end()) {
+	pages.erase(d / page_size);
+      } else {
+	pages[d / page_size] = p->second;
+	++pool->shared_pages;
+      }
+      done += page_size;
+      continue;
+    }
+    uint64_t n = MIN(page_size - s % page_size, page_size - d % page_size);
+    n = MIN(n, len - done);
+    bufferlist bl;
+    src.read(s, n, &bl);
+    write(d, bl);
+    done += n;
+  }
+  if (dstoff + len > data_len)
+    data_len = dstoff + len;
+}
+
+void MemStore::Object::clone(const Object &src)
+{
+  pages = src.pages;
+  data_len = src.data_len;
+  pool->shared_pages += pages.size();
+}
+
+void MemStore::Object::fiemap(uint64_t offset, uint64_t len,
+			      map<uint64_t,uint64_t> *extents) const
+{
+  const uint64_t page_size = pool->page_size;
+  uint64_t end = MIN(offset + len, data_len);
+  for (map<uint64_t,PageRef>::const_iterator p =
+	 pages.lower_bound(offset / page_size);
+       p != pages.end() && p->first * page_size < end;
+       ++p) {
+    uint64_t start = MAX(p->first * page_size, offset);
+    uint64_t stop = MIN((p->first + 1) * page_size, end);
+    if (!extents->empty() &&
+	extents->rbegin()->first + extents->rbegin()->second == start)
+      extents->rbegin()->second += stop - start;
+    else
+      (*extents)[start] = stop - start;
+  }
+}
+
+// -- MemStore --
+
 int MemStore::peek_journal_fsid(uuid_d *fsid)
 {
   *fsid = uuid_d();
@@ -170,11 +400,10 @@ int MemStore::_load()
     int r = cbl.read_file(fn.c_str(), &err);
     if (r < 0)
       return r;
-    CollectionRef c(new Collection);
+    CollectionRef c(new Collection(&pool));
     bufferlist::iterator p = cbl.begin();
     c->decode(p);
     coll_map[*q] = c;
-    used_bytes += c->used_bytes();
   }
 
   fn = path + "/sharded";
@@ -240,6 +469,8 @@ int MemStore::statfs(struct statfs *st)
   // Device size is a configured constant
   st->f_blocks = g_conf->memstore_device_bytes / st->f_bsize;
 
+  // Pages shared between clones are only counted once
+  uint64_t used_bytes = pool.bytes.read();
   dout(10) << __func__ << ": used_bytes: " << used_bytes << "/" << g_conf->memstore_device_bytes << dendl;
   st->f_bfree = st->f_bavail = MAX((long(st->f_blocks) - long(used_bytes / st->f_bsize)), 0);
 
@@ -293,7 +524,7 @@ int MemStore::stat(
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  st->st_size = o->data.length();
+  st->st_size = o->get_size();
   st->st_blksize = 4096;
   st->st_blocks = (st->st_size + st->st_blksize - 1) / st->st_blksize;
   st->st_nlink = 1;
@@ -319,15 +550,15 @@ int MemStore::read(
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  if (offset >= o->data.length())
+  if (offset >= o->get_size())
     return 0;
   size_t l = len;
   if (l == 0)  // note: len == 0 means read the entire object
-    l = o->data.length();
-  else if (offset + l > o->data.length())
-    l = o->data.length() - offset;
+    l = o->get_size();
+  else if (offset + l > o->get_size())
+    l = o->get_size() - offset;
   bl.clear();
-  bl.substr_of(o->data, offset, l);
+  o->read(offset, l, &bl);
   return bl.length();
 }
 
@@ -344,13 +575,10 @@ int MemStore::fiemap(coll_t cid, const ghobject_t& oid,
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  if (offset >= o->data.length())
+  if (offset >= o->get_size())
     return 0;
-  size_t l = len;
-  if (offset + l > o->data.length())
-    l = o->data.length() - offset;
   map<uint64_t, uint64_t> m;
-  m[offset] = l;
+  o->fiemap(offset, len, &m);
   ::encode(m, bl);
   return 0;  
 }
@@ -629,6 +857,7 @@ int MemStore::queue_transactions(Sequencer *osr,
 
     _do_transaction(**p);
   }
+  _update_perf_counters();
 
   Context *on_apply = NULL, *on_apply_sync = NULL, *on_commit = NULL;
   ObjectStore::Transaction::collect_contexts(tls, &on_apply, &on_commit,
@@ -998,7 +1227,7 @@ int MemStore::_touch(coll_t cid, const ghobject_t& oid)
 
   ObjectRef o = c->get_object(oid);
   if (!o) {
-    o.reset(new Object);
+    o = c->create_object();
     c->object_map[oid] = o;
     c->object_hash[oid] = o;
   }
@@ -1021,56 +1250,36 @@ int MemStore::_write(coll_t cid, const ghobject_t& oid,
   ObjectRef o = c->get_object(oid);
   if (!o) {
     // write implicitly creates a missing object
-    o.reset(new Object);
+    o = c->create_object();
     c->object_map[oid] = o;
     c->object_hash[oid] = o;
   }
 
-  int old_size = o->data.length();
-  _write_into_bl(bl, offset, &o->data);
-  used_bytes += (o->data.length() - old_size);
-
+  if (!_have_pages(o->pages_needed(offset, len)))
+    return -ENOSPC;
+  o->write(offset, bl);
   return 0;
 }
 
-void MemStore::_write_into_bl(const bufferlist& src, unsigned offset,
-			      bufferlist *dst)
-{
-  unsigned len = src.length();
-
-  // before
-  bufferlist newdata;
-  if (dst->length() >= offset) {
-    newdata.substr_of(*dst, 0, offset);
-  } else {
-    newdata.substr_of(*dst, 0, dst->length());
-    bufferptr bp(offset - dst->length());
-    bp.zero();
-    newdata.append(bp);
-  }
-
-  newdata.append(src);
-
-  // after
-  if (dst->length() > offset + len) {
-    bufferlist tail;
-    tail.substr_of(*dst, offset + len, dst->length() - (offset + len));
-    newdata.append(tail);
-  }
-
-  dst->claim(newdata);
-}
-
 int MemStore::_zero(coll_t cid, const ghobject_t& oid,
 		    uint64_t offset, size_t len)
 {
   dout(10) << __func__ << " " << cid << " " << oid << " " << offset << "~"
 	   << len << dendl;
-  bufferptr bp(len);
-  bp.zero();
-  bufferlist bl;
-  bl.push_back(bp);
-  return _write(cid, oid, offset, len, bl);
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  RWLock::WLocker l(c->lock);
+
+  ObjectRef o = c->get_object(oid);
+  if (!o) {
+    // zero implicitly creates a missing object, like write
+    o = c->create_object();
+    c->object_map[oid] = o;
+    c->object_hash[oid] = o;
+  }
+  o->zero(offset, len);
+  return 0;
 }
 
 int MemStore::_truncate(coll_t cid, const ghobject_t& oid, uint64_t size)
@@ -1084,19 +1293,7 @@ int MemStore::_truncate(coll_t cid, const ghobject_t& oid, uint64_t size)
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  if (o->data.length() > size) {
-    bufferlist bl;
-    bl.substr_of(o->data, 0, size);
-    used_bytes -= o->data.length() - size;
-    o->data.claim(bl);
-  } else if (o->data.length() == size) {
-    // do nothing
-  } else {
-    bufferptr bp(size - o->data.length());
-    bp.zero();
-    used_bytes += bp.length();
-    o->data.append(bp);
-  }
+  o->truncate(size);
   return 0;
 }
 
@@ -1113,9 +1310,6 @@ int MemStore::_remove(coll_t cid, const ghobject_t& oid)
     return -ENOENT;
   c->object_map.erase(oid);
   c->object_hash.erase(oid);
-
-  used_bytes -= o->data.length();
-
   return 0;
 }
 
@@ -1183,12 +1377,11 @@ int MemStore::_clone(coll_t cid, const ghobject_t& oldoid,
     return -ENOENT;
   ObjectRef no = c->get_object(newoid);
   if (!no) {
-    no.reset(new Object);
+    no = c->create_object();
     c->object_map[newoid] = no;
     c->object_hash[newoid] = no;
   }
-  used_bytes += oo->data.length() - no->data.length();
-  no->data = oo->data;
+  no->clone(*oo);
   no->omap_header = oo->omap_header;
   no->omap = oo->omap;
   no->xattr = oo->xattr;
@@ -1213,21 +1406,18 @@ int MemStore::_clone_range(coll_t cid, const ghobject_t& oldoid,
     return -ENOENT;
   ObjectRef no = c->get_object(newoid);
   if (!no) {
-    no.reset(new Object);
+    no = c->create_object();
     c->object_map[newoid] = no;
     c->object_hash[newoid] = no;
   }
-  if (srcoff >= oo->data.length())
+  if (srcoff >= oo->get_size())
     return 0;
-  if (srcoff + len >= oo->data.length())
-    len = oo->data.length() - srcoff;
-  bufferlist bl;
-  bl.substr_of(oo->data, srcoff, len);
-
-  int old_size = no->data.length();
-  _write_into_bl(bl, dstoff, &no->data);
-  used_bytes += (no->data.length() - old_size);
-
+  if (srcoff + len >= oo->get_size())
+    len = oo->get_size() - srcoff;
+  // pessimistic: aligned pages end up shared rather than allocated
+  if (!_have_pages(no->pages_needed(dstoff, len)))
+    return -ENOSPC;
+  no->clone_range(*oo, srcoff, len, dstoff);
   return len;
 }
 
@@ -1294,10 +1484,9 @@ int MemStore::_omap_rmkeyrange(coll_t cid, const ghobject_t &oid,
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  map<string,bufferlist>::iterator p = o->omap.upper_bound(first);
-  map<string,bufferlist>::iterator e = o->omap.lower_bound(last);
-  while (p != e)
-    o->omap.erase(p++);
+  if (first >= last)
+    return 0;
+  o->omap.erase(o->omap.lower_bound(first), o->omap.lower_bound(last));
   return 0;
 }
 
@@ -1324,7 +1513,7 @@ int MemStore::_create_collection(coll_t cid)
   ceph::unordered_map<coll_t,CollectionRef>::iterator cp = coll_map.find(cid);
   if (cp != coll_map.end())
     return -EEXIST;
-  coll_map[cid].reset(new Collection);
+  coll_map[cid].reset(new Collection(&pool));
   return 0;
 }
 
@@ -1340,7 +1529,6 @@ int MemStore::_destroy_collection(coll_t cid)
     if (!cp->second->object_map.empty())
       return -ENOTEMPTY;
   }
-  used_bytes -= cp->second->used_bytes();
   coll_map.erase(cp);
   return 0;
 }
@@ -17,22 +17,92 @@
 #define CEPH_MEMSTORE_H
 
 #include "include/assert.h"
+#include "include/atomic.h"
 #include "include/unordered_map.h"
 #include "include/memory.h"
 #include "common/Finisher.h"
 #include "common/RWLock.h"
+#include "common/perf_counters.h"
 #include "ObjectStore.h"
 
+enum {
+  l_memstore_first = 84100,
+  l_memstore_bytes,
+  l_memstore_pages_cow,
+  l_memstore_pages_shared,
+  l_memstore_last,
+};
+
 class MemStore : public ObjectStore {
 public:
+  /// Store-wide page accounting, shared by all objects
+  struct PagePool {
+    uint64_t page_size;
+    atomic64_t bytes;        ///< bytes in allocated pages
+    uint64_t cow_pages;      ///< pages copied because they were shared
+    uint64_t shared_pages;   ///< pages shared by clones instead of copied
+
+    PagePool(uint64_t page_size)
+      : page_size(page_size), cow_pages(0), shared_pages(0) {}
+  };
+
+  /**
+   * Fixed size chunk of object data.  Pages are shared between objects
+   * by clone/clone_range and copied on first write; reads hand out
+   * references to them, so a page still referenced by a reader is also
+   * copied before it is written.
+   */
+  struct Page {
+    PagePool *pool;
+    bufferptr data;
+
+    Page(PagePool *pool, bool zero=true)
+      : pool(pool), data(buffer::create_page_aligned(pool->page_size)) {
+      if (zero)
+	data.zero();
+      pool->bytes.add(data.length());
+    }
+    Page(PagePool *pool, const Page &o)
+      : pool(pool), data(buffer::create_page_aligned(pool->page_size)) {
+      memcpy(data.c_str(), o.data.c_str(), data.length());
+      pool->bytes.add(data.length());
+    }
+    ~Page() {
+      pool->bytes.sub(data.length());
+    }
+  };
+  typedef ceph::shared_ptr<Page> PageRef;
+
   struct Object {
-    bufferlist data;
+    PagePool *pool;
+    map<uint64_t,PageRef> pages;  ///< by page index; missing pages are holes
+    uint64_t data_len;
     map<string,bufferptr> xattr;
     bufferlist omap_header;
     map<string,bufferlist> omap;
 
+    Object(PagePool *pool) : pool(pool), data_len(0) {}
+
+    uint64_t get_size() const {
+      return data_len;
+    }
+    void read(uint64_t offset, uint64_t len, bufferlist *bl) const;
+    /// pages a write to offset~len would have to allocate
+    uint64_t pages_needed(uint64_t offset, uint64_t len) const;
+    void write(uint64_t offset, const bufferlist &bl);
+    void zero(uint64_t offset, uint64_t len);
+    void truncate(uint64_t size);
+    /// copy src's data, sharing whole pages where alignment allows
+    void clone_range(const Object &src, uint64_t srcoff, uint64_t len,
+		     uint64_t dstoff);
+    void clone(const Object &src);
+    void fiemap(uint64_t offset, uint64_t len,
+		map<uint64_t,uint64_t> *extents) const;
+
     void encode(bufferlist& bl) const {
       ENCODE_START(1, 1, bl);
+      bufferlist data;
+      read(0, data_len, &data);
       ::encode(data, bl);
       ::encode(xattr, bl);
       ::encode(omap_header, bl);
@@ -41,14 +111,19 @@ public:
     }
     void decode(bufferlist::iterator& p) {
       DECODE_START(1, p);
+      bufferlist data;
       ::decode(data, p);
+      pages.clear();
+      data_len = 0;
+      write(0, data);
       ::decode(xattr, p);
       ::decode(omap_header, p);
       ::decode(omap, p);
       DECODE_FINISH(p);
     }
     void dump(Formatter *f) const {
-      f->dump_int("data_len", data.length());
+      f->dump_int("data_len", data_len);
+      f->dump_int("pages", pages.size());
       f->dump_int("omap_header_len", omap_header.length());
 
       f->open_array_section("xattrs");
@@ -77,6 +152,7 @@ public:
   typedef ceph::shared_ptr<Object> ObjectRef;
 
   struct Collection {
+    PagePool *pool;
     ceph::unordered_map<ghobject_t, ObjectRef> object_hash;  ///< for lookup
     map<ghobject_t, ObjectRef> object_map;        ///< for iteration
     map<string,bufferptr> xattr;
@@ -94,6 +170,10 @@ public:
       return o->second;
     }
 
+    ObjectRef create_object() const {
+      return ObjectRef(new Object(pool));
+    }
+
     void encode(bufferlist& bl) const {
       ENCODE_START(1, 1, bl);
       ::encode(xattr, bl);
@@ -115,7 +195,7 @@ public:
       while (s--) {
 	ghobject_t k;
 	::decode(k, p);
-	ObjectRef o(new Object);
+	ObjectRef o = create_object();
 	o->decode(p);
 	object_map.insert(make_pair(k, o));
 	object_hash.insert(make_pair(k, o));
@@ -123,18 +203,8 @@ public:
       DECODE_FINISH(p);
     }
 
-    uint64_t used_bytes() const {
-      uint64_t result = 0;
-      for (map<ghobject_t, ObjectRef>::const_iterator p = object_map.begin();
-	   p != object_map.end();
-	   ++p) {
-        result += p->second->data.length();
-      }
-
-      return result;
-    }
-
-    Collection() : lock("MemStore::Collection::lock") {}
+    Collection(PagePool *pool)
+      : pool(pool), lock("MemStore::Collection::lock") {}
   };
   typedef ceph::shared_ptr<Collection> CollectionRef;
 
@@ -185,6 +255,10 @@ private:
   };
 
 
+  CephContext *cct;
+  PagePool pool;   ///< must outlive coll_map
+  PerfCounters *memstore_logger;
+
   ceph::unordered_map<coll_t, CollectionRef> coll_map;
   RWLock coll_lock;    ///< rwlock to protect coll_map
   Mutex apply_lock;    ///< serialize all updates
@@ -193,11 +267,10 @@ private:
 
   Finisher finisher;
 
-  uint64_t used_bytes;
-
   void _do_transaction(Transaction& t);
-
-  void _write_into_bl(const bufferlist& src, unsigned offset, bufferlist *dst);
+  void _update_perf_counters();
+  /// true if n more pages fit in memstore_device_bytes
+  bool _have_pages(uint64_t n);
 
   int _touch(coll_t cid, const ghobject_t& oid);
   int _write(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len,
@@ -236,14 +309,8 @@ private:
   void dump_all();
 
 public:
-  MemStore(CephContext *cct, const string& path)
-    : ObjectStore(path),
-      coll_lock("MemStore::coll_lock"),
-      apply_lock("MemStore::apply_lock"),
-      finisher(cct),
-      used_bytes(0),
-      sharded(false) {}
-  ~MemStore() { }
+  MemStore(CephContext *cct, const string& path);
+  ~MemStore();
 
   int peek_journal_fsid(uuid_d *fsid);
 
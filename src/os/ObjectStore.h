@@ -57,6 +57,9 @@ enum {
   l_os_j_wr,
   l_os_j_wr_bytes,
   l_os_j_full,
+  l_os_j_aio_inflight,
+  l_os_j_aio_submit_batch,
+  l_os_j_aio_reap_batch,
   l_os_committing,
   l_os_commit,
   l_os_commit_len,
@@ -69,6 +72,7 @@ enum {
   l_os_bytes,
   l_os_apply_lat,
   l_os_queue_lat,
+  l_os_parallel_apply,
   l_os_last,
 };
 
@@ -509,6 +513,29 @@ public:
     }
     uint32_t get_fadvise_flags() { return data.fadvise_flags; }
 
+    /// an object operated on by a transaction, see get_touched_objects()
+    struct touched_object_t {
+      const ghobject_t *oid;  ///< owned by the transaction
+      bool keys_only;         ///< only target of omap_setkeys/omap_rmkeys
+
+      touched_object_t(const ghobject_t *o, bool k) : oid(o), keys_only(k) {}
+    };
+
+    /**
+     * get_touched_objects
+     *
+     * Add every object this transaction operates on to objects, noting
+     * the ones that are only the target of omap key updates
+     * (omap_setkeys/omap_rmkeys), as the pg meta object of an ordinary
+     * OSD write is.  The pointers stay valid as long as the transaction
+     * is not modified.
+     *
+     * @returns false if the transaction also operates on whole
+     * collections (or is in the legacy encoding), in which case objects
+     * does not describe everything the transaction touches
+     */
+    bool get_touched_objects(vector<touched_object_t> *objects);
+
     void set_use_tbl(bool value) {
       use_tbl = value;
     }
@@ -642,7 +669,8 @@ public:
       if (other.data.largest_data_len > data.largest_data_len) {
 	data.largest_data_len = other.data.largest_data_len;
 	data.largest_data_off = other.data.largest_data_off;
-	data.largest_data_off_in_tbl = tbl.length() + other.data.largest_data_off_in_tbl;
+	data.largest_data_off_in_tbl = (use_tbl ? tbl.length() : data_bl.length()) +
+	  other.data.largest_data_off_in_tbl;
       }
       data.fadvise_flags |= other.data.fadvise_flags;
       tbl.append(other.tbl);
@@ -651,12 +679,15 @@ public:
       on_applied_sync.splice(on_applied_sync.end(), other.on_applied_sync);
 
       //append coll_index & object_index
+      bool identity = true;
       vector<__le32> cm(other.coll_index.size());
       map<coll_t, __le32>::iterator coll_index_p;
       for (coll_index_p = other.coll_index.begin();
            coll_index_p != other.coll_index.end();
            ++coll_index_p) {
         cm[coll_index_p->second] = _get_coll_id(coll_index_p->first);
+        if (cm[coll_index_p->second] != coll_index_p->second)
+          identity = false;
       }
 
       vector<__le32> om(other.object_index.size());
@@ -665,7 +696,18 @@ public:
            object_index_p != other.object_index.end();
            ++object_index_p) {
         om[object_index_p->second] = _get_object_id(object_index_p->first);
-      }      
+        if (om[object_index_p->second] != object_index_p->second)
+          identity = false;
+      }
+
+      if (identity) {
+        //the ids of other are valid as-is (e.g. we were empty or other only
+        //refers to the leading part of our tables), so just share its op
+        //and data buffers instead of copying and rewriting them
+        op_bl.append(other.op_bl);
+        data_bl.append(other.data_bl);
+        return;
+      }
 
       //the other.op_bl SHOULD NOT be changes during append operation,
       //we use additional bufferlist to avoid this problem
@@ -732,7 +774,8 @@ public:
           return data.largest_data_off_in_tbl +
             sizeof(__u8) +      // encode struct_v
             sizeof(__u8) +      // encode compat_v
-            sizeof(__u32);      // encode len
+            sizeof(__u32) +     // encode len
+            sizeof(__u32);      // data_bl length
         }
       }
       return 0;  // none
@@ -777,8 +820,8 @@ public:
 
       bufferlist::iterator data_bl_p;
 
-      vector<coll_t> colls;
-      vector<ghobject_t> objects;
+      vector<const coll_t*> colls;
+      vector<const ghobject_t*> objects;
 
       iterator(Transaction *t)
         : t(t),
@@ -793,14 +836,14 @@ public:
         for (coll_index_p = t->coll_index.begin();
              coll_index_p != t->coll_index.end();
              ++coll_index_p) {
-          colls[coll_index_p->second] = coll_index_p->first;
+          colls[coll_index_p->second] = &coll_index_p->first;
         }
 
         map<ghobject_t, __le32>::iterator object_index_p;
         for (object_index_p = t->object_index.begin();
              object_index_p != t->object_index.end();
              ++object_index_p) {
-          objects[object_index_p->second] = object_index_p->first;
+          objects[object_index_p->second] = &object_index_p->first;
         }
       }
 
@@ -838,13 +881,13 @@ public:
         ::decode(keys, data_bl_p);
       }
 
-      ghobject_t get_oid(__le32 oid_id) {
+      const ghobject_t &get_oid(__le32 oid_id) {
         assert(oid_id < objects.size());
-        return objects[oid_id];
+        return *objects[oid_id];
       }
-      coll_t get_cid(__le32 cid_id) {
+      const coll_t &get_cid(__le32 cid_id) {
         assert(cid_id < colls.size());
-        return colls[cid_id];
+        return *colls[cid_id];
       }
       uint32_t get_fadvise_flags() const {
 	return t->get_fadvise_flags();
@@ -874,12 +917,13 @@ private:
         op_ptr = bufferptr(sizeof(Op) * OPS_PER_PTR);
 	op_ptr.zero();
       }
-      bufferptr ptr(op_ptr, 0, sizeof(Op));
-      op_bl.append(ptr);
+      // ops carved from the same op_ptr are merged into a single
+      // contiguous bufferptr at the tail of op_bl
+      char* p = op_ptr.c_str();
+      op_bl.append(op_ptr, 0, sizeof(Op));
 
       op_ptr.set_offset(op_ptr.offset() + sizeof(Op));
 
-      char* p = ptr.c_str();
       return reinterpret_cast<Op*>(p);
     }
     __le32 _get_coll_id(const coll_t& coll) {
@@ -978,7 +1022,9 @@ public:
       if (write_data.length() > data.largest_data_len) {
 	data.largest_data_len = write_data.length();
 	data.largest_data_off = off;
-	data.largest_data_off_in_tbl = tbl.length() + sizeof(__u32);  // we are about to
+	// write_data was the last thing encoded, right after its length
+	data.largest_data_off_in_tbl =
+	  (use_tbl ? tbl.length() : data_bl.length()) - write_data.length();
       }
       data.ops++;
     }
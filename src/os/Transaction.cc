@@ -507,6 +507,54 @@ void ObjectStore::Transaction::_build_actions_from_tbl()
 #pragma GCC diagnostic pop
 #pragma GCC diagnostic warning "-Wpragmas"
 
+bool ObjectStore::Transaction::get_touched_objects(
+  vector<touched_object_t> *objects)
+{
+  assert(objects);
+  if (use_tbl)
+    return false;
+
+  // by object index: true once an op other than a key update uses it
+  vector<bool> full(object_index.size(), false);
+  iterator i = begin();
+  while (i.have_op()) {
+    Op *op = i.decode_op();
+    switch (op->op) {
+    case OP_MKCOLL:
+    case OP_RMCOLL:
+    case OP_COLL_ADD:
+    case OP_COLL_MOVE:
+    case OP_COLL_MOVE_RENAME:
+    case OP_COLL_SETATTR:
+    case OP_COLL_SETATTRS:
+    case OP_COLL_RMATTR:
+    case OP_COLL_RENAME:
+    case OP_COLL_HINT:
+    case OP_SPLIT_COLLECTION:
+    case OP_SPLIT_COLLECTION2:
+      return false;
+    case OP_OMAP_SETKEYS:
+    case OP_OMAP_RMKEYS:
+      break;
+    case OP_CLONE:
+    case OP_CLONERANGE:
+    case OP_CLONERANGE2:
+      if (op->dest_oid < full.size())
+	full[op->dest_oid] = true;
+      // fall through
+    default:
+      if (op->oid < full.size())
+	full[op->oid] = true;
+    }
+  }
+
+  for (map<ghobject_t, __le32>::iterator p = object_index.begin();
+       p != object_index.end();
+       ++p)
+    objects->push_back(touched_object_t(&p->first, !full[p->second]));
+  return true;
+}
+
 void ObjectStore::Transaction::dump(ceph::Formatter *f)
 {
   f->open_array_section("ops");
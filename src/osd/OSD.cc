@@ -202,6 +202,8 @@ OSDService::OSDService(OSD *osd) :
   recovery_gen_wq("recovery_gen_wq", cct->_conf->osd_recovery_thread_timeout,
 		  &osd->recovery_tp),
   op_gen_wq("op_gen_wq", cct->_conf->osd_recovery_thread_timeout, &osd->osd_tp),
+  deep_scrub_gen_wq("deep_scrub_gen_wq", cct->_conf->osd_scrub_thread_timeout,
+		    &osd->deep_scrub_tp),
   class_handler(osd->class_handler),
   pg_epoch_lock("OSDService::pg_epoch_lock"),
   publish_lock("OSDService::publish_lock"),
@@ -209,6 +211,9 @@ OSDService::OSDService(OSD *osd) :
   peer_map_epoch_lock("OSDService::peer_map_epoch_lock"),
   sched_scrub_lock("OSDService::sched_scrub_lock"), scrubs_pending(0),
   scrubs_active(0),
+  scrub_budget_bytes(0), scrub_budget_ops(0),
+  snap_trim_budget_lock("OSDService::snap_trim_budget_lock"),
+  snap_trim_budget_ops(0),
   agent_lock("OSD::agent_lock"),
   agent_valid_iterator(false),
   agent_ops(0),
@@ -952,6 +957,75 @@ void OSDService::dec_scrubs_active()
   sched_scrub_lock.Unlock();
 }
 
+void OSDService::_scrub_budget_refill(utime_t now)
+{
+  assert(sched_scrub_lock.is_locked());
+  double bps = cct->_conf->osd_deep_scrub_bytes_per_sec;
+  double ops = cct->_conf->osd_deep_scrub_ops_per_sec;
+  if (scrub_budget_stamp != utime_t() && now > scrub_budget_stamp) {
+    double elapsed = (double)(now - scrub_budget_stamp);
+    // allow a burst of up to one second worth of io
+    scrub_budget_bytes = MIN(scrub_budget_bytes + elapsed * bps, bps);
+    scrub_budget_ops = MIN(scrub_budget_ops + elapsed * ops, ops);
+  }
+  scrub_budget_stamp = now;
+}
+
+void OSDService::scrub_budget_charge(uint64_t bytes, uint64_t ops,
+				      utime_t now)
+{
+  Mutex::Locker l(sched_scrub_lock);
+  _scrub_budget_refill(now);
+  if (cct->_conf->osd_deep_scrub_bytes_per_sec > 0)
+    scrub_budget_bytes -= bytes;
+  if (cct->_conf->osd_deep_scrub_ops_per_sec > 0)
+    scrub_budget_ops -= ops;
+}
+
+double OSDService::scrub_budget_wait(utime_t now)
+{
+  Mutex::Locker l(sched_scrub_lock);
+  _scrub_budget_refill(now);
+  double bps = cct->_conf->osd_deep_scrub_bytes_per_sec;
+  double ops = cct->_conf->osd_deep_scrub_ops_per_sec;
+  double wait = 0;
+  if (bps > 0 && scrub_budget_bytes < 0)
+    wait = MAX(wait, -scrub_budget_bytes / bps);
+  if (ops > 0 && scrub_budget_ops < 0)
+    wait = MAX(wait, -scrub_budget_ops / ops);
+  return wait;
+}
+
+void OSDService::_snap_trim_budget_refill(utime_t now)
+{
+  assert(snap_trim_budget_lock.is_locked());
+  double ops = cct->_conf->osd_snap_trim_ops_per_sec;
+  if (snap_trim_budget_stamp != utime_t() && now > snap_trim_budget_stamp) {
+    double elapsed = (double)(now - snap_trim_budget_stamp);
+    snap_trim_budget_ops = MIN(snap_trim_budget_ops + elapsed * ops, ops);
+  }
+  snap_trim_budget_stamp = now;
+}
+
+void OSDService::snap_trim_budget_charge(uint64_t ops)
+{
+  if (cct->_conf->osd_snap_trim_ops_per_sec <= 0)
+    return;
+  Mutex::Locker l(snap_trim_budget_lock);
+  _snap_trim_budget_refill(ceph_clock_now(cct));
+  snap_trim_budget_ops -= ops;
+}
+
+double OSDService::snap_trim_budget_wait()
+{
+  double ops = cct->_conf->osd_snap_trim_ops_per_sec;
+  if (ops <= 0)
+    return 0;
+  Mutex::Locker l(snap_trim_budget_lock);
+  _snap_trim_budget_refill(ceph_clock_now(cct));
+  return snap_trim_budget_ops < 0 ? -snap_trim_budget_ops / ops : 0;
+}
+
 void OSDService::retrieve_epochs(epoch_t *_boot_epoch, epoch_t *_up_epoch,
                                  epoch_t *_bind_epoch) const
 {
@@ -1487,6 +1561,8 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   recovery_tp(cct, "OSD::recovery_tp", cct->_conf->osd_recovery_threads, "osd_recovery_threads"),
   disk_tp(cct, "OSD::disk_tp", cct->_conf->osd_disk_threads, "osd_disk_threads"),
   command_tp(cct, "OSD::command_tp", 1),
+  deep_scrub_tp(cct, "OSD::deep_scrub_tp", cct->_conf->osd_deep_scrub_threads,
+		"osd_deep_scrub_threads"),
   paused_recovery(false),
   session_waiting_lock("OSD::session_waiting_lock"),
   heartbeat_lock("OSD::heartbeat_lock"),
@@ -1523,6 +1599,7 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   pg_stat_queue_lock("OSD::pg_stat_queue_lock"),
   osd_stat_updated(false),
   pg_stat_tid(0), pg_stat_tid_flushed(0),
+  pg_stat_tid_session(0), pg_stat_mon_features(0),
   command_wq(
     this,
     cct->_conf->osd_command_thread_timeout,
@@ -1879,6 +1956,7 @@ int OSD::init()
   recovery_tp.start();
   disk_tp.start();
   command_tp.start();
+  deep_scrub_tp.start();
 
   set_disk_tp_priority();
 
@@ -2177,6 +2255,10 @@ void OSD::create_logger()
   osd_plb.add_time_avg(l_osd_tier_flush_lat, "osd_tier_flush_lat", "Object flush latency");
   osd_plb.add_time_avg(l_osd_tier_promote_lat, "osd_tier_promote_lat", "Object promote latency");
   osd_plb.add_time_avg(l_osd_tier_r_lat, "osd_tier_r_lat", "Object proxy read latency");
+  osd_plb.add_u64_counter(l_osd_op_wq_steal_pgs, "op_wq_steal_pgs", "PGs moved to an idle op queue shard");
+  osd_plb.add_u64_counter(l_osd_op_wq_steal_ops, "op_wq_steal_ops", "Ops moved to an idle op queue shard");
+  osd_plb.add_u64_counter(l_osd_op_fast_read, "op_fast_read", "Client reads served without the PG lock");
+  osd_plb.add_u64_counter(l_osd_op_nolock_reply, "op_nolock_reply", "Replica replies handled without the PG lock");
 
   logger = osd_plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
@@ -2348,6 +2430,11 @@ int OSD::shutdown()
   disk_tp.stop();
   dout(10) << "disk tp paused (new)" << dendl;
 
+  // after disk_tp, whose scrubs may be waiting for it
+  deep_scrub_tp.drain();
+  deep_scrub_tp.stop();
+  dout(10) << "deep scrub tp stopped" << dendl;
+
   dout(10) << "stopping agent" << dendl;
   service.agent_stop();
 
@@ -2752,6 +2839,50 @@ PG *OSD::_lookup_lock_pg_with_map_lock_held(spg_t pgid)
   return pg;
 }
 
+struct PGStateLoad {
+  map<spg_t, interval_set<snapid_t> >::iterator pgs_entry;
+  PG *pg;
+  bufferlist bl;
+  PGStateLoad(map<spg_t, interval_set<snapid_t> >::iterator e)
+    : pgs_entry(e), pg(NULL) {}
+};
+
+/// reads pg info and log for load_pgs on a temporary thread pool
+struct LoadPGStateWQ : public ThreadPool::WorkQueue<PGStateLoad> {
+  ObjectStore *store;
+  list<PGStateLoad*> q;
+
+  LoadPGStateWQ(ObjectStore *store, time_t ti, ThreadPool *tp)
+    : ThreadPool::WorkQueue<PGStateLoad>("OSD::LoadPGStateWQ", ti, 0, tp),
+      store(store) {}
+
+  bool _enqueue(PGStateLoad *load) {
+    q.push_back(load);
+    return true;
+  }
+  void _dequeue(PGStateLoad *load) {
+    assert(0);
+  }
+  PGStateLoad *_dequeue() {
+    if (q.empty())
+      return NULL;
+    PGStateLoad *load = q.front();
+    q.pop_front();
+    return load;
+  }
+  bool _empty() {
+    return q.empty();
+  }
+  void _process(PGStateLoad *load, ThreadPool::TPHandle &handle) {
+    load->pg->lock();
+    load->pg->read_state(store, load->bl);
+    load->pg->unlock();
+  }
+  void _clear() {
+    assert(q.empty());
+  }
+};
+
 void OSD::load_pgs()
 {
   assert(osd_lock.is_locked());
@@ -2800,7 +2931,9 @@ void OSD::load_pgs()
     dout(10) << "load_pgs ignoring unrecognized " << *it << dendl;
   }
 
-  bool has_upgraded = false;
+  // open every pg first, then read their info and logs (the bulk of the
+  // startup cost) in parallel before finishing them off in order
+  vector<PGStateLoad*> loads;
   for (map<spg_t, interval_set<snapid_t> >::iterator i = pgs.begin();
        i != pgs.end();
        ++i) {
@@ -2819,8 +2952,8 @@ void OSD::load_pgs()
     }
 
     dout(10) << "pgid " << pgid << " coll " << coll_t(pgid) << dendl;
-    bufferlist bl;
-    epoch_t map_epoch = PG::peek_map_epoch(store, pgid, &bl);
+    PGStateLoad *load = new PGStateLoad(i);
+    epoch_t map_epoch = PG::peek_map_epoch(store, pgid, &load->bl);
 
     PG *pg = NULL;
     if (map_epoch > 0) {
@@ -2832,6 +2965,7 @@ void OSD::load_pgs()
 	       << "current map, so this is probably a result of bug 10617.  "
 	       << "Skipping the pg for now, you can use ceph_objectstore_tool "
 	       << "to clean it up later." << dendl;
+	  delete load;
 	  continue;
 	} else {
 	  derr << __func__ << ": have pgid " << pgid << " at epoch "
@@ -2845,9 +2979,42 @@ void OSD::load_pgs()
       pg = _open_lock_pg(osdmap, pgid);
     }
     // there can be no waiters here, so we don't call wake_pg_waiters
+    pg->unlock();
+    load->pg = pg;
+    loads.push_back(load);
+  }
+
+  // read pg state, log
+  if (cct->_conf->osd_load_pgs_threads > 1 && loads.size() > 1) {
+    ThreadPool load_tp(cct, "OSD::load_pgs_tp",
+		       MIN((int)loads.size(), cct->_conf->osd_load_pgs_threads));
+    LoadPGStateWQ load_wq(store, cct->_conf->osd_op_thread_timeout, &load_tp);
+    load_tp.start();
+    for (vector<PGStateLoad*>::iterator p = loads.begin();
+	 p != loads.end();
+	 ++p)
+      load_wq.queue(*p);
+    load_wq.drain();
+    load_tp.stop();
+  } else {
+    for (vector<PGStateLoad*>::iterator p = loads.begin();
+	 p != loads.end();
+	 ++p) {
+      (*p)->pg->lock();
+      (*p)->pg->read_state(store, (*p)->bl);
+      (*p)->pg->unlock();
+    }
+  }
 
-    // read pg state, log
-    pg->read_state(store, bl);
+  bool has_upgraded = false;
+  for (vector<PGStateLoad*>::iterator p = loads.begin();
+       p != loads.end();
+       ++p) {
+    map<spg_t, interval_set<snapid_t> >::iterator i = (*p)->pgs_entry;
+    spg_t pgid(i->first);
+    PG *pg = (*p)->pg;
+    delete *p;
+    pg->lock();
 
     if (pg->must_upgrade()) {
       if (!pg->can_upgrade()) {
@@ -4306,6 +4473,11 @@ void OSD::ms_handle_connect(Connection *con)
     if (is_stopping())
       return;
     dout(10) << "ms_handle_connect on mon" << dendl;
+    // whatever was in flight to the old mon will not be acked
+    pg_stat_queue_lock.Lock();
+    pg_stat_tid_session = pg_stat_tid;
+    pg_stat_mon_features = con->get_features();
+    pg_stat_queue_lock.Unlock();
     if (is_booting()) {
       start_boot();
     } else {
@@ -4603,7 +4775,7 @@ void OSD::send_still_alive(epoch_t epoch, const entity_inst_t &i)
   monc->send_mon_message(m);
 }
 
-void OSD::send_pg_stats(const utime_t &now)
+void OSD::send_pg_stats(const utime_t &now, bool force)
 {
   assert(osd_lock.is_locked());
 
@@ -4615,6 +4787,18 @@ void OSD::send_pg_stats(const utime_t &now)
    
   pg_stat_queue_lock.Lock();
 
+  // don't pile reports up behind a mon that is slow to commit them; what
+  // is still queued goes out with the next report anyway
+  uint64_t in_flight =
+    pg_stat_tid - MAX(pg_stat_tid_flushed, pg_stat_tid_session);
+  if (!force && cct->_conf->osd_mon_report_max_in_flight > 0 &&
+      in_flight >= (uint64_t)cct->_conf->osd_mon_report_max_in_flight) {
+    dout(10) << "send_pg_stats - " << in_flight << " reports in flight, waiting"
+	     << dendl;
+    pg_stat_queue_lock.Unlock();
+    return;
+  }
+
   if (osd_stat_updated || !pg_stat_queue.empty()) {
     last_pg_stats_sent = now;
     osd_stat_updated = false;
@@ -4624,6 +4808,9 @@ void OSD::send_pg_stats(const utime_t &now)
     utime_t had_for(now);
     had_for -= had_map_since;
 
+    bool use_delta = cct->_conf->osd_pg_stat_delta &&
+      (pg_stat_mon_features & CEPH_FEATURE_MON_PGSTAT_DELTA);
+
     MPGStats *m = new MPGStats(monc->get_fsid(), osdmap->get_epoch(), had_for);
     m->set_tid(++pg_stat_tid);
     m->osd_stat = cur_stat;
@@ -4639,7 +4826,13 @@ void OSD::send_pg_stats(const utime_t &now)
       }
       pg->pg_stats_publish_lock.Lock();
       if (pg->pg_stats_publish_valid) {
-	m->pg_stat[pg->info.pgid.pgid] = pg->pg_stats_publish;
+	if (use_delta && pg->pg_stats_acked_valid) {
+	  pg->pg_stats_publish.encode_delta(pg->pg_stats_acked,
+					    m->pg_stat_delta[pg->info.pgid.pgid]);
+	  pg->pg_stats_delta_tid = pg_stat_tid;
+	} else {
+	  m->pg_stat[pg->info.pgid.pgid] = pg->pg_stats_publish;
+	}
 	dout(25) << " sending " << pg->info.pgid << " " << pg->pg_stats_publish.reported_epoch << ":"
 		 << pg->pg_stats_publish.reported_seq << dendl;
       } else {
@@ -4686,10 +4879,18 @@ void OSD::handle_pg_stats_ack(MPGStatsAck *ack)
     if (ack->pg_stat.count(pg->info.pgid.pgid)) {
       pair<version_t,epoch_t> acked = ack->pg_stat[pg->info.pgid.pgid];
       pg->pg_stats_publish_lock.Lock();
-      if (acked.first == pg->pg_stats_publish.reported_seq &&
+      if (acked.first == 0 && acked.second == 0) {
+	dout(20) << " delta nacked on " << pg->info.pgid << ", will send full stats"
+		 << dendl;
+	pg->pg_stats_acked_valid = false;
+	pg->pg_stats_delta_tid = 0;
+      } else if (acked.first == pg->pg_stats_publish.reported_seq &&
 	  acked.second == pg->pg_stats_publish.reported_epoch) {
 	dout(25) << " ack on " << pg->info.pgid << " " << pg->pg_stats_publish.reported_epoch
 		 << ":" << pg->pg_stats_publish.reported_seq << dendl;
+	pg->pg_stats_acked = pg->pg_stats_publish;
+	pg->pg_stats_acked_valid = true;
+	pg->pg_stats_delta_tid = 0;
 	pg->stat_queue_item.remove_myself();
 	pg->put("pg_stat_queue");
       } else {
@@ -4700,6 +4901,13 @@ void OSD::handle_pg_stats_ack(MPGStatsAck *ack)
     } else {
       dout(30) << " still pending " << pg->info.pgid << " " << pg->pg_stats_publish.reported_epoch
 	       << ":" << pg->pg_stats_publish.reported_seq << dendl;
+      pg->pg_stats_publish_lock.Lock();
+      if (pg->pg_stats_delta_tid && pg->pg_stats_delta_tid <= ack->get_tid()) {
+	// a mon that predates deltas skipped them
+	pg->pg_stats_acked_valid = false;
+	pg->pg_stats_delta_tid = 0;
+      }
+      pg->pg_stats_publish_lock.Unlock();
     }
   }
   
@@ -4716,7 +4924,7 @@ void OSD::flush_pg_stats()
 {
   dout(10) << "flush_pg_stats" << dendl;
   utime_t now = ceph_clock_now(cct);
-  send_pg_stats(now);
+  send_pg_stats(now, true);
 
   osd_lock.Unlock();
 
@@ -8219,21 +8427,34 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb )
   ShardData* sdata = shard_list[shard_index];
   assert(NULL != sdata);
   sdata->sdata_op_ordering_lock.Lock();
-  if (sdata->pqueue.empty()) {
+  if (sdata->pqueue->empty()) {
     sdata->sdata_op_ordering_lock.Unlock();
-    osd->cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
-    sdata->sdata_lock.Lock();
-    sdata->sdata_cond.WaitInterval(osd->cct, sdata->sdata_lock, utime_t(2, 0));
-    sdata->sdata_lock.Unlock();
+    if (!steal_pg(shard_index)) {
+      osd->cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+      sdata->sdata_lock.Lock();
+      sdata->sdata_cond.WaitInterval(osd->cct, sdata->sdata_lock, utime_t(2, 0));
+      sdata->sdata_lock.Unlock();
+    }
     sdata->sdata_op_ordering_lock.Lock();
-    if(sdata->pqueue.empty()) {
+    if(sdata->pqueue->empty()) {
       sdata->sdata_op_ordering_lock.Unlock();
       return;
     }
   }
-  pair<PGRef, OpRequestRef> item = sdata->pqueue.dequeue();
-  sdata->pg_for_processing[&*(item.first)].push_back(item.second);
+  pair<PGRef, OpRequestRef> item = sdata->pqueue->dequeue();
+  list<OpRequestRef>& pfp = sdata->pg_for_processing[&*(item.first)];
+  pfp.push_back(item.second);
+  int type = item.second->get_req()->get_type();
+  bool fast = osd->cct->_conf->osd_fast_read && pfp.size() == 1 &&
+    type == CEPH_MSG_OSD_OP;
   sdata->sdata_op_ordering_lock.Unlock();
+
+  if (fast && try_fast_read(sdata, item))
+    return;
+  if ((type == MSG_OSD_REPOPREPLY || type == MSG_OSD_SUBOPREPLY) &&
+      try_nolock(sdata, item))
+    return;
+
   ThreadPool::TPHandle tp_handle(osd->cct, hb, timeout_interval, 
     suicide_interval);
 
@@ -8285,22 +8506,111 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb )
   (item.first)->unlock();
 }
 
-void OSD::ShardedOpWQ::_enqueue(pair<PGRef, OpRequestRef> item) {
+/**
+ * Run item without the pg lock if the pg lets us (see PG::do_fast_read).
+ *
+ * item is the only entry of its pg in pg_for_processing, so nothing queued
+ * behind it can overtake it. If another thread popped it for the locked
+ * path meanwhile, or anybody took the pg lock while we were reading, the
+ * result is dropped and we fall back to the locked path: in the first case
+ * that thread's own entry is now ours to pop.
+ *
+ * @return true if the op was consumed
+ */
+bool OSD::ShardedOpWQ::try_fast_read(ShardData *sdata,
+				     pair<PGRef, OpRequestRef> &item)
+{
+  PG *pg = &*(item.first);
+  OpRequestRef op = item.second;
+  uint64_t gen;
+  MOSDOpReply *reply = NULL;
+  op->set_dequeued_time(ceph_clock_now(osd->cct));
+  if (!pg->do_fast_read(op, &gen, &reply))
+    return false;
 
-  uint32_t shard_index = (((item.first)->get_pgid().ps())% shard_list.size());
+  {
+    Mutex::Locker l(sdata->sdata_op_ordering_lock);
+    map<PG*, list<OpRequestRef> >::iterator p =
+      sdata->pg_for_processing.find(pg);
+    if (p == sdata->pg_for_processing.end() || p->second.front() != op ||
+	!pg->fast_read_valid(gen)) {
+      reply->put();
+      return false;
+    }
+    p->second.pop_front();
+    if (p->second.empty())
+      sdata->pg_for_processing.erase(p);
+  }
 
-  ShardData* sdata = shard_list[shard_index];
-  assert (NULL != sdata);
+  op->mark_reached_pg();
+  pg->fast_read_complete(op, reply);
+  osd->logger->inc(l_osd_op_fast_read);
+  osd->service.send_message_osd_client(reply, op->get_req()->get_connection());
+  return true;
+}
+
+/**
+ * Let the pg handle item without its lock (see PG::do_request_nolock).
+ *
+ * Such messages need not be ordered against the pg's other ops, so item is
+ * dropped from pg_for_processing wherever it is. If another thread already
+ * popped it for the locked path (which must cope with that), we go on to
+ * pop that thread's entry instead.
+ *
+ * @return true if the op was consumed
+ */
+bool OSD::ShardedOpWQ::try_nolock(ShardData *sdata,
+				  pair<PGRef, OpRequestRef> &item)
+{
+  PG *pg = &*(item.first);
+  if (!pg->do_request_nolock(item.second))
+    return false;
+  osd->logger->inc(l_osd_op_nolock_reply);
+
+  Mutex::Locker l(sdata->sdata_op_ordering_lock);
+  map<PG*, list<OpRequestRef> >::iterator p =
+    sdata->pg_for_processing.find(pg);
+  if (p == sdata->pg_for_processing.end())
+    return false;
+  list<OpRequestRef>::iterator i =
+    std::find(p->second.begin(), p->second.end(), item.second);
+  if (i == p->second.end())
+    return false;
+  p->second.erase(i);
+  if (p->second.empty())
+    sdata->pg_for_processing.erase(p);
+  return true;
+}
+
+void OSD::ShardedOpWQ::_enqueue_locked(ShardData *sdata,
+					pair<PGRef, OpRequestRef> item,
+					bool front)
+{
+  assert(sdata->sdata_op_ordering_lock.is_locked());
   unsigned priority = item.second->get_req()->get_priority();
   unsigned cost = item.second->get_req()->get_cost();
-  sdata->sdata_op_ordering_lock.Lock();
- 
-  if (priority >= CEPH_MSG_PRIO_LOW)
-    sdata->pqueue.enqueue_strict(
-      item.second->get_req()->get_source_inst(), priority, item);
-  else
-    sdata->pqueue.enqueue(item.second->get_req()->get_source_inst(),
-      priority, cost, item);
+  if (priority >= CEPH_MSG_PRIO_LOW) {
+    if (front)
+      sdata->pqueue->enqueue_strict_front(
+	item.second->get_req()->get_source_inst(), priority, item);
+    else
+      sdata->pqueue->enqueue_strict(
+	item.second->get_req()->get_source_inst(), priority, item);
+  } else {
+    if (front)
+      sdata->pqueue->enqueue_front(item.second->get_req()->get_source_inst(),
+				   priority, cost, item);
+    else
+      sdata->pqueue->enqueue(item.second->get_req()->get_source_inst(),
+			     priority, cost, item);
+  }
+}
+
+void OSD::ShardedOpWQ::_enqueue(pair<PGRef, OpRequestRef> item) {
+
+  ShardData* sdata = lock_pg_shard(&*(item.first));
+  assert (NULL != sdata);
+  _enqueue_locked(sdata, item, false);
   sdata->sdata_op_ordering_lock.Unlock();
 
   sdata->sdata_lock.Lock();
@@ -8311,24 +8621,14 @@ void OSD::ShardedOpWQ::_enqueue(pair<PGRef, OpRequestRef> item) {
 
 void OSD::ShardedOpWQ::_enqueue_front(pair<PGRef, OpRequestRef> item) {
 
-  uint32_t shard_index = (((item.first)->get_pgid().ps())% shard_list.size());
-
-  ShardData* sdata = shard_list[shard_index];
+  ShardData* sdata = lock_pg_shard(&*(item.first));
   assert (NULL != sdata);
-  sdata->sdata_op_ordering_lock.Lock();
   if (sdata->pg_for_processing.count(&*(item.first))) {
     sdata->pg_for_processing[&*(item.first)].push_front(item.second);
     item.second = sdata->pg_for_processing[&*(item.first)].back();
     sdata->pg_for_processing[&*(item.first)].pop_back();
   }
-  unsigned priority = item.second->get_req()->get_priority();
-  unsigned cost = item.second->get_req()->get_cost();
-  if (priority >= CEPH_MSG_PRIO_LOW)
-    sdata->pqueue.enqueue_strict_front(
-      item.second->get_req()->get_source_inst(),priority, item);
-  else
-    sdata->pqueue.enqueue_front(item.second->get_req()->get_source_inst(),
-      priority, cost, item);
+  _enqueue_locked(sdata, item, true);
 
   sdata->sdata_op_ordering_lock.Unlock();
   sdata->sdata_lock.Lock();
@@ -8337,6 +8637,117 @@ void OSD::ShardedOpWQ::_enqueue_front(pair<PGRef, OpRequestRef> item) {
 
 }
 
+/*
+ * Called by an idle thread of shard to_index: move every queued op of one
+ * pg from the longest other shard to ours. Whole pgs move, and only while
+ * none of their ops is between dequeue and processing, so per-pg ordering
+ * is kept.
+ */
+bool OSD::ShardedOpWQ::steal_pg(uint32_t to_index)
+{
+  uint64_t threshold = osd->cct->_conf->osd_op_shard_steal_threshold;
+  if (!threshold || num_shards < 2)
+    return false;
+
+  uint32_t from_index = to_index;
+  unsigned longest = 0;
+  for (uint32_t i = 0; i < num_shards; i++) {
+    if (i == to_index)
+      continue;
+    ShardData* sdata = shard_list[i];
+    if (!sdata->sdata_op_ordering_lock.TryLock())
+      continue;
+    unsigned len = sdata->pqueue->length();
+    sdata->sdata_op_ordering_lock.Unlock();
+    if (len > longest) {
+      longest = len;
+      from_index = i;
+    }
+  }
+  if (longest < threshold)
+    return false;
+
+  ShardData* from = shard_list[from_index];
+  ShardData* to = shard_list[to_index];
+  // take both ordering locks in shard order
+  if (from_index < to_index) {
+    from->sdata_op_ordering_lock.Lock();
+    to->sdata_op_ordering_lock.Lock();
+  } else {
+    to->sdata_op_ordering_lock.Lock();
+    from->sdata_op_ordering_lock.Lock();
+  }
+
+  list<pair<PGRef, OpRequestRef> > moved;
+  if (from->pqueue->length() >= threshold) {
+    pair<PGRef, OpRequestRef> item = from->pqueue->dequeue();
+    PG *pg = &*(item.first);
+    assert(get_shard_index(pg) == from_index);
+    if (from->pg_for_processing.count(pg)) {
+      // ops of this pg are in flight on the other shard, leave it be
+      _enqueue_locked(from, item, true);
+    } else {
+      Pred f(pg);
+      from->pqueue->remove_by_filter(f, &moved);
+      moved.push_front(item);
+      pg->op_wq_shard.set(to_index + 1);
+      for (list<pair<PGRef, OpRequestRef> >::iterator i = moved.begin();
+	   i != moved.end();
+	   ++i)
+	_enqueue_locked(to, *i, false);
+    }
+  }
+
+  to->sdata_op_ordering_lock.Unlock();
+  from->sdata_op_ordering_lock.Unlock();
+
+  if (moved.empty())
+    return false;
+  lgeneric_subdout(osd->cct, osd, 10) << "steal_pg moved "
+    << moved.front().first->get_pgid() << " with " << moved.size()
+    << " ops from shard " << from_index << " to " << to_index << dendl;
+  osd->logger->inc(l_osd_op_wq_steal_pgs);
+  osd->logger->inc(l_osd_op_wq_steal_ops, moved.size());
+  return true;
+}
+
+unsigned OSD::ShardedOpWQ::OpClassifier::get_class(
+  const entity_inst_t &cl,
+  const pair<PGRef, OpRequestRef> &item)
+{
+  switch (item.second->get_req()->get_type()) {
+  case CEPH_MSG_OSD_OP:
+    return OP_CLASS_CLIENT_OP;
+  case MSG_OSD_PG_PUSH:
+  case MSG_OSD_PG_PULL:
+  case MSG_OSD_PG_PUSH_REPLY:
+  case MSG_OSD_PG_SCAN:
+  case MSG_OSD_PG_BACKFILL:
+    return OP_CLASS_RECOVERY;
+  default:
+    return OP_CLASS_OSD_SUBOP;
+  }
+}
+
+OSD::ShardedOpWQ::MClockQueueT::ClientInfo
+OSD::ShardedOpWQ::OpClassifier::get_info(unsigned c)
+{
+  md_config_t *conf = cct->_conf;
+  switch (c) {
+  case OP_CLASS_CLIENT_OP:
+    return MClockQueueT::ClientInfo(conf->osd_op_queue_mclock_client_op_res,
+				    conf->osd_op_queue_mclock_client_op_wgt,
+				    conf->osd_op_queue_mclock_client_op_lim);
+  case OP_CLASS_RECOVERY:
+    return MClockQueueT::ClientInfo(conf->osd_op_queue_mclock_recov_res,
+				    conf->osd_op_queue_mclock_recov_wgt,
+				    conf->osd_op_queue_mclock_recov_lim);
+  default:
+    return MClockQueueT::ClientInfo(conf->osd_op_queue_mclock_osd_subop_res,
+				    conf->osd_op_queue_mclock_osd_subop_wgt,
+				    conf->osd_op_queue_mclock_osd_subop_lim);
+  }
+}
 
 /*
  * NOTE: dequeue called in worker thread, with pg lock
@@ -53,6 +53,7 @@ using namespace std;
 #include "common/simple_cache.hpp"
 #include "common/sharedptr_registry.hpp"
 #include "common/PrioritizedQueue.h"
+#include "common/MClockQueue.h"
 #include "messages/MOSDOp.h"
 
 #define CEPH_OSD_PROTOCOL    10 /* cluster internal */
@@ -149,6 +150,11 @@ enum {
   l_osd_tier_promote_lat,
   l_osd_tier_r_lat,
 
+  l_osd_op_wq_steal_pgs,
+  l_osd_op_wq_steal_ops,
+  l_osd_op_fast_read,
+  l_osd_op_nolock_reply,
+
   l_osd_last,
 };
 
@@ -342,6 +348,7 @@ public:
   ThreadPool::WorkQueue<MOSDRepScrub> &rep_scrub_wq;
   GenContextWQ recovery_gen_wq;
   GenContextWQ op_gen_wq;
+  GenContextWQ deep_scrub_gen_wq;
   ClassHandler  *&class_handler;
 
   void dequeue_pg(PG *pg, list<OpRequestRef> *dequeued);
@@ -569,6 +576,27 @@ public:
   void dec_scrubs_pending();
   void dec_scrubs_active();
 
+  // -- deep scrub io budget --
+  /// token buckets for osd_deep_scrub_{bytes,ops}_per_sec; may go negative
+  double scrub_budget_bytes, scrub_budget_ops;
+  utime_t scrub_budget_stamp;
+  void _scrub_budget_refill(utime_t now);
+  /// account for io done by a deep scrub (primary or replica)
+  void scrub_budget_charge(uint64_t bytes, uint64_t ops, utime_t now);
+  /// @return seconds to wait before the next deep scrub chunk
+  double scrub_budget_wait(utime_t now);
+
+  // -- snap trim io budget --
+  Mutex snap_trim_budget_lock;
+  /// token bucket for osd_snap_trim_ops_per_sec; may go negative
+  double snap_trim_budget_ops;
+  utime_t snap_trim_budget_stamp;
+  void _snap_trim_budget_refill(utime_t now);
+  /// account for objects trimmed
+  void snap_trim_budget_charge(uint64_t ops);
+  /// @return seconds to wait before trimming more objects
+  double snap_trim_budget_wait();
+
   void reply_op_error(OpRequestRef op, int err);
   void reply_op_error(OpRequestRef op, int err, eversion_t v, version_t uv);
   void handle_misdirected_op(PG *pg, OpRequestRef op);
@@ -1123,6 +1151,7 @@ private:
   ThreadPool recovery_tp;
   ThreadPool disk_tp;
   ThreadPool command_tp;
+  ThreadPool deep_scrub_tp;
 
   bool paused_recovery;
 
@@ -1474,34 +1503,62 @@ private:
  
   class ShardedOpWQ: public ShardedThreadPool::ShardedWQ < pair <PGRef, OpRequestRef> > {
 
+    typedef OpQueue< pair<PGRef, OpRequestRef>, entity_inst_t> OpQueueT;
+    typedef MClockQueue< pair<PGRef, OpRequestRef>, entity_inst_t> MClockQueueT;
+
+    /// scheduling classes for osd_op_queue = mclock
+    enum {
+      OP_CLASS_CLIENT_OP,
+      OP_CLASS_OSD_SUBOP,
+      OP_CLASS_RECOVERY,
+    };
+    struct OpClassifier : public MClockQueueT::Classifier {
+      CephContext *cct;
+      OpClassifier(CephContext *cct) : cct(cct) {}
+      unsigned get_class(const entity_inst_t &cl,
+                         const pair<PGRef, OpRequestRef> &item);
+      MClockQueueT::ClientInfo get_info(unsigned c);
+    } classifier;
+
     struct ShardData {
       Mutex sdata_lock;
       Cond sdata_cond;
       Mutex sdata_op_ordering_lock;
       map<PG*, list<OpRequestRef> > pg_for_processing;
-      PrioritizedQueue< pair<PGRef, OpRequestRef>, entity_inst_t> pqueue;
-      ShardData(string lock_name, string ordering_lock, uint64_t max_tok_per_prio, uint64_t min_cost):
+      OpQueueT *pqueue;
+      ShardData(string lock_name, string ordering_lock, OpQueueT *q):
           sdata_lock(lock_name.c_str()),
           sdata_op_ordering_lock(ordering_lock.c_str()),
-          pqueue(max_tok_per_prio, min_cost) {}
+          pqueue(q) {}
+      ~ShardData() {
+        delete pqueue;
+      }
     };
 
     vector<ShardData*> shard_list;
     OSD *osd;
     uint32_t num_shards;
 
+    OpQueueT *create_queue() {
+      md_config_t *conf = osd->cct->_conf;
+      if (conf->osd_op_queue == "mclock")
+        return new MClockQueueT(&classifier);
+      return new PrioritizedQueue< pair<PGRef, OpRequestRef>, entity_inst_t>(
+        conf->osd_op_pq_max_tokens_per_priority,
+        conf->osd_op_pq_min_cost);
+    }
+
     public:
       ShardedOpWQ(uint32_t pnum_shards, OSD *o, time_t ti, time_t si, ShardedThreadPool* tp):
         ShardedThreadPool::ShardedWQ < pair <PGRef, OpRequestRef> >(ti, si, tp),
-        osd(o), num_shards(pnum_shards) {
+        classifier(o->cct), osd(o), num_shards(pnum_shards) {
         for(uint32_t i = 0; i < num_shards; i++) {
           char lock_name[32] = {0};
           snprintf(lock_name, sizeof(lock_name), "%s.%d", "OSD:ShardedOpWQ:", i);
           char order_lock[32] = {0};
           snprintf(order_lock, sizeof(order_lock), "%s.%d", "OSD:ShardedOpWQ:order:", i);
-          ShardData* one_shard = new ShardData(lock_name, order_lock, 
-            osd->cct->_conf->osd_op_pq_max_tokens_per_priority, 
-            osd->cct->_conf->osd_op_pq_min_cost);
+          ShardData* one_shard = new ShardData(lock_name, order_lock,
+            create_queue());
           shard_list.push_back(one_shard);
         }
       }
@@ -1517,6 +1574,28 @@ private:
       void _process(uint32_t thread_index, heartbeat_handle_d *hb);
       void _enqueue(pair <PGRef, OpRequestRef> item);
       void _enqueue_front(pair <PGRef, OpRequestRef> item);
+      void _enqueue_locked(ShardData *sdata, pair <PGRef, OpRequestRef> item,
+                           bool front);
+      bool steal_pg(uint32_t to_index);
+      bool try_fast_read(ShardData *sdata, pair <PGRef, OpRequestRef> &item);
+      bool try_nolock(ShardData *sdata, pair <PGRef, OpRequestRef> &item);
+
+      uint32_t get_shard_index(PG *pg) {
+        uint32_t s = pg->op_wq_shard.read();
+        return s ? s - 1 : pg->get_pgid().ps() % shard_list.size();
+      }
+
+      /// lock (ordering lock) and return the shard holding pg's ops
+      ShardData *lock_pg_shard(PG *pg) {
+        while (true) {
+          ShardData *sdata = shard_list[get_shard_index(pg)];
+          sdata->sdata_op_ordering_lock.Lock();
+          // a steal may have moved the pg while we waited
+          if (sdata == shard_list[get_shard_index(pg)])
+            return sdata;
+          sdata->sdata_op_ordering_lock.Unlock();
+        }
+      }
       
       void return_waiting_threads() {
         for(uint32_t i = 0; i < num_shards; i++) {
@@ -1537,13 +1616,13 @@ private:
           assert (NULL != sdata);
           sdata->sdata_op_ordering_lock.Lock();
 	  f->open_object_section(lock_name);
-	  sdata->pqueue.dump(f);
+	  sdata->pqueue->dump(f);
 	  f->close_section();
           sdata->sdata_op_ordering_lock.Unlock();
         }
       }
 
-      struct Pred {
+      struct Pred : public OpQueueT::Filter {
         PG *pg;
         Pred(PG *pg) : pg(pg) {}
         bool operator()(const pair<PGRef, OpRequestRef> &op) {
@@ -1552,20 +1631,18 @@ private:
       };
 
       void dequeue(PG *pg, list<OpRequestRef> *dequeued = 0) {
-        ShardData* sdata = NULL;
         assert(pg != NULL);
-        uint32_t shard_index = pg->get_pgid().ps()% shard_list.size();
-        sdata = shard_list[shard_index];
+        ShardData* sdata = lock_pg_shard(pg);
         assert(sdata != NULL);
         if (!dequeued) {
-          sdata->sdata_op_ordering_lock.Lock();
-          sdata->pqueue.remove_by_filter(Pred(pg));
+          Pred f(pg);
+          sdata->pqueue->remove_by_filter(f);
           sdata->pg_for_processing.erase(pg);
           sdata->sdata_op_ordering_lock.Unlock();
         } else {
           list<pair<PGRef, OpRequestRef> > _dequeued;
-          sdata->sdata_op_ordering_lock.Lock();
-          sdata->pqueue.remove_by_filter(Pred(pg), &_dequeued);
+          Pred f(pg);
+          sdata->pqueue->remove_by_filter(f, &_dequeued);
           for (list<pair<PGRef, OpRequestRef> >::iterator i = _dequeued.begin();
             i != _dequeued.end(); ++i) {
             dequeued->push_back(i->second);
@@ -1586,7 +1663,7 @@ private:
         ShardData* sdata = shard_list[shard_index];
         assert(NULL != sdata);
         Mutex::Locker l(sdata->sdata_op_ordering_lock);
-        return sdata->pqueue.empty();
+        return sdata->pqueue->empty();
       }
 
   } op_shardedwq;
@@ -1888,8 +1965,10 @@ protected:
   xlist<PG*> pg_stat_queue;
   bool osd_stat_updated;
   uint64_t pg_stat_tid, pg_stat_tid_flushed;
+  uint64_t pg_stat_tid_session;  ///< last tid sent before the mon session began
+  uint64_t pg_stat_mon_features;  ///< features of the mon session
 
-  void send_pg_stats(const utime_t &now);
+  void send_pg_stats(const utime_t &now, bool force = false);
   void handle_pg_stats_ack(class MPGStatsAck *ack);
   void flush_pg_stats();
 
@@ -0,0 +1,342 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OSD_OBJECTCONTEXTCACHE_H
+#define CEPH_OSD_OBJECTCONTEXTCACHE_H
+
+#include <list>
+#include <vector>
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/unordered_set.hpp>
+
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/dout.h"
+#include "include/hash.h"
+#include "osd_types.h"
+
+/**
+ * ObjectContextCache - per-pg registry of ObjectContexts and SnapSetContexts
+ *
+ * Every live ObjectContext of the pg is indexed (weakly) so that there is
+ * only ever one context per object; the most recently used ones are also
+ * pinned on an LRU, trimmed to a byte budget and optionally an entry
+ * count.  Registered SnapSetContexts live in the same index under their
+ * snapdir oid, so the head, snapdir and snapset of an object are found
+ * with a single lock and a single probe.
+ *
+ * Index entries are intrusive and recycled through a free list, and the
+ * index hashes the placement hash and snap of the oid, so a lookup neither
+ * allocates nor compares object names on the way to the right bucket.
+ *
+ * Iteration order is unspecified.
+ */
+class ObjectContextCache {
+  struct Entry {
+    boost::intrusive::unordered_set_member_hook<> hash_item;
+    boost::intrusive::list_member_hook<> lru_item;  ///< lru or free list
+    hobject_t oid;
+    ceph::weak_ptr<ObjectContext> weak;
+    ObjectContext *obc;       ///< live context, if any
+    ObjectContextRef pin;     ///< held while on the lru
+    uint64_t charge;          ///< bytes counted against the lru
+    SnapSetContext *ssc;      ///< registered snapset, snapdir oids only
+    Entry() : obc(NULL), charge(0), ssc(NULL) {}
+  };
+
+  struct OidHash {
+    size_t operator()(const hobject_t &oid) const {
+      rjhash<uint64_t> H;
+      return H(((uint64_t)oid.get_hash() << 32) ^ oid.snap.val);
+    }
+    size_t operator()(const Entry &e) const {
+      return (*this)(e.oid);
+    }
+  };
+  struct OidEqual {
+    bool operator()(const Entry &a, const Entry &b) const {
+      return a.oid == b.oid;
+    }
+    bool operator()(const hobject_t &oid, const Entry &e) const {
+      return oid == e.oid;
+    }
+  };
+
+  typedef boost::intrusive::member_hook<
+    Entry, boost::intrusive::unordered_set_member_hook<>,
+    &Entry::hash_item> HashHook;
+  typedef boost::intrusive::unordered_set<
+    Entry, HashHook,
+    boost::intrusive::hash<OidHash>,
+    boost::intrusive::equal<OidEqual>,
+    boost::intrusive::power_2_buckets<true> > Index;
+  typedef boost::intrusive::member_hook<
+    Entry, boost::intrusive::list_member_hook<>,
+    &Entry::lru_item> ListHook;
+  typedef boost::intrusive::list<Entry, ListHook> EntryList;
+
+  static const unsigned MIN_BUCKETS = 64;
+  static const unsigned MAX_FREE = 1024;
+
+  CephContext *cct;
+  Mutex lock;
+  Cond cond;
+  std::vector<Index::bucket_type> buckets;
+  Index index;
+  EntryList lru;           ///< pinned contexts, most recent first
+  EntryList free_entries;  ///< recycled index entries
+  uint64_t lru_bytes;
+  uint64_t max_bytes;      ///< 0 for no byte limit
+  unsigned max_count;      ///< 0 for no count limit
+  unsigned num_live;       ///< entries with a live context
+
+  class Cleanup {
+    ObjectContextCache *cache;
+    Entry *entry;
+  public:
+    Cleanup(ObjectContextCache *c, Entry *e) : cache(c), entry(e) {}
+    void operator()(ObjectContext *obc) {
+      cache->remove(entry, obc);
+      delete obc;
+    }
+  };
+
+  static uint64_t footprint(const Entry &e) {
+    uint64_t r = sizeof(Entry) + sizeof(ObjectContext) +
+      e.oid.oid.name.length() + e.oid.get_key().length() +
+      e.oid.nspace.length();
+    for (map<string, bufferlist>::const_iterator p =
+	   e.obc->attr_cache.begin();
+	 p != e.obc->attr_cache.end();
+	 ++p)
+      r += p->first.length() + p->second.length();
+    return r;
+  }
+
+  Entry *find(const hobject_t &oid) {
+    Index::iterator i = index.find(oid, OidHash(), OidEqual());
+    return i == index.end() ? NULL : &*i;
+  }
+
+  Entry *insert(const hobject_t &oid) {
+    Entry *e;
+    if (free_entries.empty()) {
+      e = new Entry;
+    } else {
+      e = &free_entries.front();
+      free_entries.pop_front();
+    }
+    e->oid = oid;
+    if (index.size() >= buckets.size()) {
+      std::vector<Index::bucket_type> bigger(buckets.size() * 2);
+      index.rehash(Index::bucket_traits(&bigger[0], bigger.size()));
+      buckets.swap(bigger);
+    }
+    index.insert(*e);
+    return e;
+  }
+
+  /// drop e from the index once it has neither a context nor a snapset
+  void maybe_release(Entry *e) {
+    if (e->obc || e->ssc)
+      return;
+    assert(!e->lru_item.is_linked());
+    index.erase(index.iterator_to(*e));
+    if (free_entries.size() < MAX_FREE) {
+      e->oid = hobject_t();
+      free_entries.push_front(*e);
+    } else {
+      delete e;
+    }
+  }
+
+  void remove(Entry *e, ObjectContext *obc) {
+    Mutex::Locker l(lock);
+    assert(e->obc == obc);
+    e->obc = NULL;
+    e->weak.reset();
+    --num_live;
+    maybe_release(e);
+    cond.Signal();
+  }
+
+  void trim(std::list<ObjectContextRef> *to_release) {
+    while (!lru.empty() &&
+	   ((max_bytes && lru_bytes > max_bytes) ||
+	    (max_count && lru.size() > max_count))) {
+      Entry &e = lru.back();
+      lru.pop_back();
+      lru_bytes -= e.charge;
+      e.charge = 0;
+      to_release->push_back(ObjectContextRef());
+      to_release->back().swap(e.pin);
+    }
+  }
+
+  void lru_touch(Entry *e, const ObjectContextRef &obc,
+		 std::list<ObjectContextRef> *to_release) {
+    if (e->lru_item.is_linked()) {
+      lru.erase(lru.iterator_to(*e));
+      lru_bytes -= e->charge;
+    } else {
+      e->pin = obc;
+    }
+    lru.push_front(*e);
+    e->charge = footprint(*e);
+    lru_bytes += e->charge;
+    trim(to_release);
+  }
+
+  /// find the live context for oid, waiting out one being torn down
+  ObjectContextRef _lookup(const hobject_t &oid, Entry **pe) {
+    while (true) {
+      Entry *e = find(oid);
+      *pe = e;
+      if (!e || !e->obc)
+	return ObjectContextRef();
+      ObjectContextRef obc = e->weak.lock();
+      if (obc)
+	return obc;
+      cond.Wait(lock);
+    }
+  }
+
+public:
+  ObjectContextCache(CephContext *cct, uint64_t max_bytes, unsigned max_count)
+    : cct(cct), lock("ObjectContextCache::lock"),
+      buckets(MIN_BUCKETS),
+      index(Index::bucket_traits(&buckets[0], buckets.size())),
+      lru_bytes(0), max_bytes(max_bytes), max_count(max_count),
+      num_live(0) {}
+
+  ~ObjectContextCache() {
+    clear();
+    if (num_live) {
+      lderr(cct) << "leaked refs:\n";
+      dump(*_dout);
+      *_dout << dendl;
+      assert(num_live == 0);
+    }
+    index.clear_and_dispose(Deleter());
+    free_entries.clear_and_dispose(Deleter());
+  }
+
+  struct Deleter {
+    void operator()(Entry *e) {
+      delete e;
+    }
+  };
+
+  void set_limits(uint64_t bytes, unsigned count) {
+    std::list<ObjectContextRef> to_release;
+    Mutex::Locker l(lock);
+    max_bytes = bytes;
+    max_count = count;
+    trim(&to_release);
+  }
+
+  ObjectContextRef lookup(const hobject_t &oid) {
+    std::list<ObjectContextRef> to_release;
+    Mutex::Locker l(lock);
+    Entry *e;
+    ObjectContextRef obc = _lookup(oid, &e);
+    if (obc)
+      lru_touch(e, obc, &to_release);
+    return obc;
+  }
+
+  ObjectContextRef lookup_or_create(const hobject_t &oid) {
+    std::list<ObjectContextRef> to_release;
+    Mutex::Locker l(lock);
+    Entry *e;
+    ObjectContextRef obc = _lookup(oid, &e);
+    if (!obc) {
+      if (!e)
+	e = insert(oid);
+      e->obc = new ObjectContext;
+      obc = ObjectContextRef(e->obc, Cleanup(this, e));
+      e->weak = obc;
+      ++num_live;
+    }
+    lru_touch(e, obc, &to_release);
+    return obc;
+  }
+
+  /// append every live context, in no particular order
+  void get_all(std::list<ObjectContextRef> *ls) {
+    Mutex::Locker l(lock);
+    for (Index::iterator i = index.begin(); i != index.end(); ++i) {
+      if (!i->obc)
+	continue;
+      ObjectContextRef obc = i->weak.lock();
+      if (obc)
+	ls->push_back(obc);
+    }
+  }
+
+  /// unpin everything; contexts still referenced elsewhere stay indexed
+  void clear() {
+    std::list<ObjectContextRef> to_release;
+    Mutex::Locker l(lock);
+    while (!lru.empty()) {
+      Entry &e = lru.front();
+      lru.pop_front();
+      e.charge = 0;
+      to_release.push_back(ObjectContextRef());
+      to_release.back().swap(e.pin);
+    }
+    lru_bytes = 0;
+  }
+
+  /// true iff no context is alive
+  bool empty() {
+    Mutex::Locker l(lock);
+    return num_live == 0;
+  }
+
+  void dump(ostream &out) {
+    for (Index::iterator i = index.begin(); i != index.end(); ++i) {
+      if (!i->obc)
+	continue;
+      out << __func__ << " " << this << " " << i->oid << " = " << i->obc
+	  << " with " << i->weak.use_count() << " refs" << std::endl;
+    }
+  }
+
+  /**
+   * SnapSetContext registry, keyed by snapdir oid
+   *
+   * The caller holds get_snapset_lock() across a lookup and the matching
+   * register so that a snapset is only ever loaded once.
+   */
+  Mutex &get_snapset_lock() {
+    return lock;
+  }
+  SnapSetContext *_lookup_snapset(const hobject_t &snapdir) {
+    assert(lock.is_locked());
+    Entry *e = find(snapdir);
+    return e ? e->ssc : NULL;
+  }
+  void _register_snapset(SnapSetContext *ssc) {
+    assert(lock.is_locked());
+    Entry *e = find(ssc->oid);
+    if (!e)
+      e = insert(ssc->oid);
+    assert(e->ssc == NULL);
+    e->ssc = ssc;
+  }
+  void _unregister_snapset(SnapSetContext *ssc) {
+    assert(lock.is_locked());
+    Entry *e = find(ssc->oid);
+    assert(e && e->ssc == ssc);
+    e->ssc = NULL;
+    maybe_release(e);
+  }
+
+  uint64_t get_bytes() {
+    Mutex::Locker l(lock);
+    return lru_bytes;
+  }
+};
+
+#endif
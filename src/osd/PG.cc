@@ -21,6 +21,7 @@
 #include "common/Timer.h"
 
 #include "messages/MOSDOp.h"
+#include "messages/MOSDOpReply.h"
 #include "messages/MOSDPGNotify.h"
 #include "messages/MOSDPGLog.h"
 #include "messages/MOSDPGRemove.h"
@@ -189,7 +190,10 @@ PG::PG(OSDService *o, OSDMapRef curmap,
   #ifdef PG_DEBUG_REFS
   _ref_id_lock("PG::_ref_id_lock"), _ref_id(0),
   #endif
-  deleting(false), dirty_info(false), dirty_big_info(false),
+  deleting(false),
+  fast_read_lock("PG::fast_read_lock"),
+  fast_read_armed(false), fast_read_ok(false), fast_read_gen(0),
+  dirty_info(false), dirty_big_info(false),
   info(p),
   info_struct_v(0),
   coll(p), pg_log(cct),
@@ -209,6 +213,8 @@ PG::PG(OSDService *o, OSDMapRef curmap,
   flushes_in_progress(0),
   pg_stats_publish_lock("PG::pg_stats_publish_lock"),
   pg_stats_publish_valid(false),
+  pg_stats_acked_valid(false),
+  pg_stats_delta_tid(0),
   osr(osd->osr_registry.lookup_or_create(p, (stringify(p)))),
   finish_sync_event(NULL),
   scrub_after_recovery(false),
@@ -244,6 +250,84 @@ void PG::lock(bool no_lockdep) const
   assert(!dirty_big_info);
 
   dout(30) << "lock" << dendl;
+  if (fast_read_armed)
+    fast_read_invalidate();
+}
+
+void PG::fast_read_invalidate() const
+{
+  Mutex::Locker l(fast_read_lock);
+  fast_read_ok = false;
+  ++fast_read_gen;
+}
+
+void PG::fast_read_publish() const
+{
+  bool ok = g_conf->osd_fast_read && can_fast_read();
+  fast_read_armed = ok;
+  Mutex::Locker l(fast_read_lock);
+  fast_read_ok = ok;
+  if (!ok)
+    return;
+  if (!fast_read_map ||
+      fast_read_map->osdmap != osdmap_ref ||
+      fast_read_map->same_primary_since != info.history.same_primary_since) {
+    FastReadMapRef m(new FastReadMap);
+    m->osdmap = osdmap_ref;
+    m->pool_name = pool.name;
+    m->pool_auid = pool.auid;
+    m->same_primary_since = info.history.same_primary_since;
+    fast_read_map = m;
+  }
+}
+
+void PG::fast_read_fold_stats()
+{
+  uint64_t num_rd = fast_read_num_rd.read();
+  uint64_t num_rd_kb = fast_read_num_rd_kb.read();
+  if (!num_rd)
+    return;
+  fast_read_num_rd.sub(num_rd);
+  fast_read_num_rd_kb.sub(num_rd_kb);
+  // persist lazily, like the stats of reads under the pg lock
+  unstable_stats.sum.num_rd += num_rd;
+  unstable_stats.sum.num_rd_kb += num_rd_kb;
+}
+
+bool PG::get_fast_read(FastReadMapRef *m, uint64_t *gen)
+{
+  Mutex::Locker l(fast_read_lock);
+  if (!fast_read_ok)
+    return false;
+  *m = fast_read_map;
+  *gen = fast_read_gen;
+  return true;
+}
+
+void PG::fast_read_complete(OpRequestRef& op, MOSDOpReply *reply)
+{
+  uint64_t outb = reply->get_data().length();
+  utime_t now = ceph_clock_now(cct);
+  utime_t latency = now - op->get_req()->get_recv_stamp();
+  utime_t process_latency = now - op->get_dequeued_time();
+
+  fast_read_num_rd.inc();
+  fast_read_num_rd_kb.add(SHIFT_ROUND_UP(outb, 10));
+
+  osd->logger->inc(l_osd_op);
+  osd->logger->inc(l_osd_op_outb, outb);
+  osd->logger->tinc(l_osd_op_lat, latency);
+  osd->logger->tinc(l_osd_op_process_lat, process_latency);
+  osd->logger->inc(l_osd_op_r);
+  osd->logger->inc(l_osd_op_r_outb, outb);
+  osd->logger->tinc(l_osd_op_r_lat, latency);
+  osd->logger->tinc(l_osd_op_r_process_lat, process_latency);
+}
+
+bool PG::fast_read_valid(uint64_t gen)
+{
+  Mutex::Locker l(fast_read_lock);
+  return fast_read_ok && fast_read_gen == gen;
 }
 
 std::string PG::gen_prefix() const
@@ -1749,6 +1833,12 @@ void PG::activate(ObjectStore::Transaction& t,
 }
 
 bool PG::op_has_sufficient_caps(OpRequestRef& op)
+{
+  return op_has_sufficient_caps(op, pool.name, pool.auid);
+}
+
+bool PG::op_has_sufficient_caps(OpRequestRef& op, const string& pool_name,
+				uint64_t pool_auid)
 {
   // only check MOSDOp
   if (op->get_req()->get_type() != CEPH_MSG_OSD_OP)
@@ -1768,16 +1858,16 @@ bool PG::op_has_sufficient_caps(OpRequestRef& op)
   if (key.length() == 0)
     key = req->get_oid().name;
 
-  bool cap = caps.is_capable(pool.name, req->get_object_locator().nspace,
-                             pool.auid, key,
+  bool cap = caps.is_capable(pool_name, req->get_object_locator().nspace,
+                             pool_auid, key,
 			     op->need_read_cap(),
 			     op->need_write_cap(),
 			     op->need_class_read_cap(),
 			     op->need_class_write_cap());
 
-  dout(20) << "op_has_sufficient_caps pool=" << pool.id << " (" << pool.name
+  dout(20) << "op_has_sufficient_caps pool=" << pool.id << " (" << pool_name
 		   << " " << req->get_object_locator().nspace
-	   << ") owner=" << pool.auid
+	   << ") owner=" << pool_auid
 	   << " need_read_cap=" << op->need_read_cap()
 	   << " need_write_cap=" << op->need_write_cap()
 	   << " need_class_read_cap=" << op->need_class_read_cap()
@@ -2421,6 +2511,8 @@ void PG::publish_stats_to_osd()
   if (!is_primary())
     return;
 
+  fast_read_fold_stats();
+
   pg_stats_publish_lock.Lock();
 
   if (info.stats.stats.sum.num_scrub_errors)
@@ -2488,6 +2580,7 @@ void PG::clear_publish_stats()
   dout(15) << "clear_stats" << dendl;
   pg_stats_publish_lock.Lock();
   pg_stats_publish_valid = false;
+  pg_stats_acked_valid = false;
   pg_stats_publish_lock.Unlock();
 
   osd->pg_stat_queue_dequeue(this);
@@ -2776,6 +2869,7 @@ void PG::_init(ObjectStore::Transaction& t, spg_t pgid, const pg_pool_t *pool)
 
 void PG::prepare_write_info(map<string,bufferlist> *km)
 {
+  fast_read_fold_stats();
   info.stats.stats.add(unstable_stats);
   unstable_stats.clear();
 
@@ -3673,6 +3767,16 @@ int PG::build_scrub_map_chunk(
 
 
   get_pgbackend()->be_scan_list(map, ls, deep, seed, handle);
+  if (deep) {
+    uint64_t bytes = 0;
+    for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
+      std::map<hobject_t, ScrubMap::object>::iterator o =
+	map.objects.find(*p);
+      if (o != map.objects.end())
+	bytes += o->second.size;
+    }
+    osd->scrub_budget_charge(bytes, ls.size(), ceph_clock_now(cct));
+  }
   _scan_rollback_obs(rollback_obs, handle);
   _scan_snaps(map);
 
@@ -3800,6 +3904,22 @@ void PG::scrub(ThreadPool::TPHandle &handle)
     lock();
     dout(20) << __func__ << " slept for " << t << dendl;
   }
+  if (scrubber.deep && scrubber.state == PG::Scrubber::NEW_CHUNK) {
+    double wait = osd->scrub_budget_wait(ceph_clock_now(cct));
+    if (wait > 0) {
+      dout(20) << __func__ << " deep scrub over budget, waiting " << wait
+	       << dendl;
+      unlock();
+      while (wait > 0) {
+	utime_t t;
+	t.set_from_double(MIN(wait, 1.0));
+	t.sleep();
+	handle.reset_tp_timeout();
+	wait = osd->scrub_budget_wait(ceph_clock_now(cct));
+      }
+      lock();
+    }
+  }
 
   if (!is_primary() || !is_active() || !is_clean() || !is_scrubbing()) {
     dout(10) << "scrub -- not primary or active or not clean" << dendl;
@@ -64,6 +64,7 @@ using namespace std;
 class OSD;
 class OSDService;
 class MOSDOp;
+class MOSDOpReply;
 class MOSDSubOp;
 class MOSDSubOpReply;
 class MOSDPGScan;
@@ -246,6 +247,67 @@ protected:
 public:
   bool deleting;  // true while in removing or OSD is shutting down
 
+  /// OSD::ShardedOpWQ shard holding this pg's queued ops plus one, 0 for
+  /// the default (pgid based) shard; changes only under the shard locks
+  atomic_t op_wq_shard;
+
+  /**
+   * Simple reads may run without the pg lock (see do_fast_read) while the
+   * pg is quiescent: each unlock() publishes whether that is the case
+   * together with the map it was decided against, and each lock() bumps
+   * fast_read_gen so that a reader can tell whether anybody took the lock
+   * while it was reading.
+   */
+  struct FastReadMap {
+    OSDMapRef osdmap;
+    string pool_name;
+    uint64_t pool_auid;
+    epoch_t same_primary_since;
+  };
+  typedef ceph::shared_ptr<FastReadMap> FastReadMapRef;
+
+protected:
+  /// fast reads may be allowed; protected by the pg lock
+  mutable bool fast_read_armed;
+  mutable Mutex fast_read_lock;
+  mutable bool fast_read_ok;
+  mutable uint64_t fast_read_gen;
+  mutable FastReadMapRef fast_read_map;
+  // stats of fast reads, folded into unstable_stats under the pg lock
+  atomic64_t fast_read_num_rd, fast_read_num_rd_kb;
+
+  void fast_read_invalidate() const;
+  void fast_read_publish() const;
+  void fast_read_fold_stats();
+  /// true if the pg (locked) is in a state that fast reads may rely on
+  virtual bool can_fast_read() const { return false; }
+
+public:
+  /// snapshot the published state; false if fast reads are not allowed
+  bool get_fast_read(FastReadMapRef *m, uint64_t *gen);
+  /// true if nobody took the pg lock since get_fast_read returned gen
+  bool fast_read_valid(uint64_t gen);
+  /**
+   * Try to execute op without the pg lock. Returns false if the op is not
+   * eligible; otherwise fills in the reply, which must only be sent if
+   * fast_read_valid(*gen) still holds.
+   */
+  virtual bool do_fast_read(OpRequestRef& op, uint64_t *gen,
+			    MOSDOpReply **reply) {
+    return false;
+  }
+  /// account for a fast read whose reply is about to be sent
+  void fast_read_complete(OpRequestRef& op, MOSDOpReply *reply);
+
+  /**
+   * Try to handle a message from the op queue without the pg lock (e.g. a
+   * replica ack that is merely counted). Returns false if it must go
+   * through do_request.
+   */
+  virtual bool do_request_nolock(OpRequestRef& op) {
+    return false;
+  }
+
 
   void lock_suspend_timeout(ThreadPool::TPHandle &handle);
   void lock(bool no_lockdep = false) const;
@@ -253,6 +315,8 @@ public:
     //generic_dout(0) << this << " " << info.pgid << " unlock" << dendl;
     assert(!dirty_info);
     assert(!dirty_big_info);
+    if (fast_read_armed || cct->_conf->osd_fast_read)
+      fast_read_publish();
     _lock.Unlock();
   }
 
@@ -761,6 +825,10 @@ protected:
   Mutex pg_stats_publish_lock;
   bool pg_stats_publish_valid;
   pg_stat_t pg_stats_publish;
+  // last stats the mon acked; reports are sent as deltas against these
+  bool pg_stats_acked_valid;
+  pg_stat_t pg_stats_acked;
+  uint64_t pg_stats_delta_tid;  ///< last report that carried a delta
 
   // for ordering writes
   ceph::shared_ptr<ObjectStore::Sequencer> osr;
@@ -2212,6 +2280,8 @@ public:
   }
 
   bool op_has_sufficient_caps(OpRequestRef& op);
+  bool op_has_sufficient_caps(OpRequestRef& op, const string& pool_name,
+			      uint64_t pool_auid);
 
 
   // recovery bits
@@ -325,6 +325,7 @@ void PGBackend::be_scan_list(
 {
   dout(10) << __func__ << " scanning " << ls.size() << " objects"
            << (deep ? " deeply" : "") << dendl;
+  vector<pair<hobject_t, ScrubMap::object*> > deep_objs;
   int i = 0;
   for (vector<hobject_t>::const_iterator p = ls.begin();
        p != ls.end();
@@ -351,7 +352,7 @@ void PGBackend::be_scan_list(
 
       // calculate the CRC32 on deep scrubs
       if (deep) {
-	be_deep_scrub(*p, seed, o, handle);
+	deep_objs.push_back(make_pair(poid, &o));
       }
 
       dout(25) << __func__ << "  " << poid << dendl;
@@ -368,6 +369,72 @@ void PGBackend::be_scan_list(
       assert(0);
     }
   }
+  if (!deep_objs.empty())
+    be_deep_scrub_list(deep_objs, seed, handle);
+}
+
+struct DeepScrubBatch {
+  Mutex lock;
+  Cond cond;
+  PGBackend *pgb;
+  const vector<pair<hobject_t, ScrubMap::object*> > &objs;
+  uint32_t seed;
+  atomic_t next;      ///< next object to scrub
+  unsigned running;   ///< queued contexts not yet finished
+  DeepScrubBatch(PGBackend *pgb,
+		 const vector<pair<hobject_t, ScrubMap::object*> > &objs,
+		 uint32_t seed)
+    : lock("DeepScrubBatch::lock"), pgb(pgb), objs(objs), seed(seed),
+      running(0) {}
+};
+
+class C_DeepScrubObjects : public GenContext<ThreadPool::TPHandle&> {
+  DeepScrubBatch *batch;
+public:
+  C_DeepScrubObjects(DeepScrubBatch *batch) : batch(batch) {}
+  void finish(ThreadPool::TPHandle &handle) {
+    unsigned i;
+    while ((i = batch->next.inc() - 1) < batch->objs.size())
+      batch->pgb->be_deep_scrub(batch->objs[i].first, batch->seed,
+				*batch->objs[i].second, handle);
+    Mutex::Locker l(batch->lock);
+    if (--batch->running == 0)
+      batch->cond.Signal();
+  }
+};
+
+/**
+ * Deep scrub the objects of a chunk in the osd's deep scrub thread pool.
+ *
+ * Each object is read by a single thread, so reads stay sequential per
+ * object while the store sees several of them in flight.  The calling
+ * thread waits for the batch and keeps its own heartbeat alive.
+ */
+void PGBackend::be_deep_scrub_list(
+  const vector<pair<hobject_t, ScrubMap::object*> > &objs, uint32_t seed,
+  ThreadPool::TPHandle &handle)
+{
+  int threads = g_conf->osd_deep_scrub_threads;
+  if (threads <= 1 || objs.size() == 1) {
+    for (vector<pair<hobject_t, ScrubMap::object*> >::const_iterator p =
+	   objs.begin();
+	 p != objs.end();
+	 ++p)
+      be_deep_scrub(p->first, seed, *p->second, handle);
+    return;
+  }
+  unsigned n = MIN((unsigned)threads, objs.size());
+  dout(20) << __func__ << " " << objs.size() << " objects in " << n
+	   << " work items" << dendl;
+  DeepScrubBatch batch(this, objs, seed);
+  Mutex::Locker l(batch.lock);
+  batch.running = n;
+  for (unsigned i = 0; i < n; ++i)
+    get_parent()->schedule_deep_scrub_work(new C_DeepScrubObjects(&batch));
+  while (batch.running) {
+    batch.cond.WaitInterval(g_ceph_context, batch.lock, utime_t(1, 0));
+    handle.reset_tp_timeout();
+  }
 }
 
 enum scrub_error_type PGBackend::be_compare_scrub_objects(
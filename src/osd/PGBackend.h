@@ -193,6 +193,10 @@
      virtual void schedule_recovery_work(
        GenContext<ThreadPool::TPHandle&> *c) = 0;
 
+     /// queue c in the osd's deep scrub thread pool
+     virtual void schedule_deep_scrub_work(
+       GenContext<ThreadPool::TPHandle&> *c) = 0;
+
      virtual pg_shard_t whoami_shard() const = 0;
      int whoami() const {
        return whoami_shard().osd;
@@ -302,6 +306,16 @@
      OpRequestRef op ///< [in] message received
      ) = 0; ///< @return true if the message was handled
 
+   /**
+    * gives PGBackend a crack at an incoming message without the pg lock
+    *
+    * Only messages whose effect can wait for the next locked call into the
+    * backend qualify. If it returns false the message is handled as usual.
+    */
+   virtual bool handle_message_nolock(
+     OpRequestRef op ///< [in] message received
+     ) { return false; } ///< @return true if the message was handled
+
    virtual void check_recovery_sources(const OSDMapRef osdmap) = 0;
 
 
@@ -449,6 +463,11 @@
        const hobject_t &hoid,         ///< [in] object to write
        set<string> &keys              ///< [in] omap keys, may be cleared
        ) { assert(0); }
+     virtual void omap_rmkeyrange(
+       const hobject_t &hoid,         ///< [in] object to write
+       const string &first,           ///< [in] first key to remove
+       const string &last             ///< [in] key to stop at
+       ) { assert(0); }
      virtual void omap_clear(
        const hobject_t &hoid          ///< [in] object to clear omap
        ) { assert(0); }
@@ -591,6 +610,9 @@
    void be_scan_list(
      ScrubMap &map, const vector<hobject_t> &ls, bool deep, uint32_t seed,
      ThreadPool::TPHandle &handle);
+   void be_deep_scrub_list(
+     const vector<pair<hobject_t, ScrubMap::object*> > &objs, uint32_t seed,
+     ThreadPool::TPHandle &handle);
    enum scrub_error_type be_compare_scrub_objects(
      pg_shard_t auth_shard,
      const ScrubMap::object &auth,
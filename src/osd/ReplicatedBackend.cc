@@ -239,6 +239,11 @@ void ReplicatedBackend::clear_recovery_state()
 void ReplicatedBackend::on_change()
 {
   dout(10) << __func__ << dendl;
+  {
+    Spinlock::Locker l(remote_acks_lock);
+    remote_acks.clear();
+  }
+  peer_lcod.clear();
   for (map<ceph_tid_t, InProgressOp>::iterator i = in_progress_ops.begin();
        i != in_progress_ops.end();
        in_progress_ops.erase(i++)) {
@@ -416,6 +421,13 @@ public:
     ) {
     t->omap_rmkeys(get_coll(hoid), hoid, keys);
   }
+  void omap_rmkeyrange(
+    const hobject_t &hoid,
+    const string &first,
+    const string &last
+    ) {
+    t->omap_rmkeyrange(get_coll(hoid), hoid, first, last);
+  }
   void omap_clear(
     const hobject_t &hoid
     ) {
@@ -583,7 +595,15 @@ void ReplicatedBackend::submit_transaction(
   op.waiting_for_commit.insert(
     parent->get_actingbackfill_shards().begin(),
     parent->get_actingbackfill_shards().end());
-
+  op.remote.reset(
+    new RemoteAcks(
+      parent->get_actingbackfill_shards(),
+      get_parent()->whoami_shard(),
+      orig_op));
+  {
+    Spinlock::Locker l(remote_acks_lock);
+    remote_acks[tid] = op.remote;
+  }
 
   issue_op(
     soid,
@@ -642,14 +662,19 @@ void ReplicatedBackend::op_applied(
 
   op->waiting_for_applied.erase(get_parent()->whoami_shard());
   parent->op_applied(op->v);
+  sync_remote_acks(*op);
 
-  if (op->waiting_for_applied.empty()) {
+  if (op->waiting_for_applied.empty() && op->on_applied) {
     op->on_applied->complete(0);
     op->on_applied = 0;
   }
+  if (op->waiting_for_commit.empty() && op->on_commit) {
+    op->on_commit->complete(0);
+    op->on_commit = 0;
+  }
   if (op->done()) {
     assert(!op->on_commit && !op->on_applied);
-    in_progress_ops.erase(op->tid);
+    finish_in_progress_op(op->tid);
   }
 }
 
@@ -661,17 +686,156 @@ void ReplicatedBackend::op_commit(
     op->op->mark_event("op_commit");
 
   op->waiting_for_commit.erase(get_parent()->whoami_shard());
+  sync_remote_acks(*op);
 
-  if (op->waiting_for_commit.empty()) {
+  if (op->waiting_for_applied.empty() && op->on_applied) {
+    op->on_applied->complete(0);
+    op->on_applied = 0;
+  }
+  if (op->waiting_for_commit.empty() && op->on_commit) {
     op->on_commit->complete(0);
     op->on_commit = 0;
   }
   if (op->done()) {
     assert(!op->on_commit && !op->on_applied);
-    in_progress_ops.erase(op->tid);
+    finish_in_progress_op(op->tid);
+  }
+}
+
+int ReplicatedBackend::RemoteAcks::record(
+  pg_shard_t from, bool ondisk, eversion_t lcod)
+{
+  int i = find(from);
+  assert(i >= 0);
+  Peer &p = peers[i];
+  if (!ondisk) {
+    if (p.state.read() != NONE)
+      return -1;
+    p.applied_lcod = lcod;
+    if (!p.state.compare_and_swap(NONE, APPLIED))
+      return -1;  // raced with the commit
+    return applied_left.dec() == 0 ? 1 : 0;
+  }
+
+  if (p.state.read() == COMMITTED)
+    return -1;
+  p.commit_lcod = lcod;
+  while (true) {
+    unsigned s = p.state.read();
+    if (s == COMMITTED)
+      return -1;
+    if (p.state.compare_and_swap(s, COMMITTED)) {
+      bool completed = false;
+      if (s == NONE && applied_left.dec() == 0)
+	completed = true;
+      if (commit_left.dec() == 0)
+	completed = true;
+      return completed ? 1 : 0;
+    }
+  }
+}
+
+void ReplicatedBackend::sync_remote_acks(InProgressOp &op)
+{
+  RemoteAcks &r = *op.remote;
+  for (unsigned i = 0; i < r.shards.size(); ++i) {
+    pg_shard_t from = r.shards[i];
+    unsigned state = r.peers[i].state.read();
+    eversion_t lcod;
+    if (state == RemoteAcks::COMMITTED) {
+      if (!op.waiting_for_commit.erase(from))
+	continue;
+      op.waiting_for_applied.erase(from);
+      lcod = r.peers[i].commit_lcod;
+    } else if (state == RemoteAcks::APPLIED) {
+      if (!op.waiting_for_applied.erase(from))
+	continue;
+      lcod = r.peers[i].applied_lcod;
+    } else {
+      continue;
+    }
+    // replies may be folded out of order; never move a peer backwards
+    eversion_t &last = peer_lcod[from];
+    if (lcod > last) {
+      last = lcod;
+      parent->update_peer_last_complete_ondisk(from, lcod);
+    }
   }
 }
 
+void ReplicatedBackend::finish_in_progress_op(ceph_tid_t tid)
+{
+  {
+    Spinlock::Locker l(remote_acks_lock);
+    remote_acks.erase(tid);
+  }
+  in_progress_ops.erase(tid);
+}
+
+template<typename T>
+static void get_modify_reply(
+  Message *m, ceph_tid_t *tid, pg_shard_t *from, bool *ondisk,
+  eversion_t *lcod)
+{
+  T *r = static_cast<T *>(m);
+  *tid = r->get_tid();
+  *from = r->from;
+  *ondisk = r->is_ondisk();
+  *lcod = r->get_last_complete_ondisk();
+}
+
+bool ReplicatedBackend::handle_message_nolock(
+  OpRequestRef op
+  )
+{
+  if (!cct->_conf->osd_repop_reply_nolock)
+    return false;
+
+  ceph_tid_t tid;
+  pg_shard_t from;
+  bool ondisk;
+  eversion_t lcod;
+  switch (op->get_req()->get_type()) {
+  case MSG_OSD_SUBOPREPLY:
+    if (!static_cast<MOSDSubOpReply*>(op->get_req())->ops.empty())
+      return false;  // push reply
+    get_modify_reply<MOSDSubOpReply>(op->get_req(), &tid, &from, &ondisk,
+				     &lcod);
+    break;
+  case MSG_OSD_REPOPREPLY:
+    get_modify_reply<MOSDRepOpReply>(op->get_req(), &tid, &from, &ondisk,
+				     &lcod);
+    break;
+  default:
+    return false;
+  }
+
+  // in the index means the op is in flight in the current interval
+  RemoteAcksRef acks;
+  {
+    Spinlock::Locker l(remote_acks_lock);
+    map<ceph_tid_t, RemoteAcksRef>::iterator p = remote_acks.find(tid);
+    if (p == remote_acks.end())
+      return false;
+    acks = p->second;
+  }
+  if (acks->find(from) < 0)
+    return false;
+
+  op->mark_started();
+  int r = acks->record(from, ondisk, lcod);
+  if (r < 0)
+    return false;
+  if (acks->op) {
+    ostringstream ss;
+    ss << (ondisk ? "sub_op_commit_rec from " : "sub_op_applied_rec from ")
+       << from;
+    acks->op->mark_event(ss.str());
+  }
+  // the reply completing a set goes through the locked path
+  return r == 0;
+}
+
 template<typename T, int MSGTYPE>
 void ReplicatedBackend::sub_op_modify_reply(OpRequestRef op)
 {
@@ -706,27 +870,17 @@ void ReplicatedBackend::sub_op_modify_reply(OpRequestRef op)
 
     // oh, good.
 
-    if (r->ack_type & CEPH_OSD_FLAG_ONDISK) {
-      assert(ip_op.waiting_for_commit.count(from));
-      ip_op.waiting_for_commit.erase(from);
-      if (ip_op.op) {
-        ostringstream ss;
-        ss << "sub_op_commit_rec from " << from;
-	ip_op.op->mark_event(ss.str());
-      }
-    } else {
-      assert(ip_op.waiting_for_applied.count(from));
-      if (ip_op.op) {
-        ostringstream ss;
-        ss << "sub_op_applied_rec from " << from;
-	ip_op.op->mark_event(ss.str());
-      }
+    // may already have been recorded by handle_message_nolock
+    bool ondisk = r->ack_type & CEPH_OSD_FLAG_ONDISK;
+    if (ip_op.remote->record(from, ondisk,
+			     r->get_last_complete_ondisk()) >= 0 &&
+	ip_op.op) {
+      ostringstream ss;
+      ss << (ondisk ? "sub_op_commit_rec from " : "sub_op_applied_rec from ")
+	 << from;
+      ip_op.op->mark_event(ss.str());
     }
-    ip_op.waiting_for_applied.erase(from);
-
-    parent->update_peer_last_complete_ondisk(
-      from,
-      r->get_last_complete_ondisk());
+    sync_remote_acks(ip_op);
 
     if (ip_op.waiting_for_applied.empty() &&
         ip_op.on_applied) {
@@ -740,7 +894,7 @@ void ReplicatedBackend::sub_op_modify_reply(OpRequestRef op)
     }
     if (ip_op.done()) {
       assert(!ip_op.on_commit && !ip_op.on_applied);
-      in_progress_ops.erase(iter);
+      finish_in_progress_op(rep_tid);
     }
   }
 }
@@ -762,6 +916,8 @@ void ReplicatedBackend::be_deep_scrub(
 	       poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
 	     pos,
 	     cct->_conf->osd_deep_scrub_stride, bl,
+	     CEPH_OSD_OP_FLAG_FADVISE_SEQUENTIAL |
+	     CEPH_OSD_OP_FLAG_FADVISE_DONTNEED,
 	     true)) > 0) {
     handle.reset_tp_timeout();
     h << bl;
@@ -962,15 +1118,12 @@ void ReplicatedBackend::do_push_reply(OpRequestRef op)
   assert(m->get_type() == MSG_OSD_PG_PUSH_REPLY);
   pg_shard_t from = m->from;
 
-  vector<PushOp> replies(1);
+  vector<PushOp> replies;
   for (vector<PushReplyOp>::iterator i = m->replies.begin();
        i != m->replies.end();
        ++i) {
-    bool more = handle_push_reply(from, *i, &(replies.back()));
-    if (more)
-      replies.push_back(PushOp());
+    handle_push_reply(from, *i, &replies);
   }
-  replies.erase(replies.end() - 1);
 
   map<pg_shard_t, vector<PushOp> > _replies;
   _replies[from].swap(replies);
@@ -1583,6 +1736,13 @@ void ReplicatedBackend::prep_push_to_replica(
 		       pi->second.last_backfill,
 		       data_subset, clone_subsets);
   } else if (soid.snap == CEPH_NOSNAP) {
+    // can the replica patch its older copy in place?
+    if (calc_delta_subset(obc, soid, peer, data_subset)) {
+      dout(15) << "push_to_replica delta " << data_subset << dendl;
+      return prep_push(obc, soid, peer, oi.version, data_subset, clone_subsets,
+		       pop, true);
+    }
+
     // pushing head or unversioned object.
     // base this on partially on replica's clones?
     SnapSetContext *ssc = obc->ssc;
@@ -1618,7 +1778,8 @@ void ReplicatedBackend::prep_push(
   eversion_t version,
   interval_set<uint64_t> &data_subset,
   map<hobject_t, interval_set<uint64_t> >& clone_subsets,
-  PushOp *pop)
+  PushOp *pop,
+  bool delta)
 {
   get_parent()->begin_peer_recover(peer, soid);
   // take note.
@@ -1630,10 +1791,12 @@ void ReplicatedBackend::prep_push(
   pi.recovery_info.soid = soid;
   pi.recovery_info.oi = obc->obs.oi;
   pi.recovery_info.version = version;
+  pi.recovery_info.delta = delta;
   pi.recovery_progress.first = true;
   pi.recovery_progress.data_recovered_to = 0;
   pi.recovery_progress.data_complete = 0;
-  pi.recovery_progress.omap_complete = 0;
+  // a delta never touches omap, the peer's copy is already current
+  pi.recovery_progress.omap_complete = delta;
 
   ObjectRecoveryProgress new_progress;
   int r = build_push_op(pi.recovery_info,
@@ -1643,6 +1806,92 @@ void ReplicatedBackend::prep_push(
 			&(pi.stat));
   assert(r == 0);
   pi.recovery_progress = new_progress;
+  pi.in_flight = 1;
+}
+
+/**
+ * Find the extents of head that peer is missing
+ *
+ * Works when peer has an older copy of the object that is still covered
+ * by our log and every entry since then was a data-only modification
+ * recording its dirty extents (see ReplicatedPG::record_dirty_extents).
+ * The result must fit in one push so that the peer can apply it in place
+ * in a single transaction.
+ */
+bool ReplicatedBackend::calc_delta_subset(
+  ObjectContextRef obc, const hobject_t& head, pg_shard_t peer,
+  interval_set<uint64_t>& data_subset)
+{
+  if (!cct->_conf->osd_recovery_delta ||
+      !(get_parent()->min_peer_features() & CEPH_FEATURE_OSD_DELTA_RECOVERY))
+    return false;
+
+  boost::optional<const pg_missing_t &> pm =
+    get_parent()->maybe_get_shard_missing(peer);
+  if (!pm)
+    return false;
+  map<hobject_t, pg_missing_t::item>::const_iterator mi =
+    pm->missing.find(head);
+  if (mi == pm->missing.end() || mi->second.have == eversion_t())
+    return false;
+  const eversion_t &have = mi->second.have;
+
+  const PGLog::IndexedLog &log = get_parent()->get_log().get_log();
+  if (have < log.tail)
+    return false;
+
+  // walk back from the head of the log to have; the entries must chain
+  // from have to the version we are pushing
+  interval_set<uint64_t> extents;
+  eversion_t next = obc->obs.oi.version;
+  for (list<pg_log_entry_t>::const_reverse_iterator p = log.log.rbegin();
+       p != log.log.rend() && p->version > have;
+       ++p) {
+    if (p->soid != head)
+      continue;
+    if (p->version != next || !p->is_modify() || !p->has_dirty_extents)
+      return false;
+    extents.union_of(p->dirty_extents);
+    next = p->prior_version;
+  }
+  if (next != have || next == obc->obs.oi.version)
+    return false;
+
+  uint64_t size = obc->obs.oi.size;
+  interval_set<uint64_t> in_object;
+  if (size)
+    in_object.insert(0, size);
+  extents.intersection_of(in_object);
+  if ((uint64_t)extents.size() > cct->_conf->osd_recovery_max_chunk ||
+      (size && (uint64_t)extents.size() >= size))
+    return false;
+
+  dout(20) << __func__ << " " << head << " have " << have
+	   << " need " << obc->obs.oi.version << " extents " << extents << dendl;
+  data_subset.swap(extents);
+  return true;
+}
+
+/**
+ * Queue further chunks of a large object without waiting for the acks of
+ * those already sent, up to osd_recovery_push_pipeline of them. The
+ * replica applies the chunks of an object in the order they were sent.
+ */
+void ReplicatedBackend::prep_push_more(PushInfo *pi, vector<PushOp> *pushes)
+{
+  unsigned depth = MAX(1, cct->_conf->osd_recovery_push_pipeline);
+  while (!pi->recovery_progress.data_complete && pi->in_flight < depth) {
+    pushes->push_back(PushOp());
+    ObjectRecoveryProgress new_progress;
+    int r = build_push_op(pi->recovery_info,
+			  pi->recovery_progress,
+			  &new_progress,
+			  &(pushes->back()),
+			  &(pi->stat));
+    assert(r == 0);
+    pi->recovery_progress = new_progress;
+    ++pi->in_flight;
+  }
 }
 
 int ReplicatedBackend::send_pull_legacy(int prio, pg_shard_t peer,
@@ -1692,7 +1941,20 @@ void ReplicatedBackend::submit_push_data(
   ObjectStore::Transaction *t)
 {
   coll_t target_coll;
-  if (first && complete) {
+  if (recovery_info.delta) {
+    // patch our older copy in place; whatever of copy_subset is not in
+    // the data was a hole on the primary
+    assert(first && complete);
+    target_coll = coll;
+    get_parent()->on_local_recover_start(recovery_info.soid, t);
+    t->truncate(coll, recovery_info.soid, recovery_info.size);
+    interval_set<uint64_t> holes = recovery_info.copy_subset;
+    holes.subtract(intervals_included);
+    for (interval_set<uint64_t>::const_iterator p = holes.begin();
+	 p != holes.end();
+	 ++p)
+      t->zero(coll, recovery_info.soid, p.get_start(), p.get_len());
+  } else if (first && complete) {
     target_coll = coll;
   } else {
     dout(10) << __func__ << ": Creating oid "
@@ -1701,7 +1963,7 @@ void ReplicatedBackend::submit_push_data(
     target_coll = get_temp_coll(t);
   }
 
-  if (first) {
+  if (first && !recovery_info.delta) {
     get_parent()->on_local_recover_start(recovery_info.soid, t);
     t->remove(get_temp_coll(t), recovery_info.soid);
     t->touch(target_coll, recovery_info.soid);
@@ -2166,13 +2428,14 @@ void ReplicatedBackend::sub_op_push_reply(OpRequestRef op)
 
   PushReplyOp rop;
   rop.soid = soid;
-  PushOp pop;
-  bool more = handle_push_reply(peer, rop, &pop);
-  if (more)
-    send_push_op_legacy(op->get_req()->get_priority(), peer, pop);
+  vector<PushOp> pops;
+  handle_push_reply(peer, rop, &pops);
+  for (vector<PushOp>::iterator i = pops.begin(); i != pops.end(); ++i)
+    send_push_op_legacy(op->get_req()->get_priority(), peer, *i);
 }
 
-bool ReplicatedBackend::handle_push_reply(pg_shard_t peer, PushReplyOp &op, PushOp *reply)
+bool ReplicatedBackend::handle_push_reply(pg_shard_t peer, PushReplyOp &op,
+					  vector<PushOp> *replies)
 {
   const hobject_t &soid = op.soid;
   if (pushing.count(soid) == 0) {
@@ -2186,19 +2449,19 @@ bool ReplicatedBackend::handle_push_reply(pg_shard_t peer, PushReplyOp &op, Push
     return false;
   } else {
     PushInfo *pi = &pushing[soid][peer];
+    if (pi->in_flight)
+      --pi->in_flight;
 
     if (!pi->recovery_progress.data_complete) {
       dout(10) << " pushing more from, "
 	       << pi->recovery_progress.data_recovered_to
 	       << " of " << pi->recovery_info.copy_subset << dendl;
-      ObjectRecoveryProgress new_progress;
-      int r = build_push_op(
-	pi->recovery_info,
-	pi->recovery_progress, &new_progress, reply,
-	&(pi->stat));
-      assert(r == 0);
-      pi->recovery_progress = new_progress;
+      prep_push_more(pi, replies);
       return true;
+    } else if (pi->in_flight) {
+      dout(10) << " pushed all of " << soid << ", waiting for "
+	       << pi->in_flight << " more acks from osd." << peer << dendl;
+      return false;
     } else {
       // done!
       get_parent()->on_peer_recover(
@@ -2422,6 +2685,7 @@ int ReplicatedBackend::start_pushes(
       prep_push_to_replica(obc, soid, peer,
 			   &(h->pushes[peer].back())
 	);
+      prep_push_more(&(pushing[soid][peer]), &(h->pushes[peer]));
     }
   }
   return pushes;
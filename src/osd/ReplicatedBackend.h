@@ -19,6 +19,7 @@
 #include "PGBackend.h"
 #include "osd_types.h"
 #include "../include/memory.h"
+#include "include/Spinlock.h"
 
 struct C_ReplicatedBackend_OnPullComplete;
 class ReplicatedBackend : public PGBackend {
@@ -69,6 +70,11 @@ public:
     OpRequestRef op
     );
 
+  /// @see PGBackend::handle_message_nolock
+  bool handle_message_nolock(
+    OpRequestRef op
+    );
+
   void on_change();
   void clear_recovery_state();
   void on_flushed();
@@ -165,12 +171,16 @@ public:
 private:
   // push
   struct PushInfo {
-    ObjectRecoveryProgress recovery_progress;
+    ObjectRecoveryProgress recovery_progress;  ///< progress of what was sent
     ObjectRecoveryInfo recovery_info;
     ObjectContextRef obc;
     object_stat_sum_t stat;
+    unsigned in_flight;  ///< chunks sent but not acked yet
+
+    PushInfo() : in_flight(0) {}
 
     void dump(Formatter *f) const {
+      f->dump_unsigned("in_flight", in_flight);
       {
 	f->open_object_section("recovery_progress");
 	recovery_progress.dump(f);
@@ -232,7 +242,8 @@ private:
   void do_pull(OpRequestRef op);
   void do_push_reply(OpRequestRef op);
 
-  bool handle_push_reply(pg_shard_t peer, PushReplyOp &op, PushOp *reply);
+  bool handle_push_reply(pg_shard_t peer, PushReplyOp &op,
+			 vector<PushOp> *replies);
   void handle_pull(pg_shard_t peer, PullOp &op, PushOp *reply);
   bool handle_pull_response(
     pg_shard_t from, PushOp &op, PullOp *response,
@@ -301,7 +312,12 @@ private:
 		 eversion_t version,
 		 interval_set<uint64_t> &data_subset,
 		 map<hobject_t, interval_set<uint64_t> >& clone_subsets,
-		 PushOp *op);
+		 PushOp *op,
+		 bool delta = false);
+  void prep_push_more(PushInfo *pi, vector<PushOp> *pushes);
+  bool calc_delta_subset(ObjectContextRef obc, const hobject_t& head,
+			 pg_shard_t peer,
+			 interval_set<uint64_t>& data_subset);
   void calc_head_subsets(ObjectContextRef obc, SnapSet& snapset, const hobject_t& head,
 			 const pg_missing_t& missing,
 			 const hobject_t &last_backfill,
@@ -313,8 +329,51 @@ private:
     );
 
   /**
-   * Client IO
+   * Replica replies to an in-flight op, counted without the pg lock
+   *
+   * Each reply advances its replica's slot from NONE to APPLIED or
+   * COMMITTED (a commit implies applied). Only the reply that completes the
+   * remote applied or commit set has to take the pg lock; the locked paths
+   * fold the slots back into the InProgressOp's waiting sets.
    */
+  struct RemoteAcks {
+    enum { NONE = 0, APPLIED = 1, COMMITTED = 2 };
+    struct Peer {
+      atomic_t state;
+      eversion_t applied_lcod;  ///< valid once state >= APPLIED
+      eversion_t commit_lcod;   ///< valid once state == COMMITTED
+    };
+    vector<pg_shard_t> shards;
+    Peer *peers;
+    atomic_t applied_left, commit_left;
+    OpRequestRef op;
+
+    RemoteAcks(const set<pg_shard_t> &s, pg_shard_t whoami, OpRequestRef op)
+      : peers(NULL), op(op) {
+      for (set<pg_shard_t>::const_iterator i = s.begin(); i != s.end(); ++i)
+	if (*i != whoami)
+	  shards.push_back(*i);
+      peers = new Peer[shards.size()];
+      applied_left.set(shards.size());
+      commit_left.set(shards.size());
+    }
+    ~RemoteAcks() {
+      delete[] peers;
+    }
+    int find(pg_shard_t from) const {
+      for (unsigned i = 0; i < shards.size(); ++i)
+	if (shards[i] == from)
+	  return i;
+      return -1;
+    }
+    /// @return -1 if already recorded, 1 if it completed a set, 0 otherwise
+    int record(pg_shard_t from, bool ondisk, eversion_t lcod);
+  private:
+    RemoteAcks(const RemoteAcks&);
+    RemoteAcks& operator=(const RemoteAcks&);
+  };
+  typedef ceph::shared_ptr<RemoteAcks> RemoteAcksRef;
+
   struct InProgressOp {
     ceph_tid_t tid;
     set<pg_shard_t> waiting_for_commit;
@@ -323,6 +382,7 @@ private:
     Context *on_applied;
     OpRequestRef op;
     eversion_t v;
+    RemoteAcksRef remote;
     InProgressOp(
       ceph_tid_t tid, Context *on_commit, Context *on_applied,
       OpRequestRef op, eversion_t v)
@@ -334,6 +394,15 @@ private:
     }
   };
   map<ceph_tid_t, InProgressOp> in_progress_ops;
+
+  /// RemoteAcks of in_progress_ops, for replies handled without the pg lock
+  Spinlock remote_acks_lock;
+  map<ceph_tid_t, RemoteAcksRef> remote_acks;
+  /// last_complete_ondisk reported by each peer; acks may be folded late
+  map<pg_shard_t, eversion_t> peer_lcod;
+
+  void sync_remote_acks(InProgressOp &op);
+  void finish_in_progress_op(ceph_tid_t tid);
 public:
   PGTransaction *get_transaction();
   friend class C_OSD_OnOpCommit;
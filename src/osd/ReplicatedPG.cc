@@ -339,6 +339,12 @@ void ReplicatedPG::schedule_recovery_work(
   osd->recovery_gen_wq.queue(c);
 }
 
+void ReplicatedPG::schedule_deep_scrub_work(
+  GenContext<ThreadPool::TPHandle&> *c)
+{
+  osd->deep_scrub_gen_wq.queue(c);
+}
+
 void ReplicatedPG::send_message_osd_cluster(
   int peer, Message *m, epoch_t from_epoch)
 {
@@ -1222,8 +1228,8 @@ ReplicatedPG::ReplicatedPG(OSDService *o, OSDMapRef curmap,
   pgbackend(
     PGBackend::build_pg_backend(
       _pool.info, curmap, this, coll_t(p), coll_t::make_temp_coll(p), o->store, cct)),
-  object_contexts(o->cct, g_conf->osd_pg_object_context_cache_count),
-  snapset_contexts_lock("ReplicatedPG::snapset_contexts"),
+  object_contexts(o->cct, g_conf->osd_pg_object_context_cache_bytes,
+		  g_conf->osd_pg_object_context_cache_count),
   new_backfill(false),
   temp_seq(0),
   snap_trimmer_machine(this)
@@ -1364,6 +1370,170 @@ bool ReplicatedPG::check_src_targ(const hobject_t& soid, const hobject_t& toid)
  * pg lock will be held (if multithreaded)
  * osd_lock NOT held.
  */
+bool ReplicatedPG::can_fast_read() const
+{
+  return is_primary() &&
+    is_active() &&
+    is_clean() &&
+    !is_replay() &&
+    !deleting &&
+    flushes_in_progress == 0 &&
+    last_update_applied == info.last_update &&
+    waiting_for_peered.empty() &&
+    waiting_for_active.empty() &&
+    waiting_for_cache_not_full.empty() &&
+    waiting_for_all_missing.empty() &&
+    waiting_for_unreadable_object.empty() &&
+    waiting_for_degraded_object.empty() &&
+    waiting_for_blocked_object.empty() &&
+    !hit_set &&
+    !agent_state;
+}
+
+/**
+ * Execute a simple read without taking the pg lock.
+ *
+ * Only called from the op queue, and only if nothing else of this pg is
+ * in flight there. We rely on the state published by the last unlock():
+ * the pg was clean with every write applied, so the object store holds
+ * exactly what a locked read would see. Anything out of the ordinary
+ * (errors, digest mismatches, snaps, tiering) is left to do_op.
+ */
+bool ReplicatedPG::do_fast_read(OpRequestRef& op, uint64_t *gen,
+				MOSDOpReply **reply)
+{
+  if (op->get_req()->get_type() != CEPH_MSG_OSD_OP)
+    return false;
+  MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
+  if (OSD::op_is_discardable(m))
+    return false;
+  if (!op->may_read() || op->may_write() || op->may_cache() ||
+      op->includes_pg_op() || op->send_map_update ||
+      m->get_snapid() != CEPH_NOSNAP ||
+      m->has_flag(CEPH_OSD_FLAG_RWORDERED) ||
+      m->ops.empty())
+    return false;
+  for (vector<OSDOp>::const_iterator p = m->ops.begin();
+       p != m->ops.end();
+       ++p) {
+    switch (p->op.op) {
+    case CEPH_OSD_OP_READ:
+    case CEPH_OSD_OP_SYNC_READ:
+      if (p->op.extent.truncate_seq)
+	return false;
+      break;
+    case CEPH_OSD_OP_STAT:
+    case CEPH_OSD_OP_GETXATTR:
+      break;
+    default:
+      return false;
+    }
+  }
+
+  FastReadMapRef fmap;
+  if (!get_fast_read(&fmap, gen))
+    return false;
+
+  OSDMapRef osdmap = fmap->osdmap;
+  const pg_pool_t *pi = osdmap->get_pg_pool(info.pgid.pool());
+  if (!pi ||
+      pi->require_rollback() ||
+      pi->has_tiers() ||
+      pi->is_tier() ||
+      pi->hit_set_params.get_type() != HitSet::TYPE_NONE)
+    return false;
+  if (m->get_map_epoch() > osdmap->get_epoch() ||
+      m->get_map_epoch() < fmap->same_primary_since ||
+      m->get_map_epoch() < pi->last_force_op_resend)
+    return false;
+  if (osdmap->is_blacklisted(m->get_source_addr()))
+    return false;
+  if (!op_has_sufficient_caps(op, fmap->pool_name, fmap->pool_auid))
+    return false;
+
+  hobject_t soid(m->get_oid(), m->get_object_locator().key,
+		 CEPH_NOSNAP, m->get_pg().ps(),
+		 info.pgid.pool(), m->get_object_locator().nspace);
+  bufferlist bv;
+  int r = pgbackend->objects_get_attr(soid, OI_ATTR, &bv);
+  if (r < 0)
+    return false;
+  object_info_t oi(bv);
+  if (oi.is_whiteout())
+    return false;
+
+  vector<OSDOp> ops = m->ops;
+  bool first_read = true;
+  uint64_t data_off = 0;
+  for (vector<OSDOp>::iterator p = ops.begin(); p != ops.end(); ++p) {
+    ceph_osd_op& o = p->op;
+    switch (o.op) {
+    case CEPH_OSD_OP_READ:
+    case CEPH_OSD_OP_SYNC_READ:
+      {
+	// same as the locked path: length 0 reads to the end of the object
+	if (o.extent.offset >= oi.size)
+	  o.extent.length = 0;
+	else if (o.extent.length == 0 ||
+		 o.extent.offset + o.extent.length > oi.size)
+	  o.extent.length = oi.size - o.extent.offset;
+	if (o.extent.length) {
+	  r = pgbackend->objects_read_sync(
+	    soid, o.extent.offset, o.extent.length, o.flags, &p->outdata);
+	  if (r < 0)
+	    return false;
+	  o.extent.length = r;
+	  if (o.extent.offset == 0 && o.extent.length == oi.size &&
+	      oi.is_data_digest() &&
+	      oi.data_digest != p->outdata.crc32c(-1))
+	    return false;  // let do_op report it
+	}
+	if (first_read) {
+	  first_read = false;
+	  data_off = o.extent.offset;
+	}
+      }
+      break;
+    case CEPH_OSD_OP_STAT:
+      ::encode(oi.size, p->outdata);
+      ::encode(oi.mtime, p->outdata);
+      break;
+    case CEPH_OSD_OP_GETXATTR:
+      {
+	string aname;
+	bufferlist::iterator bp = p->indata.begin();
+	bp.copy(o.xattr.name_len, aname);
+	r = pgbackend->objects_get_attr(soid, "_" + aname, &p->outdata);
+	if (r < 0)
+	  return false;
+	o.xattr.value_len = p->outdata.length();
+      }
+      break;
+    default:
+      assert(0);
+    }
+    p->rval = 0;
+  }
+
+  // no dout here: gen_prefix() reads state that needs the pg lock
+  MOSDOpReply *rep = new MOSDOpReply(m, 0, osdmap->get_epoch(), 0, false);
+  rep->claim_op_out_data(ops);
+  rep->get_header().data_off = data_off;
+  rep->set_reply_versions(eversion_t(), oi.user_version);
+  rep->set_result(0);
+  rep->add_flags(CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK);
+  *reply = rep;
+  return true;
+}
+
+bool ReplicatedPG::do_request_nolock(OpRequestRef& op)
+{
+  // map sharing happens on the locked path (OSD::dequeue_op)
+  if (op->send_map_update)
+    return false;
+  return pgbackend->handle_message_nolock(op);
+}
+
 void ReplicatedPG::do_op(OpRequestRef& op)
 {
   MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
@@ -2666,7 +2836,8 @@ void ReplicatedPG::do_backfill(OpRequestRef op)
   }
 }
 
-ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
+ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid,
+						   RepGather *repop)
 {
   // load clone info
   bufferlist bl;
@@ -2709,12 +2880,21 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
 	   << " old snapset " << snapset << dendl;
   assert(snapset.seq);
 
-  RepGather *repop = simple_repop_create(obc);
-  OpContext *ctx = repop->ctx;
-  ctx->snapset_obc = snapset_obc;
-  ctx->lock_to_release = OpContext::W_LOCK;
-  ctx->release_snapset_obc = true;
-  ctx->at_version = get_next_version();
+  OpContext *ctx;
+  if (!repop) {
+    repop = simple_repop_create(obc);
+    ctx = repop->ctx;
+    ctx->snapset_obc = snapset_obc;
+    ctx->lock_to_release = OpContext::W_LOCK;
+    ctx->release_snapset_obc = true;
+    ctx->at_version = get_next_version();
+  } else {
+    // batched with the trims of other heads
+    ctx = repop->ctx;
+    ctx->trimmed_obcs.push_back(obc);
+    ctx->trimmed_obcs.push_back(snapset_obc);
+    ctx->at_version.version++;
+  }
 
   PGBackend::PGTransaction *t = ctx->op_t;
   set<snapid_t> new_snaps;
@@ -2778,15 +2958,15 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
 	pg_log_entry_t::DELETE,
 	coid,
 	ctx->at_version,
-	ctx->obs->oi.version,
+	obc->obs.oi.version,
 	0,
 	osd_reqid_t(),
 	ctx->mtime)
       );
     if (pool.info.require_rollback()) {
       set<snapid_t> snaps(
-	ctx->obc->obs.oi.snaps.begin(),
-	ctx->obc->obs.oi.snaps.end());
+	obc->obs.oi.snaps.begin(),
+	obc->obs.oi.snaps.end());
       ctx->log.back().mod_desc.update_snaps(snaps);
       if (ctx->log.back().mod_desc.rmobject(ctx->at_version.version)) {
 	t->stash(coid, ctx->at_version.version);
@@ -2808,7 +2988,7 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
     coi.version = ctx->at_version;
     bl.clear();
     ::encode(coi, bl);
-    setattr_maybe_cache(ctx->obc, ctx, t, OI_ATTR, bl);
+    setattr_maybe_cache(obc, ctx, t, OI_ATTR, bl);
 
     ctx->log.push_back(
       pg_log_entry_t(
@@ -2823,10 +3003,10 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
     if (pool.info.require_rollback()) {
       set<string> changing;
       changing.insert(OI_ATTR);
-      ctx->obc->fill_in_setattrs(changing, &(ctx->log.back().mod_desc));
+      obc->fill_in_setattrs(changing, &(ctx->log.back().mod_desc));
       set<snapid_t> snaps(
-	ctx->obc->obs.oi.snaps.begin(),
-	ctx->obc->obs.oi.snaps.end());
+	obc->obs.oi.snaps.begin(),
+	obc->obs.oi.snaps.end());
       ctx->log.back().mod_desc.update_snaps(old_snaps);
     } else {
       ctx->log.back().mod_desc.mark_unrollbackable();
@@ -2846,13 +3026,13 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
 	pg_log_entry_t::DELETE,
 	snapoid,
 	ctx->at_version,
-	ctx->snapset_obc->obs.oi.version,
+	snapset_obc->obs.oi.version,
 	0,
 	osd_reqid_t(),
 	ctx->mtime)
       );
 
-    ctx->snapset_obc->obs.exists = false;
+    snapset_obc->obs.exists = false;
     
     if (pool.info.require_rollback()) {
       if (ctx->log.back().mod_desc.rmobject(ctx->at_version.version)) {
@@ -2871,29 +3051,29 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
 	pg_log_entry_t::MODIFY,
 	snapoid,
 	ctx->at_version,
-	ctx->snapset_obc->obs.oi.version,
+	snapset_obc->obs.oi.version,
 	0,
 	osd_reqid_t(),
 	ctx->mtime)
       );
 
-    ctx->snapset_obc->obs.oi.prior_version =
-      ctx->snapset_obc->obs.oi.version;
-    ctx->snapset_obc->obs.oi.version = ctx->at_version;
+    snapset_obc->obs.oi.prior_version =
+      snapset_obc->obs.oi.version;
+    snapset_obc->obs.oi.version = ctx->at_version;
 
     bl.clear();
     ::encode(snapset, bl);
-    setattr_maybe_cache(ctx->snapset_obc, ctx, t, SS_ATTR, bl);
+    setattr_maybe_cache(snapset_obc, ctx, t, SS_ATTR, bl);
 
     bl.clear();
-    ::encode(ctx->snapset_obc->obs.oi, bl);
-    setattr_maybe_cache(ctx->snapset_obc, ctx, t, OI_ATTR, bl);
+    ::encode(snapset_obc->obs.oi, bl);
+    setattr_maybe_cache(snapset_obc, ctx, t, OI_ATTR, bl);
 
     if (pool.info.require_rollback()) {
       set<string> changing;
       changing.insert(OI_ATTR);
       changing.insert(SS_ATTR);
-      ctx->snapset_obc->fill_in_setattrs(changing, &(ctx->log.back().mod_desc));
+      snapset_obc->fill_in_setattrs(changing, &(ctx->log.back().mod_desc));
     } else {
       ctx->log.back().mod_desc.mark_unrollbackable();
     }
@@ -2919,6 +3099,20 @@ void ReplicatedPG::snap_trimmer()
   }
   dout(10) << "snap_trimmer entry" << dendl;
   if (is_primary()) {
+    double wait = osd->snap_trim_budget_wait();
+    if (wait > 0) {
+      dout(20) << __func__ << " over budget, waiting " << wait << dendl;
+      unlock();
+      utime_t t;
+      t.set_from_double(wait);
+      t.sleep();
+      lock();
+      if (deleting || !is_primary()) {
+	unlock();
+	return;
+      }
+    }
+
     entity_inst_t nobody;
     if (scrubber.active) {
       dout(10) << " scrubbing, will requeue snap_trimmer after" << dendl;
@@ -4187,6 +4381,12 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	    t->truncate(soid, op.extent.truncate_size);
 	    oi.truncate_seq = op.extent.truncate_seq;
 	    oi.truncate_size = op.extent.truncate_size;
+	    if (oi.size > op.extent.truncate_size) {
+	      interval_set<uint64_t> trim;
+	      trim.insert(op.extent.truncate_size,
+			  oi.size - op.extent.truncate_size);
+	      ctx->modified_ranges.union_of(trim);
+	    }
 	    if (op.extent.truncate_size != oi.size) {
 	      ctx->delta_stats.num_bytes -= oi.size;
 	      ctx->delta_stats.num_bytes += op.extent.truncate_size;
@@ -4997,6 +5197,39 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
       obs.oi.clear_omap_digest();
       break;
 
+    case CEPH_OSD_OP_OMAPRMKEYRANGE:
+      if (pool.info.require_rollback()) {
+	result = -EOPNOTSUPP;
+	tracepoint(osd, do_osd_op_pre_omaprmkeyrange, soid.oid.name.c_str(), soid.snap.val, "???", "???");
+	break;
+      }
+      ctx->mod_desc.mark_unrollbackable();
+      ++ctx->num_write;
+      {
+	if (!obs.exists || oi.is_whiteout()) {
+	  result = -ENOENT;
+	  tracepoint(osd, do_osd_op_pre_omaprmkeyrange, soid.oid.name.c_str(), soid.snap.val, "???", "???");
+	  break;
+	}
+	string key_begin, key_end;
+	try {
+	  ::decode(key_begin, bp);
+	  ::decode(key_end, bp);
+	}
+	catch (buffer::error& e) {
+	  result = -EINVAL;
+	  tracepoint(osd, do_osd_op_pre_omaprmkeyrange, soid.oid.name.c_str(), soid.snap.val, "???", "???");
+	  goto fail;
+	}
+	tracepoint(osd, do_osd_op_pre_omaprmkeyrange, soid.oid.name.c_str(), soid.snap.val, key_begin.c_str(), key_end.c_str());
+	t->touch(soid);
+	t->omap_rmkeyrange(soid, key_begin, key_end);
+	ctx->delta_stats.num_wr++;
+      }
+      obs.oi.set_flag(object_info_t::FLAG_OMAP);
+      obs.oi.clear_omap_digest();
+      break;
+
     case CEPH_OSD_OP_COPY_GET_CLASSIC:
       ++ctx->num_read;
       tracepoint(osd, do_osd_op_pre_copy_get_classic, soid.oid.name.c_str(), soid.snap.val);
@@ -5513,6 +5746,53 @@ void ReplicatedPG::make_writeable(OpContext *ctx)
 }
 
 
+void ReplicatedPG::record_dirty_extents(OpContext *ctx)
+{
+  const hobject_t& soid = ctx->obs->oi.soid;
+  ctx->has_dirty_extents = false;
+  ctx->dirty_extents.clear();
+  if (!cct->_conf->osd_recovery_delta ||
+      pool.info.ec_pool() ||
+      soid.snap != CEPH_NOSNAP ||
+      !ctx->obs->exists || ctx->obs->oi.is_whiteout() ||
+      !ctx->new_obs.exists)
+    return;
+
+  // only plain data updates; anything touching xattrs, omap, watchers or
+  // snaps must be recovered by a full push
+  for (vector<OSDOp>::const_iterator p = ctx->ops.begin();
+       p != ctx->ops.end();
+       ++p) {
+    switch (p->op.op) {
+    case CEPH_OSD_OP_WRITE:
+    case CEPH_OSD_OP_WRITEFULL:
+    case CEPH_OSD_OP_APPEND:
+    case CEPH_OSD_OP_ZERO:
+    case CEPH_OSD_OP_TRUNCATE:
+    case CEPH_OSD_OP_TRIMTRUNC:
+    case CEPH_OSD_OP_SETALLOCHINT:
+      break;
+    default:
+      if (ceph_osd_op_mode_modify(p->op.op) ||
+	  p->op.op == CEPH_OSD_OP_CALL)
+	return;
+    }
+  }
+
+  // a shrink is recorded as a trim of the tail, so whatever grew the
+  // object (write past eof, truncate up) is the range past the smaller
+  // of the old and new sizes
+  ctx->dirty_extents = ctx->modified_ranges;
+  uint64_t old_size = ctx->obs->oi.size;
+  uint64_t new_size = ctx->new_obs.oi.size;
+  if (new_size > old_size) {
+    interval_set<uint64_t> grown;
+    grown.insert(old_size, new_size - old_size);
+    ctx->dirty_extents.union_of(grown);
+  }
+  ctx->has_dirty_extents = true;
+}
+
 void ReplicatedPG::write_update_size_and_usage(object_stat_sum_t& delta_stats, object_info_t& oi,
 					       interval_set<uint64_t>& modified, uint64_t offset,
 					       uint64_t length, bool count_bytes)
@@ -5674,6 +5954,9 @@ int ReplicatedPG::prepare_transaction(OpContext *ctx)
     return result;
   }
 
+  // before make_writeable trims modified_ranges to the clone overlap
+  record_dirty_extents(ctx);
+
   // clone, if necessary
   if (soid.snap == CEPH_NOSNAP)
     make_writeable(ctx);
@@ -5852,6 +6135,12 @@ void ReplicatedPG::finish_ctx(OpContext *ctx, int log_op_type, bool maintain_ssc
   }
 
   ctx->log.back().mod_desc.claim(ctx->mod_desc);
+  if (log_op_type == pg_log_entry_t::MODIFY && ctx->has_dirty_extents) {
+    dout(20) << __func__ << " dirty_extents " << ctx->dirty_extents << dendl;
+    ctx->log.back().has_dirty_extents = true;
+    ctx->log.back().dirty_extents.swap(ctx->dirty_extents);
+    ctx->has_dirty_extents = false;
+  }
   if (!ctx->extra_reqids.empty()) {
     dout(20) << __func__ << "  extra_reqids " << ctx->extra_reqids << dendl;
     ctx->log.back().extra_reqids.swap(ctx->extra_reqids);
@@ -7456,6 +7745,10 @@ void ReplicatedPG::issue_repop(RepGather *repop)
     repop->ctx->snapset_obc->ondisk_write_lock();
     unlock_snapset_obc = true;
   }
+  for (list<ObjectContextRef>::iterator i = repop->ctx->trimmed_obcs.begin();
+       i != repop->ctx->trimmed_obcs.end();
+       ++i)
+    (*i)->ondisk_write_lock();
 
   repop->ctx->apply_pending_attrs();
 
@@ -7473,7 +7766,8 @@ void ReplicatedPG::issue_repop(RepGather *repop)
   Context *onapplied_sync = new C_OSD_OndiskWriteUnlock(
     repop->obc,
     repop->ctx->clone_obc,
-    unlock_snapset_obc ? repop->ctx->snapset_obc : ObjectContextRef());
+    unlock_snapset_obc ? repop->ctx->snapset_obc : ObjectContextRef(),
+    repop->ctx->trimmed_obcs);
   pgbackend->submit_transaction(
     soid,
     repop->ctx->at_version,
@@ -7554,11 +7848,12 @@ void ReplicatedPG::simple_repop_submit(RepGather *repop)
 
 void ReplicatedPG::get_watchers(list<obj_watch_item_t> &pg_watchers)
 {
-  pair<hobject_t, ObjectContextRef> i;
-  while (object_contexts.get_next(i.first, &i)) {
-    ObjectContextRef obc(i.second);
-    get_obc_watchers(obc, pg_watchers);
-  }
+  list<ObjectContextRef> obcs;
+  object_contexts.get_all(&obcs);
+  for (list<ObjectContextRef>::iterator i = obcs.begin();
+       i != obcs.end();
+       ++i)
+    get_obc_watchers(*i, pg_watchers);
 }
 
 void ReplicatedPG::get_obc_watchers(ObjectContextRef obc, list<obj_watch_item_t> &pg_watchers)
@@ -7585,9 +7880,12 @@ void ReplicatedPG::get_obc_watchers(ObjectContextRef obc, list<obj_watch_item_t>
 void ReplicatedPG::check_blacklisted_watchers()
 {
   dout(20) << "ReplicatedPG::check_blacklisted_watchers for pg " << get_pgid() << dendl;
-  pair<hobject_t, ObjectContextRef> i;
-  while (object_contexts.get_next(i.first, &i))
-    check_blacklisted_obc_watchers(i.second);
+  list<ObjectContextRef> obcs;
+  object_contexts.get_all(&obcs);
+  for (list<ObjectContextRef>::iterator i = obcs.begin();
+       i != obcs.end();
+       ++i)
+    check_blacklisted_obc_watchers(*i);
 }
 
 void ReplicatedPG::check_blacklisted_obc_watchers(ObjectContextRef obc)
@@ -7821,16 +8119,17 @@ ObjectContextRef ReplicatedPG::get_object_context(const hobject_t& soid,
 
 void ReplicatedPG::context_registry_on_change()
 {
-  pair<hobject_t, ObjectContextRef> i;
-  while (object_contexts.get_next(i.first, &i)) {
-    ObjectContextRef obc(i.second);
-    if (obc) {
-      for (map<pair<uint64_t, entity_name_t>, WatchRef>::iterator j =
-	     obc->watchers.begin();
-	   j != obc->watchers.end();
-	   obc->watchers.erase(j++)) {
-	j->second->discard();
-      }
+  list<ObjectContextRef> obcs;
+  object_contexts.get_all(&obcs);
+  for (list<ObjectContextRef>::iterator i = obcs.begin();
+       i != obcs.end();
+       ++i) {
+    ObjectContextRef obc(*i);
+    for (map<pair<uint64_t, entity_name_t>, WatchRef>::iterator j =
+	   obc->watchers.begin();
+	 j != obc->watchers.end();
+	 obc->watchers.erase(j++)) {
+      j->second->discard();
     }
   }
 }
@@ -8130,7 +8429,7 @@ void ReplicatedPG::kick_object_context_blocked(ObjectContextRef obc)
 
 SnapSetContext *ReplicatedPG::create_snapset_context(const hobject_t& oid)
 {
-  Mutex::Locker l(snapset_contexts_lock);
+  Mutex::Locker l(object_contexts.get_snapset_lock());
   SnapSetContext *ssc = new SnapSetContext(oid.get_snapdir());
   _register_snapset_context(ssc);
   ssc->ref++;
@@ -8142,13 +8441,10 @@ SnapSetContext *ReplicatedPG::get_snapset_context(
   bool can_create,
   map<string, bufferlist> *attrs)
 {
-  Mutex::Locker l(snapset_contexts_lock);
-  SnapSetContext *ssc;
-  map<hobject_t, SnapSetContext*>::iterator p = snapset_contexts.find(
-    oid.get_snapdir());
-  if (p != snapset_contexts.end()) {
-    if (can_create || p->second->exists) {
-      ssc = p->second;
+  Mutex::Locker l(object_contexts.get_snapset_lock());
+  SnapSetContext *ssc = object_contexts._lookup_snapset(oid.get_snapdir());
+  if (ssc) {
+    if (can_create || ssc->exists) {
       ssc->exists = true;
     } else {
       return NULL;
@@ -8181,11 +8477,11 @@ SnapSetContext *ReplicatedPG::get_snapset_context(
 
 void ReplicatedPG::put_snapset_context(SnapSetContext *ssc)
 {
-  Mutex::Locker l(snapset_contexts_lock);
+  Mutex::Locker l(object_contexts.get_snapset_lock());
   --ssc->ref;
   if (ssc->ref == 0) {
     if (ssc->registered)
-      snapset_contexts.erase(ssc->oid);
+      object_contexts._unregister_snapset(ssc);
     delete ssc;
   }
 }
@@ -8704,10 +9000,15 @@ void ReplicatedPG::on_flushed()
     requeue_ops(waiting_for_peered);
   }
   if (!is_peered() || !is_primary()) {
-    pair<hobject_t, ObjectContextRef> i;
-    while (object_contexts.get_next(i.first, &i)) {
-      derr << "on_flushed: object " << i.first << " obc still alive" << dendl;
+    list<ObjectContextRef> obcs;
+    object_contexts.get_all(&obcs);
+    for (list<ObjectContextRef>::iterator i = obcs.begin();
+	 i != obcs.end();
+	 ++i) {
+      derr << "on_flushed: object " << (*i)->obs.oi.soid
+	   << " obc still alive" << dendl;
     }
+    obcs.clear();
     assert(object_contexts.empty());
   }
   pgbackend->on_flushed();
@@ -11158,19 +11459,21 @@ void ReplicatedPG::agent_estimate_atime_temp(const hobject_t& oid,
 bool ReplicatedPG::_range_available_for_scrub(
   const hobject_t &begin, const hobject_t &end)
 {
-  pair<hobject_t, ObjectContextRef> next;
-  next.second = object_contexts.lookup(begin);
-  next.first = begin;
-  bool more = true;
-  while (more && next.first < end) {
-    if (next.second && next.second->is_blocked()) {
-      next.second->requeue_scrub_on_unblock = true;
+  list<ObjectContextRef> obcs;
+  object_contexts.get_all(&obcs);
+  for (list<ObjectContextRef>::iterator i = obcs.begin();
+       i != obcs.end();
+       ++i) {
+    const hobject_t &soid = (*i)->obs.oi.soid;
+    if (soid < begin || !(soid < end))
+      continue;
+    if ((*i)->is_blocked()) {
+      (*i)->requeue_scrub_on_unblock = true;
       dout(10) << __func__ << ": scrub delayed, "
-	       << next.first << " is blocked"
+	       << soid << " is blocked"
 	       << dendl;
       return false;
     }
-    more = object_contexts.get_next(next.first, &next);
   }
   return true;
 }
@@ -11586,32 +11889,74 @@ boost::statechart::result ReplicatedPG::TrimmingObjects::react(const SnapTrim&)
   }
 
   while (repops.size() < g_conf->osd_pg_max_concurrent_snap_trims) {
-    // Get next
-    hobject_t old_pos = pos;
-    int r = pg->snap_mapper.get_next_object_to_trim(snap_to_trim, &pos);
-    if (r != 0 && r != -ENOENT) {
-      derr << __func__ << ": get_next returned " << cpp_strerror(r) << dendl;
-      assert(0);
-    } else if (r == -ENOENT) {
+    // Trim the clones of up to osd_snap_trim_batch heads in one repop.  A
+    // backfill target only gets a repop if its object is below the
+    // target's last_backfill, so don't mix heads while backfilling.
+    unsigned max = pg->backfill_targets.empty() ?
+      MAX(g_conf->osd_snap_trim_batch, 1) : 1;
+    RepGather *repop = NULL;
+    set<hobject_t> heads;
+    bool done = false, blocked = false;
+    while (heads.size() < max) {
+      // Get next
+      if (to_trim.empty()) {
+	vector<hobject_t> next;
+	int r = pg->snap_mapper.get_next_objects_to_trim(
+	  snap_to_trim, MAX(g_conf->osd_snap_trim_prefetch, 1), &next);
+	if (r != 0 && r != -ENOENT) {
+	  derr << __func__ << ": get_next returned " << cpp_strerror(r)
+	       << dendl;
+	  assert(0);
+	} else if (r == -ENOENT) {
+	  done = true;
+	  break;
+	}
+	to_trim.assign(next.begin(), next.end());
+      }
+      hobject_t pos = to_trim.front();
+
+      // the clone may have gone (e.g. evicted) since we read ahead
+      set<snapid_t> snaps;
+      int r = pg->snap_mapper.get_snaps(pos, &snaps);
+      if (r == -ENOENT || (r == 0 && !snaps.count(snap_to_trim))) {
+	dout(10) << "TrimmingObjects react " << pos << " no longer in snap "
+		 << snap_to_trim << dendl;
+	to_trim.pop_front();
+	continue;
+      }
+      assert(r == 0);
+      if (heads.count(pos.get_head()))
+	break;
+
+      dout(10) << "TrimmingObjects react trimming " << pos << dendl;
+      RepGather *trimmed = pg->trim_object(pos, repop);
+      if (!trimmed) {
+	dout(10) << __func__ << " could not get write lock on obj "
+		 << pos << dendl;
+	blocked = true;
+	break;
+      }
+      repop = trimmed;
+      heads.insert(pos.get_head());
+      to_trim.pop_front();
+    }
+
+    if (repop) {
+      dout(10) << "TrimmingObjects react submitting trim of " << heads.size()
+	       << " heads" << dendl;
+      repop->queue_snap_trimmer = true;
+      repops.insert(repop->get());
+      pg->simple_repop_submit(repop);
+      pg->osd->snap_trim_budget_charge(heads.size());
+    }
+    if (done) {
       // Done!
       dout(10) << "TrimmingObjects: got ENOENT" << dendl;
       post_event(SnapTrim());
       return transit< WaitingOnReplicas >();
     }
-
-    dout(10) << "TrimmingObjects react trimming " << pos << dendl;
-    RepGather *repop = pg->trim_object(pos);
-    if (!repop) {
-      dout(10) << __func__ << " could not get write lock on obj "
-	       << pos << dendl;
-      pos = old_pos;
+    if (blocked)
       return discard_event();
-    }
-    assert(repop);
-    repop->queue_snap_trimmer = true;
-
-    repops.insert(repop->get());
-    pg->simple_repop_submit(repop);
   }
   return discard_event();
 }
@@ -29,6 +29,7 @@
 #include "Watch.h"
 #include "OpRequest.h"
 #include "TierAgentState.h"
+#include "ObjectContextCache.h"
 
 #include "messages/MOSDOp.h"
 #include "messages/MOSDOpReply.h"
@@ -434,6 +435,8 @@ public:
 
   void schedule_recovery_work(
     GenContext<ThreadPool::TPHandle&> *c);
+  void schedule_deep_scrub_work(
+    GenContext<ThreadPool::TPHandle&> *c);
 
   pg_shard_t whoami_shard() const {
     return pg_whoami;
@@ -530,10 +533,13 @@ public:
     boost::optional<pg_hit_set_history_t> updated_hset_history;
 
     interval_set<uint64_t> modified_ranges;
+    interval_set<uint64_t> dirty_extents;  ///< for the log entry, see pg_log_entry_t
+    bool has_dirty_extents;
     ObjectContextRef obc;
     map<hobject_t,ObjectContextRef> src_obc;
     ObjectContextRef clone_obc;    // if we created a clone
     ObjectContextRef snapset_obc;  // if we created/deleted a snapdir
+    list<ObjectContextRef> trimmed_obcs;  // clones and snapsets of further heads trimmed with obc, write locked
 
     int data_off;        // FIXME: we may want to kill this msgr hint off at some point!
 
@@ -612,6 +618,7 @@ public:
       bytes_written(0), bytes_read(0), user_at_version(0),
       current_osd_subop_num(0),
       op_t(NULL),
+      has_dirty_extents(false),
       obc(obc),
       data_off(0), reply(NULL), pg(_pg),
       num_read(0),
@@ -635,6 +642,7 @@ public:
       bytes_written(0), bytes_read(0), user_at_version(0),
       current_osd_subop_num(0),
       op_t(NULL),
+      has_dirty_extents(false),
       data_off(0), reply(NULL), pg(_pg),
       num_read(0),
       num_write(0),
@@ -818,6 +826,14 @@ protected:
 	  &requeue_snaptrimmer_snapset);
 	ctx->release_snapset_obc = false;
       }
+      for (list<ObjectContextRef>::iterator i = ctx->trimmed_obcs.begin();
+	   i != ctx->trimmed_obcs.end();
+	   ++i)
+	(*i)->put_write(
+	  &to_req,
+	  &requeue_recovery_snapset,
+	  &requeue_snaptrimmer_snapset);
+      ctx->trimmed_obcs.clear();
       ctx->obc->put_write(
 	&to_req,
 	&requeue_recovery,
@@ -966,11 +982,8 @@ protected:
     return true;
   }
 
-  // projected object info
-  SharedLRU<hobject_t, ObjectContext> object_contexts;
-  // map from oid.snapdir() to SnapSetContext *
-  map<hobject_t, SnapSetContext*> snapset_contexts;
-  Mutex snapset_contexts_lock;
+  // projected object info, and SnapSetContexts keyed by oid.snapdir()
+  ObjectContextCache object_contexts;
 
   // debug order that client ops are applied
   map<hobject_t, map<client_t, ceph_tid_t> > debug_op_order;
@@ -1020,15 +1033,13 @@ protected:
     map<string, bufferlist> *attrs = 0
     );
   void register_snapset_context(SnapSetContext *ssc) {
-    Mutex::Locker l(snapset_contexts_lock);
+    Mutex::Locker l(object_contexts.get_snapset_lock());
     _register_snapset_context(ssc);
   }
   void _register_snapset_context(SnapSetContext *ssc) {
-    assert(snapset_contexts_lock.is_locked());
     if (!ssc->registered) {
-      assert(snapset_contexts.count(ssc->oid) == 0);
       ssc->registered = true;
-      snapset_contexts[ssc->oid] = ssc;
+      object_contexts._register_snapset(ssc);
     }
   }
   void put_snapset_context(SnapSetContext *ssc);
@@ -1138,6 +1149,7 @@ protected:
   void reply_ctx(OpContext *ctx, int err);
   void reply_ctx(OpContext *ctx, int err, eversion_t v, version_t uv);
   void make_writeable(OpContext *ctx);
+  void record_dirty_extents(OpContext *ctx);
   void log_op_stats(OpContext *ctx);
 
   void write_update_size_and_usage(object_stat_sum_t& stats, object_info_t& oi,
@@ -1223,16 +1235,23 @@ protected:
 
   struct C_OSD_OndiskWriteUnlock : public Context {
     ObjectContextRef obc, obc2, obc3;
+    list<ObjectContextRef> more;
     C_OSD_OndiskWriteUnlock(
       ObjectContextRef o,
       ObjectContextRef o2 = ObjectContextRef(),
-      ObjectContextRef o3 = ObjectContextRef()) : obc(o), obc2(o2), obc3(o3) {}
+      ObjectContextRef o3 = ObjectContextRef(),
+      const list<ObjectContextRef> &more = list<ObjectContextRef>())
+      : obc(o), obc2(o2), obc3(o3), more(more) {}
     void finish(int r) {
       obc->ondisk_write_unlock();
       if (obc2)
 	obc2->ondisk_write_unlock();
       if (obc3)
 	obc3->ondisk_write_unlock();
+      for (list<ObjectContextRef>::iterator p = more.begin();
+	   p != more.end();
+	   ++p)
+	(*p)->ondisk_write_unlock();
     }
   };
   struct C_OSD_OndiskWriteUnlockList : public Context {
@@ -1389,6 +1408,9 @@ public:
     OpRequestRef& op,
     ThreadPool::TPHandle &handle);
   void do_op(OpRequestRef& op);
+  bool can_fast_read() const;
+  bool do_fast_read(OpRequestRef& op, uint64_t *gen, MOSDOpReply **reply);
+  bool do_request_nolock(OpRequestRef& op);
   bool pg_op_must_wait(MOSDOp *op);
   void do_pg_op(OpRequestRef op);
   void do_sub_op(OpRequestRef op);
@@ -1398,7 +1420,7 @@ public:
     ThreadPool::TPHandle &handle);
   void do_backfill(OpRequestRef op);
 
-  RepGather *trim_object(const hobject_t &coid);
+  RepGather *trim_object(const hobject_t &coid, RepGather *repop = NULL);
   void snap_trimmer();
   int do_osd_ops(OpContext *ctx, vector<OSDOp>& ops);
 
@@ -1460,7 +1482,7 @@ private:
       boost::statechart::custom_reaction< SnapTrim >,
       boost::statechart::transition< Reset, NotTrimming >
       > reactions;
-    hobject_t pos;
+    list<hobject_t> to_trim;  ///< read ahead from the snap mapper
     TrimmingObjects(my_context ctx);
     void exit();
     boost::statechart::result react(const SnapTrim&);
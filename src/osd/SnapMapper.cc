@@ -50,6 +50,25 @@ int OSDriver::get_next(
   }
 }
 
+int OSDriver::get_next_range(
+  const std::string &after,
+  const std::string &end,
+  unsigned max,
+  vector<pair<std::string, bufferlist> > *out)
+{
+  ObjectMap::ObjectMapIterator iter =
+    os->get_omap_iterator(cid, hoid);
+  if (!iter) {
+    assert(0);
+    return -EINVAL;
+  }
+  for (iter->upper_bound(after);
+       iter->valid() && iter->key() < end && out->size() < max;
+       iter->next())
+    out->push_back(make_pair(iter->key(), iter->value()));
+  return 0;
+}
+
 struct Mapping {
   snapid_t snap;
   hobject_t hoid;
@@ -244,33 +263,44 @@ int SnapMapper::get_next_object_to_trim(
   snapid_t snap,
   hobject_t *hoid)
 {
+  vector<hobject_t> next;
+  int r = get_next_objects_to_trim(snap, 1, &next);
+  if (r == 0 && hoid)
+    *hoid = next.front();
+  return r;
+}
+
+int SnapMapper::get_next_objects_to_trim(
+  snapid_t snap,
+  unsigned max,
+  vector<hobject_t> *out)
+{
+  assert(out->empty());
   for (set<string>::iterator i = prefixes.begin();
-       i != prefixes.end();
+       i != prefixes.end() && out->size() < max;
        ++i) {
     string list_after(get_prefix(snap) + *i);
-
-    pair<string, bufferlist> next;
-    int r = backend.get_next(list_after, &next);
-    if (r < 0) {
-      break; // Done
-    }
-
-    if (next.first.substr(0, list_after.size()) !=
-	list_after) {
-      continue; // Done with this prefix
+    // first key past every key starting with list_after
+    string list_end(list_after);
+    ++list_end[list_end.size() - 1];
+
+    vector<pair<string, bufferlist> > next;
+    int r = backend.get_next_range(list_after, list_end, max - out->size(),
+				   &next);
+    if (r < 0)
+      return r;
+
+    for (vector<pair<string, bufferlist> >::iterator j = next.begin();
+	 j != next.end();
+	 ++j) {
+      assert(is_mapping(j->first));
+      pair<snapid_t, hobject_t> next_decoded(from_raw(*j));
+      assert(next_decoded.first == snap);
+      assert(check(next_decoded.second));
+      out->push_back(next_decoded.second);
     }
-
-    assert(is_mapping(next.first));
-
-    pair<snapid_t, hobject_t> next_decoded(from_raw(next));
-    assert(next_decoded.first == snap);
-    assert(check(next_decoded.second));
-
-    if (hoid)
-      *hoid = next_decoded.second;
-    return 0;
   }
-  return -ENOENT;
+  return out->empty() ? -ENOENT : 0;
 }
 
 
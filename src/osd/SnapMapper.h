@@ -71,6 +71,11 @@ public:
   int get_next(
     const std::string &key,
     pair<std::string, bufferlist> *next);
+  int get_next_range(
+    const std::string &after,
+    const std::string &end,
+    unsigned max,
+    vector<pair<std::string, bufferlist> > *out);
 };
 
 /**
@@ -216,6 +221,13 @@ public:
     hobject_t *hoid             ///< [out] next hoid to trim
     );  ///< @return error, -ENOENT if no more objects
 
+  /// Returns up to max objects with snap as a snap, in one pass per prefix
+  int get_next_objects_to_trim(
+    snapid_t snap,              ///< [in] snap to check
+    unsigned max,               ///< [in] max objects to return
+    vector<hobject_t> *out      ///< [out] next hoids to trim
+    );  ///< @return error, -ENOENT if no more objects
+
   /// Remove mapping for oid
   int remove_oid(
     const hobject_t &oid,    ///< [in] oid to remove
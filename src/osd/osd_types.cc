@@ -2083,6 +2083,185 @@ void pg_stat_t::generate_test_instances(list<pg_stat_t*>& o)
   o.push_back(new pg_stat_t(a));
 }
 
+// stamps a delta sends as a bit when they moved to last_fresh
+static utime_t pg_stat_t::* const pg_stat_delta_stamps[] = {
+  &pg_stat_t::last_change,
+  &pg_stat_t::last_active,
+  &pg_stat_t::last_peered,
+  &pg_stat_t::last_clean,
+  &pg_stat_t::last_unstale,
+  &pg_stat_t::last_undegraded,
+  &pg_stat_t::last_fullsized,
+  &pg_stat_t::last_became_active,
+  &pg_stat_t::last_became_peered,
+};
+static const unsigned pg_stat_num_delta_stamps =
+  sizeof(pg_stat_delta_stamps) / sizeof(pg_stat_delta_stamps[0]);
+
+void pg_stat_t::encode_delta_group(int group, bufferlist &bl) const
+{
+  switch (group) {
+  case DELTA_LOG:
+    ::encode(log_start, bl);
+    ::encode(ondisk_log_start, bl);
+    ::encode(log_size, bl);
+    ::encode(ondisk_log_size, bl);
+    break;
+  case DELTA_HISTORY:
+    ::encode(created, bl);
+    ::encode(last_epoch_clean, bl);
+    ::encode(parent, bl);
+    ::encode(parent_split_bits, bl);
+    ::encode(last_scrub, bl);
+    ::encode(last_deep_scrub, bl);
+    ::encode(last_scrub_stamp, bl);
+    ::encode(last_deep_scrub_stamp, bl);
+    ::encode(last_clean_scrub_stamp, bl);
+    break;
+  case DELTA_STATS:
+    ::encode(stats, bl);
+    ::encode(stats_invalid, bl);
+    ::encode(dirty_stats_invalid, bl);
+    ::encode(omap_stats_invalid, bl);
+    ::encode(hitset_stats_invalid, bl);
+    ::encode(hitset_bytes_stats_invalid, bl);
+    break;
+  case DELTA_MAPPING:
+    ::encode(up, bl);
+    ::encode(acting, bl);
+    ::encode(mapping_epoch, bl);
+    ::encode(blocked_by, bl);
+    ::encode(up_primary, bl);
+    ::encode(acting_primary, bl);
+    break;
+  default:
+    assert(0 == "bad pg_stat_t delta group");
+  }
+}
+
+void pg_stat_t::decode_delta_group(int group, bufferlist::iterator &p)
+{
+  switch (group) {
+  case DELTA_LOG:
+    ::decode(log_start, p);
+    ::decode(ondisk_log_start, p);
+    ::decode(log_size, p);
+    ::decode(ondisk_log_size, p);
+    break;
+  case DELTA_HISTORY:
+    ::decode(created, p);
+    ::decode(last_epoch_clean, p);
+    ::decode(parent, p);
+    ::decode(parent_split_bits, p);
+    ::decode(last_scrub, p);
+    ::decode(last_deep_scrub, p);
+    ::decode(last_scrub_stamp, p);
+    ::decode(last_deep_scrub_stamp, p);
+    ::decode(last_clean_scrub_stamp, p);
+    break;
+  case DELTA_STATS:
+    ::decode(stats, p);
+    ::decode(stats_invalid, p);
+    ::decode(dirty_stats_invalid, p);
+    ::decode(omap_stats_invalid, p);
+    ::decode(hitset_stats_invalid, p);
+    ::decode(hitset_bytes_stats_invalid, p);
+    break;
+  case DELTA_MAPPING:
+    ::decode(up, p);
+    ::decode(acting, p);
+    ::decode(mapping_epoch, p);
+    ::decode(blocked_by, p);
+    ::decode(up_primary, p);
+    ::decode(acting_primary, p);
+    break;
+  default:
+    throw buffer::malformed_input("bad pg_stat_t delta group");
+  }
+}
+
+void pg_stat_t::encode_delta(const pg_stat_t &base, bufferlist &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(base.reported_epoch, bl);
+  ::encode(base.reported_seq, bl);
+  ::encode(version, bl);
+  ::encode(reported_seq, bl);
+  ::encode(reported_epoch, bl);
+  ::encode(state, bl);
+  ::encode(last_fresh, bl);
+
+  // a report usually moves most stamps to last_fresh
+  __u16 fresh = 0, changed = 0;
+  for (unsigned i = 0; i < pg_stat_num_delta_stamps; ++i) {
+    const utime_t &t = this->*pg_stat_delta_stamps[i];
+    if (t == base.*pg_stat_delta_stamps[i])
+      continue;
+    if (t == last_fresh)
+      fresh |= 1 << i;
+    else
+      changed |= 1 << i;
+  }
+  ::encode(fresh, bl);
+  ::encode(changed, bl);
+  for (unsigned i = 0; i < pg_stat_num_delta_stamps; ++i) {
+    if (changed & (1 << i))
+      ::encode(this->*pg_stat_delta_stamps[i], bl);
+  }
+
+  __u8 groups = 0;
+  bufferlist gbl;
+  for (int g = DELTA_LOG; g <= DELTA_MAPPING; g <<= 1) {
+    bufferlist a, b;
+    encode_delta_group(g, a);
+    base.encode_delta_group(g, b);
+    if (!a.contents_equal(b)) {
+      groups |= g;
+      gbl.claim_append(a);
+    }
+  }
+  ::encode(groups, bl);
+  bl.claim_append(gbl);
+  ENCODE_FINISH(bl);
+}
+
+bool pg_stat_t::apply_delta(bufferlist::iterator &p)
+{
+  DECODE_START(1, p);
+  epoch_t base_epoch;
+  version_t base_seq;
+  ::decode(base_epoch, p);
+  ::decode(base_seq, p);
+  if (get_version_pair() != make_pair(base_epoch, base_seq)) {
+    p.advance(struct_end - p.get_off());
+    return false;
+  }
+  ::decode(version, p);
+  ::decode(reported_seq, p);
+  ::decode(reported_epoch, p);
+  ::decode(state, p);
+  ::decode(last_fresh, p);
+
+  __u16 fresh, changed;
+  ::decode(fresh, p);
+  ::decode(changed, p);
+  for (unsigned i = 0; i < pg_stat_num_delta_stamps; ++i) {
+    if (fresh & (1 << i))
+      this->*pg_stat_delta_stamps[i] = last_fresh;
+    else if (changed & (1 << i))
+      ::decode(this->*pg_stat_delta_stamps[i], p);
+  }
+
+  __u8 groups;
+  ::decode(groups, p);
+  for (int g = DELTA_LOG; g <= DELTA_MAPPING; g <<= 1) {
+    if (groups & g)
+      decode_delta_group(g, p);
+  }
+  DECODE_FINISH(p);
+  return true;
+}
+
 bool operator==(const pg_stat_t& l, const pg_stat_t& r)
 {
   return
@@ -2938,7 +3117,7 @@ void pg_log_entry_t::decode_with_checksum(bufferlist::iterator& p)
 
 void pg_log_entry_t::encode(bufferlist &bl) const
 {
-  ENCODE_START(10, 4, bl);
+  ENCODE_START(11, 4, bl);
   ::encode(op, bl);
   ::encode(soid, bl);
   ::encode(version, bl);
@@ -2963,12 +3142,14 @@ void pg_log_entry_t::encode(bufferlist &bl) const
   ::encode(user_version, bl);
   ::encode(mod_desc, bl);
   ::encode(extra_reqids, bl);
+  ::encode(has_dirty_extents, bl);
+  ::encode(dirty_extents, bl);
   ENCODE_FINISH(bl);
 }
 
 void pg_log_entry_t::decode(bufferlist::iterator &bl)
 {
-  DECODE_START_LEGACY_COMPAT_LEN(10, 4, 4, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(11, 4, 4, bl);
   ::decode(op, bl);
   if (struct_v < 2) {
     sobject_t old_soid;
@@ -3017,6 +3198,12 @@ void pg_log_entry_t::decode(bufferlist::iterator &bl)
     mod_desc.mark_unrollbackable();
   if (struct_v >= 10)
     ::decode(extra_reqids, bl);
+  if (struct_v >= 11) {
+    ::decode(has_dirty_extents, bl);
+    ::decode(dirty_extents, bl);
+  } else {
+    has_dirty_extents = false;
+  }
 
   DECODE_FINISH(bl);
 }
@@ -3059,6 +3246,8 @@ void pg_log_entry_t::dump(Formatter *f) const
     mod_desc.dump(f);
     f->close_section();
   }
+  if (has_dirty_extents)
+    f->dump_stream("dirty_extents") << dirty_extents;
 }
 
 void pg_log_entry_t::generate_test_instances(list<pg_log_entry_t*>& o)
@@ -3068,6 +3257,12 @@ void pg_log_entry_t::generate_test_instances(list<pg_log_entry_t*>& o)
   o.push_back(new pg_log_entry_t(MODIFY, oid, eversion_t(1,2), eversion_t(3,4),
 				 1, osd_reqid_t(entity_name_t::CLIENT(777), 8, 999),
 				 utime_t(8,9)));
+  o.push_back(new pg_log_entry_t(MODIFY, oid, eversion_t(1,3), eversion_t(1,2),
+				 2, osd_reqid_t(entity_name_t::CLIENT(777), 9, 999),
+				 utime_t(8,10)));
+  o.back()->has_dirty_extents = true;
+  o.back()->dirty_extents.insert(0, 4096);
+  o.back()->dirty_extents.insert(65536, 512);
 }
 
 ostream& operator<<(ostream& out, const pg_log_entry_t& e)
@@ -4409,7 +4604,7 @@ void ObjectRecoveryProgress::dump(Formatter *f) const
 
 void ObjectRecoveryInfo::encode(bufferlist &bl) const
 {
-  ENCODE_START(2, 1, bl);
+  ENCODE_START(3, 1, bl);
   ::encode(soid, bl);
   ::encode(version, bl);
   ::encode(size, bl);
@@ -4417,13 +4612,14 @@ void ObjectRecoveryInfo::encode(bufferlist &bl) const
   ::encode(ss, bl);
   ::encode(copy_subset, bl);
   ::encode(clone_subset, bl);
+  ::encode(delta, bl);
   ENCODE_FINISH(bl);
 }
 
 void ObjectRecoveryInfo::decode(bufferlist::iterator &bl,
 				int64_t pool)
 {
-  DECODE_START(2, bl);
+  DECODE_START(3, bl);
   ::decode(soid, bl);
   ::decode(version, bl);
   ::decode(size, bl);
@@ -4431,6 +4627,10 @@ void ObjectRecoveryInfo::decode(bufferlist::iterator &bl,
   ::decode(ss, bl);
   ::decode(copy_subset, bl);
   ::decode(clone_subset, bl);
+  if (struct_v >= 3)
+    ::decode(delta, bl);
+  else
+    delta = false;
   DECODE_FINISH(bl);
 
   if (struct_v < 2) {
@@ -4456,6 +4656,12 @@ void ObjectRecoveryInfo::generate_test_instances(
   o.back()->soid = hobject_t(sobject_t("key", CEPH_NOSNAP));
   o.back()->version = eversion_t(0,0);
   o.back()->size = 100;
+  o.push_back(new ObjectRecoveryInfo);
+  o.back()->soid = hobject_t(sobject_t("key", CEPH_NOSNAP));
+  o.back()->version = eversion_t(1,2);
+  o.back()->size = 8192;
+  o.back()->copy_subset.insert(4096, 4096);
+  o.back()->delta = true;
 }
 
 
@@ -4476,6 +4682,7 @@ void ObjectRecoveryInfo::dump(Formatter *f) const
   }
   f->dump_stream("copy_subset") << copy_subset;
   f->dump_stream("clone_subset") << clone_subset;
+  f->dump_bool("delta", delta);
 }
 
 ostream& operator<<(ostream& out, const ObjectRecoveryInfo &inf)
@@ -4489,6 +4696,7 @@ ostream &ObjectRecoveryInfo::print(ostream &out) const
 	     << soid << "@" << version
 	     << ", copy_subset: " << copy_subset
 	     << ", clone_subset: " << clone_subset
+	     << (delta ? ", delta" : "")
 	     << ")";
 }
 
@@ -1508,6 +1508,33 @@ struct pg_stat_t {
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
   static void generate_test_instances(list<pg_stat_t*>& o);
+
+  /**
+   * encode only what changed since base
+   *
+   * The version, seq, epoch, state and last_fresh are always sent; the
+   * other stamps are sent as a bit when they moved to last_fresh, and
+   * the remaining fields in groups, each only if it differs from base.
+   * New fields must be added to a group in encode_delta_group() as well
+   * as to encode().
+   */
+  void encode_delta(const pg_stat_t &base, bufferlist &bl) const;
+  /**
+   * apply a delta from encode_delta() to its base
+   *
+   * @return false, leaving *this untouched, if *this is not the base
+   * version the delta was made against
+   */
+  bool apply_delta(bufferlist::iterator &p);
+private:
+  enum {
+    DELTA_LOG = 1,
+    DELTA_HISTORY = 2,
+    DELTA_STATS = 4,
+    DELTA_MAPPING = 8,
+  };
+  void encode_delta_group(int group, bufferlist &bl) const;
+  void decode_delta_group(int group, bufferlist::iterator &p);
 };
 WRITE_CLASS_ENCODER(pg_stat_t)
 
@@ -2158,9 +2185,16 @@ struct pg_log_entry_t {
 
   vector<pair<osd_reqid_t, version_t> > extra_reqids;
 
+  /// byte ranges touched by a MODIFY that only changed object data (and
+  /// the implicit object_info/snapset attrs); lets recovery push just
+  /// these ranges to a peer that has the prior version
+  interval_set<uint64_t> dirty_extents;
+  bool has_dirty_extents;
+
   pg_log_entry_t()
     : op(0), user_version(0),
-      invalid_hash(false), invalid_pool(false), offset(0) {}
+      invalid_hash(false), invalid_pool(false), offset(0),
+      has_dirty_extents(false) {}
   pg_log_entry_t(int _op, const hobject_t& _soid, 
 		 const eversion_t& v, const eversion_t& pv,
 		 version_t uv,
@@ -2168,7 +2202,7 @@ struct pg_log_entry_t {
     : op(_op), soid(_soid), version(v),
       prior_version(pv), user_version(uv),
       reqid(rid), mtime(mt), invalid_hash(false), invalid_pool(false),
-      offset(0) {}
+      offset(0), has_dirty_extents(false) {}
       
   bool is_clone() const { return op == CLONE; }
   bool is_modify() const { return op == MODIFY; }
@@ -3364,8 +3398,9 @@ struct ObjectRecoveryInfo {
   SnapSet ss;
   interval_set<uint64_t> copy_subset;
   map<hobject_t, interval_set<uint64_t> > clone_subset;
+  bool delta;  ///< copy_subset is applied in place over the target's copy
 
-  ObjectRecoveryInfo() : size(0) { }
+  ObjectRecoveryInfo() : size(0), delta(false) { }
 
   static void generate_test_instances(list<ObjectRecoveryInfo*>& o);
   void encode(bufferlist &bl) const;
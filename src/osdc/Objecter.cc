@@ -2100,7 +2100,8 @@ void Objecter::_send_op_account(Op *op)
 
     // OMAP del operations
     case CEPH_OSD_OP_OMAPCLEAR:
-    case CEPH_OSD_OP_OMAPRMKEYS: code = l_osdc_osdop_omap_del; break;
+    case CEPH_OSD_OP_OMAPRMKEYS:
+    case CEPH_OSD_OP_OMAPRMKEYRANGE: code = l_osdc_osdop_omap_del; break;
 
     case CEPH_OSD_OP_CALL: code = l_osdc_osdop_call; break;
     case CEPH_OSD_OP_WATCH: code = l_osdc_osdop_watch; break;
@@ -745,6 +745,79 @@ TEST_F(ObjectMapTest, OddEvenClone) {
   db->clear(hoid2);
 }
 
+TEST_F(ObjectMapTest, RmKeyRange) {
+  ghobject_t hoid(hobject_t(sobject_t("foo", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("foo2", CEPH_NOSNAP)));
+
+  for (unsigned i = 0; i < 100; ++i) {
+    tester.set_key(hoid, "foo" + num_str(i), "bar" + num_str(i));
+  }
+
+  // no parent: the range goes straight to the db
+  ASSERT_EQ(0, db->rm_key_range(hoid, "foo" + num_str(10), "foo" + num_str(20)));
+  for (unsigned i = 0; i < 100; ++i) {
+    string result;
+    int r = tester.get_key(hoid, "foo" + num_str(i), &result);
+    ASSERT_EQ((i >= 10 && i < 20) ? 0 : 1, r);
+  }
+
+  // with a parent: keys only present in the parent must go too
+  db->clone(hoid, hoid2);
+  ASSERT_EQ(0, db->rm_key_range(hoid2, "foo" + num_str(30), "foo" + num_str(50)));
+  for (unsigned i = 0; i < 100; ++i) {
+    string result;
+    int r = tester.get_key(hoid2, "foo" + num_str(i), &result);
+    ASSERT_EQ(((i >= 10 && i < 20) || (i >= 30 && i < 50)) ? 0 : 1, r);
+    r = tester.get_key(hoid, "foo" + num_str(i), &result);
+    ASSERT_EQ((i >= 10 && i < 20) ? 0 : 1, r);
+  }
+
+  // a replayed range removal must not remove keys set after it
+  SequencerPosition rm_spos(10, 0, 0), set_spos(11, 0, 0);
+  ASSERT_EQ(0, db->rm_key_range(hoid, "foo" + num_str(50), "foo" + num_str(60),
+				&rm_spos));
+  map<string, bufferlist> to_set;
+  to_set["foo" + num_str(55)].append("bar" + num_str(55));
+  ASSERT_EQ(0, db->set_keys(hoid, to_set, &set_spos));
+  ASSERT_EQ(0, db->rm_key_range(hoid, "foo" + num_str(50), "foo" + num_str(60),
+				&rm_spos));
+  string result;
+  ASSERT_EQ(1, tester.get_key(hoid, "foo" + num_str(55), &result));
+  ASSERT_EQ(0, tester.get_key(hoid, "foo" + num_str(56), &result));
+
+  db->clear(hoid);
+  db->clear(hoid2);
+}
+
+TEST_F(ObjectMapTest, CloneChain) {
+  // each round clones the head and drops the previous clone, so the
+  // head's keys are found through a changing chain of parent headers
+  ghobject_t hoid(hobject_t(sobject_t("foo", CEPH_NOSNAP)));
+  vector<ghobject_t> clones;
+  for (unsigned i = 0; i < 20; ++i) {
+    tester.set_key(hoid, "foo" + num_str(i), "bar" + num_str(i));
+    ghobject_t clone(hobject_t(sobject_t("foo", i)));
+    db->clone(hoid, clone);
+    clones.push_back(clone);
+    if (i % 2)
+      db->clear(clones[i - 1]);
+
+    for (unsigned j = 0; j <= i; ++j) {
+      string result;
+      int r = tester.get_key(hoid, "foo" + num_str(j), &result);
+      ASSERT_EQ(1, r);
+      ASSERT_EQ("bar" + num_str(j), result);
+      r = tester.get_key(clone, "foo" + num_str(j), &result);
+      ASSERT_EQ(1, r);
+      ASSERT_EQ("bar" + num_str(j), result);
+    }
+  }
+
+  for (unsigned i = 1; i < clones.size(); i += 2)
+    db->clear(clones[i]);
+  db->clear(hoid);
+}
+
 TEST_F(ObjectMapTest, RandomTest) {
   tester.def_init();
   for (unsigned i = 0; i < 5000; ++i) {
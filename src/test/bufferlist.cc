@@ -169,6 +169,31 @@ TEST(Buffer, constructors) {
     EXPECT_EQ(0, buffer::get_total_alloc());
 }
 
+TEST(Buffer, page_pool) {
+  buffer::page_pool *pool = buffer::create_page_pool(4 * CEPH_PAGE_SIZE);
+  const char *first;
+  {
+    bufferptr ptr(buffer::create_page_aligned(CEPH_PAGE_SIZE + 1, pool));
+    EXPECT_EQ(CEPH_PAGE_SIZE + 1, ptr.length());
+    EXPECT_TRUE(ptr.is_page_aligned());
+    ::memset(ptr.c_str(), 'X', ptr.length());
+    first = ptr.c_str();
+    bufferptr clone = ptr.clone();
+    EXPECT_EQ(0, ::memcmp(clone.c_str(), ptr.c_str(), ptr.length()));
+  }
+  {
+    // released buffers are handed out again for the same size class
+    bufferptr ptr(buffer::create_page_aligned(2 * CEPH_PAGE_SIZE, pool));
+    EXPECT_EQ(first, ptr.c_str());
+    // and buffers outlive the creator's reference to the pool
+    buffer::put_page_pool(pool);
+    ::memset(ptr.c_str(), 'Y', ptr.length());
+  }
+  // a NULL pool falls back to a plain page aligned buffer
+  bufferptr ptr(buffer::create_page_aligned(CEPH_PAGE_SIZE, NULL));
+  EXPECT_TRUE(ptr.is_page_aligned());
+}
+
 TEST(BufferRaw, ostream) {
   bufferptr ptr(1);
   std::ostringstream stream;
@@ -0,0 +1,158 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "gtest/gtest.h"
+#include "common/MClockQueue.h"
+
+#include <map>
+
+
+typedef int Klass;
+typedef unsigned Item;
+typedef MClockQueue<Item, Klass> MQ;
+
+static double fake_now = 1000.0;
+static double fake_clock() {
+  return fake_now;
+}
+
+// items < 1000 are "client" ops, everything else is "recovery"
+struct TestClassifier : public MQ::Classifier {
+  std::map<unsigned, MQ::ClientInfo> info;
+  unsigned get_class(const Klass &cl, const Item &item) {
+    return item < 1000 ? 0 : 1;
+  }
+  MQ::ClientInfo get_info(unsigned c) {
+    return info[c];
+  }
+};
+
+struct Odd : public MQ::Filter {
+  bool operator()(const Item &item) {
+    return item % 2;
+  }
+};
+
+TEST(MClockQueue, strict_first) {
+  TestClassifier c;
+  MQ q(&c, &fake_clock);
+  EXPECT_TRUE(q.empty());
+  q.enqueue(Klass(1), 0, 1, Item(1));
+  q.enqueue_strict(Klass(1), 10, Item(2));
+  q.enqueue_strict(Klass(1), 20, Item(3));
+  q.enqueue_strict_front(Klass(1), 10, Item(4));
+  EXPECT_EQ(4u, q.length());
+  EXPECT_EQ(Item(3), q.dequeue());
+  EXPECT_EQ(Item(4), q.dequeue());
+  EXPECT_EQ(Item(2), q.dequeue());
+  EXPECT_EQ(Item(1), q.dequeue());
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(MClockQueue, fifo_per_client) {
+  TestClassifier c;
+  MQ q(&c, &fake_clock);
+  for (unsigned i = 0; i < 100; ++i)
+    q.enqueue(Klass(i % 3), 0, 1, Item(i));
+  q.enqueue_front(Klass(0), 0, 1, Item(500));
+
+  std::map<Klass, Item> last;
+  bool first = true;
+  while (!q.empty()) {
+    Item i = q.dequeue();
+    if (i == 500) {
+      // requeued at the front, so it precedes client 0's other items
+      EXPECT_TRUE(first || !last.count(Klass(0)));
+      continue;
+    }
+    first = false;
+    Klass k = Klass(i % 3);
+    if (last.count(k))
+      EXPECT_LT(last[k], i);
+    last[k] = i;
+  }
+}
+
+TEST(MClockQueue, weight) {
+  // no reservations: two backlogged clients share by weight
+  TestClassifier c;
+  c.info[0] = MQ::ClientInfo(0, 1, 0);
+  c.info[1] = MQ::ClientInfo(0, 3, 0);
+  MQ q(&c, &fake_clock);
+  for (unsigned i = 0; i < 100; ++i) {
+    q.enqueue(Klass(1), 0, 1, Item(i));
+    q.enqueue(Klass(2), 0, 1, Item(1000 + i));
+  }
+  unsigned low = 0;
+  for (unsigned i = 0; i < 80; ++i) {
+    if (q.dequeue() < 1000)
+      ++low;
+  }
+  EXPECT_EQ(20u, low);
+}
+
+TEST(MClockQueue, reservation) {
+  // a heavily weighted class cannot starve a reserved one
+  TestClassifier c;
+  c.info[0] = MQ::ClientInfo(0, 1000, 0);
+  c.info[1] = MQ::ClientInfo(10, 1, 0);
+  MQ q(&c, &fake_clock);
+  fake_now = 1000.0;
+  for (unsigned i = 0; i < 1000; ++i) {
+    q.enqueue(Klass(1), 0, 1, Item(i));
+    q.enqueue(Klass(2), 0, 1, Item(1000 + i));
+  }
+  // serve 100 items per 0.1s; the reserved client should get ~1 of them
+  // per 0.1s from its reservation in addition to its tiny weighted share
+  unsigned reserved = 0;
+  for (unsigned t = 0; t < 10; ++t) {
+    fake_now += 0.1;
+    for (unsigned i = 0; i < 100; ++i) {
+      if (q.dequeue() >= 1000)
+	++reserved;
+    }
+  }
+  EXPECT_GE(reserved, 10u);
+  EXPECT_LE(reserved, 12u);
+}
+
+TEST(MClockQueue, limit) {
+  // a limited client yields to others but still runs when alone
+  TestClassifier c;
+  c.info[0] = MQ::ClientInfo(0, 100, 1);
+  c.info[1] = MQ::ClientInfo(0, 1, 0);
+  MQ q(&c, &fake_clock);
+  fake_now = 2000.0;
+  for (unsigned i = 0; i < 10; ++i) {
+    q.enqueue(Klass(1), 0, 1, Item(i));
+    q.enqueue(Klass(2), 0, 1, Item(1000 + i));
+  }
+  EXPECT_EQ(Item(0), q.dequeue());
+  for (unsigned i = 0; i < 10; ++i)
+    EXPECT_EQ(Item(1000 + i), q.dequeue());
+  for (unsigned i = 1; i < 10; ++i)
+    EXPECT_EQ(Item(i), q.dequeue());
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(MClockQueue, remove) {
+  TestClassifier c;
+  MQ q(&c, &fake_clock);
+  for (unsigned i = 0; i < 100; ++i)
+    q.enqueue(Klass(i % 4), 0, 1, Item(i));
+  q.enqueue_strict(Klass(1), 100, Item(201));
+
+  std::list<Item> removed;
+  Odd odd;
+  q.remove_by_filter(odd, &removed);
+  EXPECT_EQ(51u, removed.size());
+  EXPECT_EQ(Item(201), removed.front());
+  EXPECT_EQ(50u, q.length());
+
+  removed.clear();
+  q.remove_by_class(Klass(2), &removed);
+  EXPECT_EQ(25u, removed.size());
+  EXPECT_EQ(25u, q.length());
+  while (!q.empty())
+    EXPECT_EQ(0u, q.dequeue() % 4);
+}
@@ -252,6 +252,21 @@ TEST_F(LibRadosIoPP, RoundTripPP) {
   ASSERT_EQ(0, memcmp(buf, cl.c_str(), sizeof(buf)));
 }
 
+TEST_F(LibRadosIoPP, ReadZeroLengthPP) {
+  bufferlist bl;
+  bl.append("hello world");
+  ASSERT_EQ(0, ioctx.write_full("foo", bl));
+  // length 0 reads from offset to the end of the object
+  bufferlist cl;
+  ASSERT_EQ((int)bl.length(), ioctx.read("foo", cl, 0, 0));
+  ASSERT_TRUE(cl.contents_equal(bl));
+  bufferlist dl;
+  ASSERT_EQ(5, ioctx.read("foo", dl, 0, 6));
+  ASSERT_EQ(string("world"), string(dl.c_str(), dl.length()));
+  bufferlist el;
+  ASSERT_EQ(0, ioctx.read("foo", el, 0, bl.length()));
+}
+
 TEST_F(LibRadosIoPP, RoundTripPP2)
 {
   bufferlist bl;
@@ -278,6 +278,7 @@ class Worker : public Thread {
   void stop() {
     done = true; 
     center.wakeup();
+    join();
   }
   void* entry() {
     center.set_owner(pthread_self());
@@ -322,6 +323,49 @@ TEST(EventCenterTest, DispatchTest) {
   worker2.stop();
 }
 
+class ChainEvent: public EventCallback {
+  EventCenter *center;
+  int remaining;
+  atomic_t *count;
+  Mutex *lock;
+  Cond *cond;
+
+ public:
+  ChainEvent(EventCenter *e, int n, atomic_t *atomic, Mutex *l, Cond *c)
+    : center(e), remaining(n), count(atomic), lock(l), cond(c) {}
+  void do_request(int id) {
+    if (--remaining) {
+      // queued from the owner: must run on the next pass, not after a wait
+      center->dispatch_event_external(EventCallbackRef(
+        new ChainEvent(center, remaining, count, lock, cond)));
+      return;
+    }
+    lock->Lock();
+    count->dec();
+    cond->Signal();
+    lock->Unlock();
+  }
+};
+
+TEST(EventCenterTest, DispatchFromOwnerTest) {
+  Worker worker(g_ceph_context);
+  atomic_t count(1);
+  Mutex lock("DispatchFromOwnerTest::lock");
+  Cond cond;
+  worker.create();
+  worker.center.dispatch_event_external(EventCallbackRef(
+    new ChainEvent(&worker.center, 1000, &count, &lock, &cond)));
+  {
+    Mutex::Locker l(lock);
+    utime_t timeout = ceph_clock_now(g_ceph_context);
+    timeout += 10;
+    while (count.read() && ceph_clock_now(g_ceph_context) < timeout)
+      cond.WaitUntil(lock, timeout);
+  }
+  ASSERT_EQ(0, count.read());
+  worker.stop();
+}
+
 INSTANTIATE_TEST_CASE_P(
   AsyncMessenger,
   EventDriverTest,
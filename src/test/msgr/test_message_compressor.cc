@@ -0,0 +1,165 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <stdlib.h>
+#include "acconfig.h"
+#include "msg/Message.h"
+#include "msg/MessageCompressor.h"
+#include "include/ceph_features.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include <gtest/gtest.h>
+
+class MTest : public Message {
+public:
+  MTest() : Message(CEPH_MSG_PING) {}
+  void encode_payload(uint64_t features) {}
+  void decode_payload() {}
+  const char *get_type_name() const { return "test"; }
+};
+
+static void fill(bufferlist &bl, unsigned len, bool random) {
+  bufferptr bp(len);
+  for (unsigned i = 0; i < len; ++i)
+    bp.c_str()[i] = random ? rand() : 'a' + (i / 100) % 4;
+  bl.push_back(bp);
+}
+
+#ifdef HAVE_SNAPPY
+TEST(MessageCompressor, round_trip) {
+  MessageCompressor *c = MessageCompressor::get(g_ceph_context);
+  MTest *m = new MTest;
+  bufferlist front, data;
+  fill(front, 8192, false);
+  fill(data, 65536, false);
+  bufferlist f = front, d = data;
+  m->set_payload(f);
+  m->set_data(d);
+
+  // not without the feature
+  c->compress(m, CEPH_FEATURES_ALL & ~CEPH_FEATURE_MSG_COMPRESS);
+  ASSERT_EQ(0, m->get_footer().flags);
+  ASSERT_TRUE(m->get_payload().contents_equal(front));
+
+  c->compress(m, CEPH_FEATURES_ALL);
+  ceph_msg_footer footer = m->get_footer();
+  ASSERT_TRUE(footer.flags & CEPH_MSG_FOOTER_FRONT_COMPRESSED);
+  ASSERT_TRUE(footer.flags & CEPH_MSG_FOOTER_DATA_COMPRESSED);
+  ASSERT_GT(front.length(), m->get_payload().length());
+  ASSERT_GT(data.length(), m->get_data().length());
+
+  f = m->get_payload();
+  d = m->get_data();
+  ASSERT_EQ(0, MessageCompressor::decompress(c, footer, f, d));
+  ASSERT_EQ(0, footer.flags);
+  ASSERT_TRUE(f.contents_equal(front));
+  ASSERT_TRUE(d.contents_equal(data));
+  ASSERT_TRUE(d.is_page_aligned());
+  m->put();
+}
+
+TEST(MessageCompressor, resend) {
+  MessageCompressor *c = MessageCompressor::get(g_ceph_context);
+  MTest *m = new MTest;
+  bufferlist front, data;
+  fill(front, 8192, false);
+  fill(data, 65536, false);
+  bufferlist f = front, d = data;
+  m->set_payload(f);
+  m->set_data(d);
+  c->compress(m, CEPH_FEATURES_ALL);
+  ASSERT_EQ(CEPH_MSG_FOOTER_FRONT_COMPRESSED | CEPH_MSG_FOOTER_DATA_COMPRESSED,
+	    m->get_footer().flags);
+
+  // resent to a peer without the feature, e.g. after a reconnect
+  m->encode(CEPH_FEATURES_ALL & ~CEPH_FEATURE_MSG_COMPRESS, 0);
+  ASSERT_EQ(0, m->get_footer().flags & (CEPH_MSG_FOOTER_FRONT_COMPRESSED |
+					CEPH_MSG_FOOTER_DATA_COMPRESSED));
+  ASSERT_TRUE(m->get_payload().contents_equal(front));
+  ASSERT_TRUE(m->get_data().contents_equal(data));
+  ASSERT_EQ(front.length(), m->get_header().front_len);
+  ASSERT_EQ(data.length(), m->get_header().data_len);
+
+  // and to one with it again
+  c->compress(m, CEPH_FEATURES_ALL);
+  ASSERT_TRUE(m->get_footer().flags & CEPH_MSG_FOOTER_DATA_COMPRESSED);
+  ASSERT_GT(data.length(), m->get_data().length());
+
+  // a re-encode starts from the original data
+  m->clear_payload();
+  m->encode(CEPH_FEATURES_ALL, 0);
+  ASSERT_EQ(0, m->get_footer().flags & (CEPH_MSG_FOOTER_FRONT_COMPRESSED |
+					CEPH_MSG_FOOTER_DATA_COMPRESSED));
+  ASSERT_TRUE(m->get_data().contents_equal(data));
+  m->put();
+}
+
+TEST(MessageCompressor, incompressible) {
+  MessageCompressor *c = MessageCompressor::get(g_ceph_context);
+  MTest *m = new MTest;
+  bufferlist data, small;
+  fill(data, 65536, true);
+  fill(small, 100, false);
+  m->set_data(data);
+  m->set_payload(small);
+  c->compress(m, CEPH_FEATURES_ALL);
+  // too small to bother, and random bytes don't shrink
+  ASSERT_EQ(0, m->get_footer().flags);
+  ASSERT_EQ(100u, m->get_payload().length());
+  ASSERT_EQ(65536u, m->get_data().length());
+  m->put();
+}
+
+TEST(MessageCompressor, corrupt) {
+  ceph_msg_footer footer;
+  memset(&footer, 0, sizeof(footer));
+  footer.flags = CEPH_MSG_FOOTER_DATA_COMPRESSED;
+  bufferlist front, data;
+  fill(data, 100, true);
+  // a 4GB uncompressed length
+  memcpy(data.c_str(), "\xff\xff\xff\xff\x0f", 5);
+  ASSERT_GT(0, MessageCompressor::decompress(NULL, footer, front, data));
+}
+#else
+TEST(MessageCompressor, without_snappy) {
+  ASSERT_EQ(CEPH_FEATURE_MSG_COMPRESS,
+	    MessageCompressor::get_unsupported_features());
+  MessageCompressor *c = MessageCompressor::get(g_ceph_context);
+  MTest *m = new MTest;
+  bufferlist front, data;
+  fill(front, 8192, false);
+  fill(data, 65536, false);
+  m->set_payload(front);
+  m->set_data(data);
+  c->compress(m, CEPH_FEATURES_ALL);
+  ASSERT_EQ(0, m->get_footer().flags);
+  ASSERT_EQ(8192u, m->get_payload().length());
+  ASSERT_EQ(65536u, m->get_data().length());
+  m->put();
+
+  ceph_msg_footer footer;
+  memset(&footer, 0, sizeof(footer));
+  footer.flags = CEPH_MSG_FOOTER_DATA_COMPRESSED;
+  ASSERT_EQ(-EOPNOTSUPP, MessageCompressor::decompress(NULL, footer, front,
+							 data));
+}
+#endif
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  // string options can't be changed once threads are started
+  g_ceph_context->_conf->set_val("ms_compress_min_size", "4096");
+  g_ceph_context->_conf->set_val("ms_compress_msg_types", "test");
+  g_ceph_context->_conf->apply_changes(NULL);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make unittest_message_compressor && ./unittest_message_compressor"
+// End:
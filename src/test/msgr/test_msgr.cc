@@ -21,6 +21,8 @@
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/ceph_argparse.h"
+#include "common/ceph_json.h"
+#include "common/perf_counters.h"
 #include "global/global_init.h"
 #include "msg/Dispatcher.h"
 #include "msg/msg_types.h"
@@ -1311,6 +1313,104 @@ TEST_P(MessengerTest, MarkdownTest) {
   delete server_msgr2;
 }
 
+class BurstDispatcher : public Dispatcher {
+ public:
+  Mutex lock;
+  Cond cond;
+  bool is_server;
+  unsigned burst;     ///< pings the server sends back for each one it gets
+  unsigned received;
+
+  BurstDispatcher(bool s, unsigned b): Dispatcher(g_ceph_context),
+                                       lock("BurstDispatcher::lock"),
+                                       is_server(s), burst(b), received(0) {}
+  bool ms_can_fast_dispatch_any() const { return true; }
+  bool ms_can_fast_dispatch(Message *m) const {
+    return m->get_type() == CEPH_MSG_PING;
+  }
+  void ms_fast_dispatch(Message *m) {
+    if (is_server) {
+      // we are on the connection's worker, so these are corked and
+      // should leave in one batch
+      for (unsigned i = 0; i < burst; ++i)
+        m->get_connection()->send_message(new MPing());
+    } else {
+      Mutex::Locker l(lock);
+      ++received;
+      cond.Signal();
+    }
+    m->put();
+  }
+  bool ms_dispatch(Message *m) {
+    m->put();
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) { return true; }
+  void ms_handle_remote_reset(Connection *con) {}
+  bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+                            bufferlist& authorizer, bufferlist& authorizer_reply,
+                            bool& isvalid, CryptoKey& session_key) {
+    isvalid = true;
+    return true;
+  }
+};
+
+static uint64_t get_perf_counter(const string &logger, const string &name)
+{
+  JSONFormatter f;
+  g_ceph_context->get_perfcounters_collection()->dump_formatted(
+    &f, false, logger, name);
+  stringstream ss;
+  f.flush(ss);
+  JSONParser p;
+  if (!p.parse(ss.str().c_str(), ss.str().length()))
+    return 0;
+  JSONObj *l = p.find_obj(logger);
+  JSONObj *counter = l ? l->find_obj(name) : NULL;
+  return counter ? strtoull(counter->get_data().c_str(), NULL, 10) : 0;
+}
+
+TEST(AsyncMessengerTest, SendBatchTest) {
+  const unsigned burst = 32;
+  Messenger *server_msgr = Messenger::create(g_ceph_context, "async", entity_name_t::OSD(0), "burst_server", getpid());
+  Messenger *client_msgr = Messenger::create(g_ceph_context, "async", entity_name_t::CLIENT(-1), "burst_client", getpid());
+  server_msgr->set_default_policy(Messenger::Policy::stateless_server(0, 0));
+  client_msgr->set_default_policy(Messenger::Policy::lossy_client(0, 0));
+  BurstDispatcher cli_dispatcher(false, 0), srv_dispatcher(true, burst);
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  ConnectionRef conn = client_msgr->get_connection(server_msgr->get_myinst());
+  ASSERT_EQ(conn->send_message(new MPing()), 0);
+  {
+    Mutex::Locker l(cli_dispatcher.lock);
+    while (cli_dispatcher.received < burst)
+      cli_dispatcher.cond.Wait(cli_dispatcher.lock);
+  }
+
+  // the client sent its ping on its own
+  ASSERT_EQ(1u, get_perf_counter("AsyncMessenger::burst_client", "send_msgs"));
+  ASSERT_EQ(1u, get_perf_counter("AsyncMessenger::burst_client", "send_batches"));
+  // the server's replies were corked and coalesced
+  ASSERT_EQ(burst, get_perf_counter("AsyncMessenger::burst_server", "send_corked"));
+  ASSERT_EQ(burst, get_perf_counter("AsyncMessenger::burst_server", "send_msgs"));
+  ASSERT_EQ(1u, get_perf_counter("AsyncMessenger::burst_server", "send_batches"));
+  ASSERT_EQ(burst, get_perf_counter("AsyncMessenger::burst_server", "send_max_batch"));
+  ASSERT_EQ(burst, get_perf_counter("AsyncMessenger::burst_server", "send_max_queue_depth"));
+
+  server_msgr->shutdown();
+  client_msgr->shutdown();
+  server_msgr->wait();
+  client_msgr->wait();
+  delete server_msgr;
+  delete client_msgr;
+}
+
 INSTANTIATE_TEST_CASE_P(
   Messenger,
   MessengerTest,
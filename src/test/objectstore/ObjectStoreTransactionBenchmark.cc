@@ -43,6 +43,8 @@ class Transaction {
   };
   static Tick write_ticks, setattr_ticks, omap_setkeys_ticks, omap_rmkeys_ticks;
   static Tick encode_ticks, decode_ticks, iterate_ticks;
+  static Tick append_ticks, encoded_bytes_ticks;
+  static uint64_t misaligned_data;
 
   void write(coll_t cid, const ghobject_t& oid, uint64_t off, uint64_t len,
              const bufferlist& data) {
@@ -83,6 +85,30 @@ class Transaction {
     decode_ticks.add(Cycles::rdtsc() - start_time);
   }
 
+  void apply_append() {
+    ObjectStore::Transaction d;
+    uint64_t start_time = Cycles::rdtsc();
+    d.append(t);
+    append_ticks.add(Cycles::rdtsc() - start_time);
+  }
+
+  void apply_encoded_bytes() {
+    uint64_t start_time = Cycles::rdtsc();
+    t.get_encoded_bytes();
+    encoded_bytes_ticks.add(Cycles::rdtsc() - start_time);
+  }
+
+  // the journal can only skip realigning the payload if the offset of
+  // the largest write inside the encoded transaction is reported exactly
+  void check_data_alignment(bufferlist& expected) {
+    bufferlist bl;
+    t.encode(bl);
+    bufferlist payload;
+    payload.substr_of(bl, t.get_data_offset(), t.get_data_length());
+    if (!payload.contents_equal(expected))
+      misaligned_data++;
+  }
+
   void apply_iterate() {
     uint64_t start_time = Cycles::rdtsc();
     ObjectStore::Transaction::iterator i = t.begin();
@@ -138,6 +164,9 @@ class Transaction {
     cerr << " encode op: " << Cycles::to_microseconds(Transaction::encode_ticks.ticks) << "us count: " << Transaction::encode_ticks.count << std::endl;
     cerr << " decode op: " << Cycles::to_microseconds(Transaction::decode_ticks.ticks) << "us count: " << Transaction::decode_ticks.count << std::endl;
     cerr << " iterate op: " << Cycles::to_microseconds(Transaction::iterate_ticks.ticks) << "us count: " << Transaction::iterate_ticks.count << std::endl;
+    cerr << " append op: " << Cycles::to_microseconds(Transaction::append_ticks.ticks) << "us count: " << Transaction::append_ticks.count << std::endl;
+    cerr << " encoded_bytes op: " << Cycles::to_microseconds(Transaction::encoded_bytes_ticks.ticks) << "us count: " << Transaction::encoded_bytes_ticks.count << std::endl;
+    cerr << " misaligned data: " << Transaction::misaligned_data << std::endl;
   }
 };
 
@@ -206,6 +235,9 @@ class PerfCase {
         t.apply_encode_decode();
         t.apply_iterate();
         ticks += Cycles::rdtsc() - start_time;
+        t.apply_encoded_bytes();
+        t.apply_append();
+        t.check_data_alignment(data["4k"]);
       }
       {
         Transaction t;
@@ -223,6 +255,8 @@ class PerfCase {
         t.apply_encode_decode();
         t.apply_iterate();
         ticks += Cycles::rdtsc() - start_time;
+        t.apply_encoded_bytes();
+        t.apply_append();
       }
     }
     return ticks;
@@ -239,6 +273,8 @@ const ghobject_t PerfCase::pglog_oid(hobject_t(sobject_t(object_t("cid_pglog"),
 const ghobject_t PerfCase::info_oid(hobject_t(sobject_t(object_t("infos"), 0)));
 Transaction::Tick Transaction::write_ticks, Transaction::setattr_ticks, Transaction::omap_setkeys_ticks, Transaction::omap_rmkeys_ticks;
 Transaction::Tick Transaction::encode_ticks, Transaction::decode_ticks, Transaction::iterate_ticks;
+Transaction::Tick Transaction::append_ticks, Transaction::encoded_bytes_ticks;
+uint64_t Transaction::misaligned_data = 0;
 
 void usage(const string &name) {
   cerr << "Usage: " << name << " [times] "
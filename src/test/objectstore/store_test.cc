@@ -26,6 +26,8 @@
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/errno.h"
+#include "include/stringify.h"
+#include "common/ceph_json.h"
 #include <boost/scoped_ptr.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int.hpp>
@@ -314,6 +316,148 @@ TEST_P(StoreTest, SimpleCloneRangeTest) {
 }
 
 
+TEST_P(StoreTest, CloneOverwriteTest) {
+  // clones must not see later partial overwrites, truncates or zeroes
+  // of their source, and vice versa
+  int r;
+  coll_t cid = coll_t("coll");
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  ghobject_t hoid3(hobject_t(sobject_t("Object 3", CEPH_NOSNAP)));
+  const unsigned len = 256 * 1024;
+  bufferlist orig;
+  orig.append(string(len, 'a'));
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, len, orig);
+    t.clone(cid, hoid, hoid2);
+    t.clone_range(cid, hoid, hoid3, 0, len, 0);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    bufferlist bl;
+    bl.append(string(100, 'b'));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 4000, 100, bl);
+    t.zero(cid, hoid2, 65536, 65536);
+    t.truncate(cid, hoid3, 1000);
+    t.truncate(cid, hoid3, len);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+
+    bufferlist exp1, exp2, exp3;
+    exp1.append(string(4000, 'a'));
+    exp1.append(string(100, 'b'));
+    exp1.append(string(len - 4100, 'a'));
+    exp2.append(string(65536, 'a'));
+    exp2.append_zero(65536);
+    exp2.append(string(len - 131072, 'a'));
+    exp3.append(string(1000, 'a'));
+    exp3.append_zero(len - 1000);
+
+    bufferlist got;
+    r = store->read(cid, hoid, 0, len, got);
+    ASSERT_EQ(r, (int)len);
+    ASSERT_TRUE(got.contents_equal(exp1));
+    got.clear();
+    r = store->read(cid, hoid2, 0, len, got);
+    ASSERT_EQ(r, (int)len);
+    ASSERT_TRUE(got.contents_equal(exp2));
+    got.clear();
+    r = store->read(cid, hoid3, 0, len, got);
+    ASSERT_EQ(r, (int)len);
+    ASSERT_TRUE(got.contents_equal(exp3));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, hoid2);
+    t.remove(cid, hoid3);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTest, SmallOverwriteTest) {
+  // repeated sub-strip writes within and across transactions must read
+  // back the latest data, including after truncate and rename
+  int r;
+  coll_t cid = coll_t("coll");
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  const unsigned len = 16384;
+  string expected(len, 'a');
+  {
+    bufferlist bl;
+    bl.append(expected);
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, len, bl);
+    for (unsigned i = 0; i < 64; ++i) {
+      bufferlist small;
+      small.append(string(10, 'b' + (i % 20)));
+      t.write(cid, hoid, i * 7, 10, small);
+      expected.replace(i * 7, 10, string(10, 'b' + (i % 20)));
+    }
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  for (unsigned round = 0; round < 3; ++round) {
+    bufferlist got, exp;
+    exp.append(expected);
+    r = store->read(cid, hoid, 0, len, got);
+    ASSERT_EQ(r, (int)len);
+    ASSERT_TRUE(got.contents_equal(exp));
+
+    bufferlist small;
+    small.append(string(100, 'x' + round));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 5000, 100, small);
+    t.truncate(cid, hoid, 4000);
+    t.truncate(cid, hoid, len);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    expected.replace(4000, len - 4000, string(len - 4000, '\0'));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.collection_move_rename(cid, hoid, cid, hoid2);
+    bufferlist small;
+    small.append(string(10, 'z'));
+    t.write(cid, hoid2, 3000, 10, small);
+    expected.replace(3000, 10, string(10, 'z'));
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+
+    bufferlist got, exp;
+    exp.append(expected);
+    r = store->read(cid, hoid2, 0, len, got);
+    ASSERT_EQ(r, (int)len);
+    ASSERT_TRUE(got.contents_equal(exp));
+    ASSERT_FALSE(store->exists(cid, hoid));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid2);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, SimpleObjectLongnameTest) {
   int r;
   coll_t cid = coll_t("coll");
@@ -1810,6 +1954,373 @@ TEST(EXT4StoreTest, _detect_fs) {
 }
 
 
+struct C_RecordApplied : public Context {
+  Mutex *lock;
+  vector<int> *order;
+  int i;
+  C_RecordApplied(Mutex *l, vector<int> *o, int i) : lock(l), order(o), i(i) {}
+  void finish(int r) {
+    Mutex::Locker l(*lock);
+    order->push_back(i);
+  }
+};
+
+/// enable filestore_sequencer_parallel_apply until the end of the scope
+struct ParallelApplyEnabled {
+  ParallelApplyEnabled() {
+    g_ceph_context->_conf->set_val("filestore_sequencer_parallel_apply", "true");
+    g_ceph_context->_conf->apply_changes(NULL);
+  }
+  ~ParallelApplyEnabled() {
+    g_ceph_context->_conf->set_val("filestore_sequencer_parallel_apply", "false");
+    g_ceph_context->_conf->apply_changes(NULL);
+  }
+};
+
+TEST(FileStoreTest, SequencerParallelApply) {
+  ParallelApplyEnabled enabled;
+  int r = ::mkdir("store_test_temp_dir", 0777);
+  ASSERT_TRUE(r == 0 || errno == EEXIST);
+  {
+    FileStore store("store_test_temp_dir", "store_test_temp_journal");
+    ASSERT_EQ(store.mkfs(), 0);
+    ASSERT_EQ(store.mount(), 0);
+
+    ObjectStore::Sequencer osr("test");
+    coll_t cid("parallel_apply");
+    {
+      ObjectStore::Transaction t;
+      t.create_collection(cid);
+      r = store.apply_transaction(&osr, t);
+      ASSERT_EQ(r, 0);
+    }
+
+    // writes to a handful of objects interleaved on one sequencer: the
+    // ones to the same object have to apply in order, and every op has
+    // to complete in queue order regardless of how they were applied
+    const int num_objects = 8;
+    const int num_ops = 400;
+    const unsigned len = 4096;
+    Mutex lock("SequencerParallelApply::lock");
+    vector<int> order;
+    vector<ObjectStore::Transaction> tls(num_ops);
+    for (int i = 0; i < num_ops; ++i) {
+      ghobject_t oid(hobject_t(sobject_t(
+	"obj_" + stringify(i % num_objects), CEPH_NOSNAP)));
+      bufferlist bl;
+      bl.append(string(len, 'a' + i % 26));
+      tls[i].write(cid, oid, (i / num_objects) * len, len, bl);
+      r = store.queue_transaction(&osr, &tls[i],
+				  new C_RecordApplied(&lock, &order, i));
+      ASSERT_EQ(r, 0);
+    }
+    C_SaferCond applied;
+    ObjectStore::Transaction last;
+    last.nop();
+    r = store.queue_transaction(&osr, &last, &applied);
+    ASSERT_EQ(r, 0);
+    applied.wait();
+
+    ASSERT_EQ(order.size(), (unsigned)num_ops);
+    for (int i = 0; i < num_ops; ++i)
+      ASSERT_EQ(order[i], i);
+
+    for (int i = 0; i < num_ops; ++i) {
+      ghobject_t oid(hobject_t(sobject_t(
+	"obj_" + stringify(i % num_objects), CEPH_NOSNAP)));
+      bufferlist bl, expected;
+      expected.append(string(len, 'a' + i % 26));
+      r = store.read(cid, oid, (i / num_objects) * len, len, bl);
+      ASSERT_EQ(r, (int)len);
+      ASSERT_TRUE(bl.contents_equal(expected));
+    }
+
+    {
+      ObjectStore::Transaction t;
+      for (int i = 0; i < num_objects; ++i)
+	t.remove(cid, ghobject_t(hobject_t(sobject_t(
+	  "obj_" + stringify(i), CEPH_NOSNAP))));
+      t.remove_collection(cid);
+      r = store.apply_transaction(&osr, t);
+      ASSERT_EQ(r, 0);
+    }
+    store.umount();
+  }
+}
+
+static uint64_t get_filestore_counter(const string &name)
+{
+  JSONFormatter f;
+  g_ceph_context->get_perfcounters_collection()->dump_formatted(
+    &f, false, "filestore", name);
+  stringstream ss;
+  f.flush(ss);
+  JSONParser p;
+  if (!p.parse(ss.str().c_str(), ss.str().length()))
+    return 0;
+  JSONObj *logger = p.find_obj("filestore");
+  JSONObj *counter = logger ? logger->find_obj(name) : NULL;
+  return counter ? strtoull(counter->get_data().c_str(), NULL, 10) : 0;
+}
+
+TEST(FileStoreTest, SequencerParallelApplyPGMeta) {
+  ParallelApplyEnabled enabled;
+  int r = ::mkdir("store_test_temp_dir", 0777);
+  ASSERT_TRUE(r == 0 || errno == EEXIST);
+  FileStore store("store_test_temp_dir", "store_test_temp_journal");
+  ASSERT_EQ(store.mkfs(), 0);
+  ASSERT_EQ(store.mount(), 0);
+
+  ObjectStore::Sequencer osr("test");
+  coll_t cid("parallel_apply_pgmeta");
+  ghobject_t pgmeta(hobject_t(sobject_t("pgmeta", CEPH_NOSNAP)));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.touch(cid, pgmeta);
+    r = store.apply_transaction(&osr, t);
+    ASSERT_EQ(r, 0);
+  }
+
+  // shaped like ordinary OSD writes: a data write plus the pg log entry
+  // and pg info going to the pg meta object of the same collection
+  const int num_objects = 16;
+  const int num_ops = 400;
+  const unsigned len = 16384;
+  Mutex lock("SequencerParallelApplyPGMeta::lock");
+  vector<int> order;
+  vector<ObjectStore::Transaction> tls(num_ops);
+  for (int i = 0; i < num_ops; ++i) {
+    ghobject_t oid(hobject_t(sobject_t(
+      "obj_" + stringify(i % num_objects), CEPH_NOSNAP)));
+    bufferlist bl;
+    bl.append(string(len, 'a' + i % 26));
+    tls[i].write(cid, oid, (i / num_objects) * len, len, bl);
+    map<string, bufferlist> km;
+    ::encode(i, km["_info"]);
+    ::encode(i, km["_epoch"]);
+    ::encode(i, km["log." + stringify(i)]);
+    tls[i].omap_setkeys(cid, pgmeta, km);
+    if (i > 0) {
+      set<string> trim;
+      trim.insert("log." + stringify(i - 1));
+      tls[i].omap_rmkeys(cid, pgmeta, trim);
+    }
+    r = store.queue_transaction(&osr, &tls[i],
+				new C_RecordApplied(&lock, &order, i));
+    ASSERT_EQ(r, 0);
+  }
+  C_SaferCond applied;
+  ObjectStore::Transaction last;
+  last.nop();
+  r = store.queue_transaction(&osr, &last, &applied);
+  ASSERT_EQ(r, 0);
+  applied.wait();
+
+  // the pg meta updates must not have serialized the data writes
+  EXPECT_GT(get_filestore_counter("parallel_apply"), 0u);
+
+  ASSERT_EQ(order.size(), (unsigned)num_ops);
+  for (int i = 0; i < num_ops; ++i)
+    ASSERT_EQ(order[i], i);
+
+  // ...and must have been applied in order
+  map<string, bufferlist> km;
+  set<string> keys;
+  keys.insert("_info");
+  keys.insert("_epoch");
+  keys.insert("log." + stringify(num_ops - 1));
+  r = store.omap_get_values(cid, pgmeta, keys, &km);
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(km.size(), 3u);
+  for (map<string, bufferlist>::iterator p = km.begin(); p != km.end(); ++p) {
+    int v;
+    bufferlist::iterator bp = p->second.begin();
+    ::decode(v, bp);
+    ASSERT_EQ(v, num_ops - 1);
+  }
+  set<string> all;
+  r = store.omap_get_keys(cid, pgmeta, &all);
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(all.size(), 3u);
+
+  for (int i = 0; i < num_ops; ++i) {
+    ghobject_t oid(hobject_t(sobject_t(
+      "obj_" + stringify(i % num_objects), CEPH_NOSNAP)));
+    bufferlist bl, expected;
+    expected.append(string(len, 'a' + i % 26));
+    r = store.read(cid, oid, (i / num_objects) * len, len, bl);
+    ASSERT_EQ(r, (int)len);
+    ASSERT_TRUE(bl.contents_equal(expected));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    for (int i = 0; i < num_objects; ++i)
+      t.remove(cid, ghobject_t(hobject_t(sobject_t(
+	"obj_" + stringify(i), CEPH_NOSNAP))));
+    t.remove(cid, pgmeta);
+    t.remove_collection(cid);
+    r = store.apply_transaction(&osr, t);
+    ASSERT_EQ(r, 0);
+  }
+  store.umount();
+}
+
+/// reopen evicted fds by file handle, with a tiny fd cache
+struct FDCacheHandlesEnabled {
+  FDCacheHandlesEnabled() {
+    g_ceph_context->_conf->set_val("filestore_fd_cache_handles", "true");
+    g_ceph_context->_conf->set_val("filestore_fd_cache_size", "16");
+    g_ceph_context->_conf->apply_changes(NULL);
+  }
+  ~FDCacheHandlesEnabled() {
+    g_ceph_context->_conf->set_val("filestore_fd_cache_handles", "false");
+    g_ceph_context->_conf->set_val("filestore_fd_cache_size", "128");
+    g_ceph_context->_conf->apply_changes(NULL);
+  }
+};
+
+TEST(FileStoreTest, FDCacheHandles) {
+  FDCacheHandlesEnabled enabled;
+  int r = ::mkdir("store_test_temp_dir", 0777);
+  ASSERT_TRUE(r == 0 || errno == EEXIST);
+  FileStore store("store_test_temp_dir", "store_test_temp_journal");
+  ASSERT_EQ(store.mkfs(), 0);
+  ASSERT_EQ(store.mount(), 0);
+
+  ObjectStore::Sequencer osr("test");
+  coll_t cid("fd_cache_handles");
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    r = store.apply_transaction(&osr, t);
+    ASSERT_EQ(r, 0);
+  }
+
+  // many more objects than cached fds, so most reads reopen an evicted
+  // fd, by handle if the kernel lets us and by path otherwise
+  const int num_objects = 256;
+  for (int i = 0; i < num_objects; ++i) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append("obj_" + stringify(i));
+    t.write(cid, ghobject_t(hobject_t(sobject_t(
+      "obj_" + stringify(i), CEPH_NOSNAP))), 0, bl.length(), bl);
+    r = store.apply_transaction(&osr, t);
+    ASSERT_EQ(r, 0);
+  }
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int i = 0; i < num_objects; ++i) {
+      bufferlist bl;
+      string expected = "obj_" + stringify(i);
+      r = store.read(cid, ghobject_t(hobject_t(sobject_t(
+	"obj_" + stringify(i), CEPH_NOSNAP))), 0, 0, bl);
+      ASSERT_EQ(r, (int)expected.length());
+      ASSERT_EQ(string(bl.c_str(), bl.length()), expected);
+    }
+  }
+
+  // a removed and recreated object must not be reopened by its old handle
+  ghobject_t oid(hobject_t(sobject_t("obj_0", CEPH_NOSNAP)));
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, oid);
+    bufferlist bl;
+    bl.append("recreated");
+    t.write(cid, oid, 0, bl.length(), bl);
+    r = store.apply_transaction(&osr, t);
+    ASSERT_EQ(r, 0);
+  }
+  for (int i = 1; i < num_objects; ++i) {
+    bufferlist bl;
+    r = store.read(cid, ghobject_t(hobject_t(sobject_t(
+      "obj_" + stringify(i), CEPH_NOSNAP))), 0, 0, bl);
+    ASSERT_GT(r, 0);
+  }
+  {
+    bufferlist bl;
+    r = store.read(cid, oid, 0, 0, bl);
+    ASSERT_EQ(r, (int)strlen("recreated"));
+    ASSERT_EQ(string(bl.c_str(), bl.length()), "recreated");
+  }
+
+  {
+    ObjectStore::Transaction t;
+    for (int i = 0; i < num_objects; ++i)
+      t.remove(cid, ghobject_t(hobject_t(sobject_t(
+	"obj_" + stringify(i), CEPH_NOSNAP))));
+    t.remove_collection(cid);
+    r = store.apply_transaction(&osr, t);
+    ASSERT_EQ(r, 0);
+  }
+  store.umount();
+}
+
+TEST(FileStoreTest, IncrementalSplit) {
+  g_ceph_context->_conf->set_val("filestore_split_incremental", "true");
+  g_ceph_context->_conf->apply_changes(NULL);
+  int r = ::mkdir("store_test_temp_dir", 0777);
+  ASSERT_TRUE(r == 0 || errno == EEXIST);
+  {
+    FileStore store("store_test_temp_dir", "store_test_temp_journal");
+    ASSERT_EQ(store.mkfs(), 0);
+    ASSERT_EQ(store.mount(), 0);
+
+    coll_t cid("incremental_split");
+    {
+      ObjectStore::Transaction t;
+      t.create_collection(cid);
+      r = store.apply_transaction(t);
+      ASSERT_EQ(r, 0);
+    }
+
+    // enough objects to split the root and a level below it; every
+    // object has to be found and listed exactly once while subdirs are
+    // only partially split
+    const int num_objects = 2000;
+    set<ghobject_t> created;
+    for (int i = 0; i < num_objects; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t(
+	"obj_" + stringify(i), CEPH_NOSNAP)));
+      ObjectStore::Transaction t;
+      t.touch(cid, hoid);
+      r = store.apply_transaction(t);
+      ASSERT_EQ(r, 0);
+      created.insert(hoid);
+      if (i % 100 == 0) {
+	for (set<ghobject_t>::iterator j = created.begin();
+	     j != created.end();
+	     ++j) {
+	  struct stat st;
+	  ASSERT_EQ(store.stat(cid, *j, &st), 0);
+	}
+      }
+    }
+
+    vector<ghobject_t> objects;
+    r = store.collection_list(cid, objects);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(objects.size(), created.size());
+    set<ghobject_t> listed(objects.begin(), objects.end());
+    ASSERT_TRUE(listed == created);
+
+    {
+      ObjectStore::Transaction t;
+      for (set<ghobject_t>::iterator i = created.begin();
+	   i != created.end();
+	   ++i)
+	t.remove(cid, *i);
+      t.remove_collection(cid);
+      r = store.apply_transaction(t);
+      ASSERT_EQ(r, 0);
+    }
+    store.umount();
+  }
+  g_ceph_context->_conf->set_val("filestore_split_incremental", "false");
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
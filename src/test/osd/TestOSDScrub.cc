@@ -141,6 +141,54 @@ TEST(TestOSDScrub, scrub_time_permit) {
 
 }
 
+TEST(TestOSDScrub, scrub_budget) {
+  ObjectStore *store = ObjectStore::create(g_ceph_context,
+             g_conf->osd_objectstore,
+             g_conf->osd_data,
+             g_conf->osd_journal);
+  Messenger *ms = Messenger::create(g_ceph_context, g_conf->ms_type,
+             entity_name_t::OSD(0), "make_checker",
+             getpid());
+  ms->set_cluster_protocol(CEPH_OSD_PROTOCOL);
+  ms->set_default_policy(Messenger::Policy::stateless_server(0, 0));
+  ms->bind(g_conf->public_addr);
+  MonClient mc(g_ceph_context);
+  mc.build_initial_monmap();
+  TestOSDScrub* osd = new TestOSDScrub(g_ceph_context, store, 0, ms, ms, ms, ms, ms, ms, &mc, "", "");
+  OSDService *service = &osd->service;
+  utime_t now(1000, 0);
+
+  // unlimited
+  service->scrub_budget_charge(1 << 30, 1000, now);
+  ASSERT_EQ(0.0, service->scrub_budget_wait(now));
+
+  g_ceph_context->_conf->set_val("osd_deep_scrub_bytes_per_sec", "1000");
+  g_ceph_context->_conf->apply_changes(NULL);
+  ASSERT_EQ(0.0, service->scrub_budget_wait(now));
+  service->scrub_budget_charge(3000, 10, now);
+  ASSERT_DOUBLE_EQ(3.0, service->scrub_budget_wait(now));
+  ASSERT_DOUBLE_EQ(2.0, service->scrub_budget_wait(now + utime_t(1, 0)));
+  // refill is capped at a one second burst
+  now += utime_t(100, 0);
+  ASSERT_EQ(0.0, service->scrub_budget_wait(now));
+  service->scrub_budget_charge(1500, 0, now);
+  ASSERT_DOUBLE_EQ(0.5, service->scrub_budget_wait(now));
+
+  g_ceph_context->_conf->set_val("osd_deep_scrub_ops_per_sec", "10");
+  g_ceph_context->_conf->apply_changes(NULL);
+  now += utime_t(100, 0);
+  service->scrub_budget_charge(0, 40, now);
+  ASSERT_DOUBLE_EQ(3.0, service->scrub_budget_wait(now));
+  // the larger of the two waits applies
+  service->scrub_budget_charge(6000, 0, now);
+  ASSERT_DOUBLE_EQ(5.0, service->scrub_budget_wait(now));
+
+  g_ceph_context->_conf->set_val("osd_deep_scrub_bytes_per_sec", "0");
+  g_ceph_context->_conf->set_val("osd_deep_scrub_ops_per_sec", "0");
+  g_ceph_context->_conf->apply_changes(NULL);
+  ASSERT_EQ(0.0, service->scrub_budget_wait(now));
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -0,0 +1,76 @@
+#!/bin/bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source test/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7113"
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function get_fast_reads() {
+    local dir=$1
+
+    CEPH_ARGS='' ./ceph --format=json daemon $dir/ceph-osd.0.asok perf dump | \
+        grep -o '"op_fast_read":[0-9]*' | cut -d: -f2
+}
+
+function TEST_fast_read() {
+    local dir=$1
+
+    run_mon $dir a --osd_pool_default_size=1 || return 1
+    run_osd $dir 0 --osd-fast-read=true || return 1
+    wait_for_clean || return 1
+
+    dd if=/dev/urandom of=$dir/obj bs=1024 count=1024 2>/dev/null
+    ./rados -p rbd put obj $dir/obj || return 1
+    wait_for_clean || return 1
+
+    local before=$(get_fast_reads $dir)
+    ./rados -p rbd get obj $dir/obj.out || return 1
+    cmp $dir/obj $dir/obj.out || return 1
+    ./rados -p rbd stat obj || return 1
+    local after=$(get_fast_reads $dir)
+    test $after -gt $before || return 1
+
+    # the read op semantics must not depend on the path taken
+    CEPH_ARGS="$CEPH_ARGS --osd_pool_default_size=1" \
+        ./ceph_test_rados_api_io \
+        --gtest_filter='LibRadosIoPP.ReadZeroLengthPP:LibRadosIoPP.ReadOpPP:LibRadosIoPP.RoundTripPP' || return 1
+
+    # turned off at runtime, reads go through the pg lock again
+    ./ceph tell osd.0 injectargs -- --no-osd-fast-read || return 1
+    before=$(get_fast_reads $dir)
+    ./rados -p rbd get obj $dir/obj.out || return 1
+    cmp $dir/obj $dir/obj.out || return 1
+    after=$(get_fast_reads $dir)
+    test $after = $before || return 1
+}
+
+main osd-fast-read "$@"
+
+# Local Variables:
+# compile-command: "cd ../.. ; make -j4 && test/osd/osd-fast-read.sh"
+# End:
@@ -0,0 +1,125 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <stdio.h>
+#include "osd/ObjectContextCache.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include <gtest/gtest.h>
+
+static hobject_t make_oid(unsigned i, snapid_t snap = CEPH_NOSNAP) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "obj_%u", i);
+  // collide on the placement hash so the index has to tell names apart
+  return hobject_t(object_t(buf), "", snap, i % 4, 0, "");
+}
+
+TEST(ObjectContextCache, lookup_or_create) {
+  ObjectContextCache cache(g_ceph_context, 0, 100);
+  ASSERT_TRUE(cache.empty());
+  ASSERT_FALSE(cache.lookup(make_oid(0)));
+
+  ObjectContextRef a = cache.lookup_or_create(make_oid(0));
+  ASSERT_TRUE(a);
+  ASSERT_FALSE(cache.empty());
+  ASSERT_EQ(a, cache.lookup_or_create(make_oid(0)));
+  ASSERT_EQ(a, cache.lookup(make_oid(0)));
+
+  ObjectContextRef b = cache.lookup_or_create(make_oid(4));
+  ASSERT_NE(a, b);
+  ASSERT_FALSE(cache.lookup(make_oid(0, 1)));
+
+  a.reset();
+  b.reset();
+  cache.clear();
+  ASSERT_TRUE(cache.empty());
+  ASSERT_FALSE(cache.lookup(make_oid(0)));
+}
+
+TEST(ObjectContextCache, count_limit) {
+  const unsigned SIZE = 8;
+  ObjectContextCache cache(g_ceph_context, 0, SIZE);
+  for (unsigned i = 0; i < SIZE * 10; ++i)
+    cache.lookup_or_create(make_oid(i));
+  for (unsigned i = 0; i < SIZE * 9; ++i)
+    ASSERT_FALSE(cache.lookup(make_oid(i)));
+  for (unsigned i = SIZE * 9; i < SIZE * 10; ++i)
+    ASSERT_TRUE(cache.lookup(make_oid(i)));
+  cache.clear();
+  ASSERT_TRUE(cache.empty());
+}
+
+TEST(ObjectContextCache, byte_limit) {
+  ObjectContextCache cache(g_ceph_context, 1 << 20, 0);
+  ObjectContextRef held = cache.lookup_or_create(make_oid(0));
+  for (unsigned i = 1; i < 100; ++i)
+    cache.lookup_or_create(make_oid(i));
+  ASSERT_GT(cache.get_bytes(), 0u);
+  ASSERT_LE(cache.get_bytes(), 1u << 20);
+
+  // shrinking the budget unpins everything, but a referenced context
+  // must still be found
+  cache.set_limits(1, 0);
+  ASSERT_EQ(0u, cache.get_bytes());
+  ASSERT_FALSE(cache.lookup(make_oid(1)));
+  ASSERT_EQ(held, cache.lookup(make_oid(0)));
+
+  held.reset();
+  cache.clear();
+  ASSERT_TRUE(cache.empty());
+}
+
+TEST(ObjectContextCache, get_all) {
+  // enough to grow the index a few times
+  ObjectContextCache cache(g_ceph_context, 0, 1000);
+  for (unsigned i = 0; i < 500; ++i)
+    cache.lookup_or_create(make_oid(i));
+  for (unsigned i = 0; i < 500; ++i)
+    ASSERT_TRUE(cache.lookup(make_oid(i)));
+  list<ObjectContextRef> ls;
+  cache.get_all(&ls);
+  ASSERT_EQ(500u, ls.size());
+  ls.clear();
+  cache.clear();
+  cache.get_all(&ls);
+  ASSERT_TRUE(ls.empty());
+}
+
+TEST(ObjectContextCache, snapset) {
+  ObjectContextCache cache(g_ceph_context, 0, 100);
+  hobject_t snapdir = make_oid(0).get_snapdir();
+  SnapSetContext ssc(snapdir);
+  {
+    Mutex::Locker l(cache.get_snapset_lock());
+    ASSERT_EQ((SnapSetContext*)NULL, cache._lookup_snapset(snapdir));
+    cache._register_snapset(&ssc);
+    ASSERT_EQ(&ssc, cache._lookup_snapset(snapdir));
+  }
+
+  // the snapdir context shares the index entry with the snapset
+  ObjectContextRef obc = cache.lookup_or_create(snapdir);
+  obc.reset();
+  cache.clear();
+  ASSERT_TRUE(cache.empty());
+  {
+    Mutex::Locker l(cache.get_snapset_lock());
+    ASSERT_EQ(&ssc, cache._lookup_snapset(snapdir));
+    cache._unregister_snapset(&ssc);
+    ASSERT_EQ((SnapSetContext*)NULL, cache._lookup_snapset(snapdir));
+  }
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make unittest_object_context_cache && ./unittest_object_context_cache"
+// End:
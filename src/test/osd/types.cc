@@ -1282,6 +1282,53 @@ TEST(pg_pool_t_test, get_random_pg_position) {
   }
 }
 
+TEST(pg_stat_t, delta) {
+  pg_stat_t base;
+  base.version = eversion_t(10, 100);
+  base.reported_epoch = 10;
+  base.reported_seq = 50;
+  base.state = PG_STATE_ACTIVE;
+  base.last_fresh = utime_t(100, 0);
+  base.last_active = base.last_fresh;
+  base.last_clean = utime_t(90, 0);
+  base.stats.sum.num_bytes = 4096;
+  base.up.push_back(1);
+  base.acting.push_back(1);
+
+  pg_stat_t cur = base;
+  cur.version = eversion_t(10, 101);
+  cur.reported_seq = 51;
+  cur.state = PG_STATE_ACTIVE | PG_STATE_CLEAN;
+  cur.last_fresh = utime_t(105, 0);
+  cur.last_active = cur.last_fresh;
+  cur.last_clean = utime_t(103, 0);
+  cur.stats.sum.num_bytes = 8192;
+
+  bufferlist delta;
+  cur.encode_delta(base, delta);
+  bufferlist full;
+  ::encode(cur, full);
+  ASSERT_LT(delta.length(), full.length());
+
+  // applied to its base the delta yields cur
+  pg_stat_t s = base;
+  bufferlist::iterator p = delta.begin();
+  ASSERT_TRUE(s.apply_delta(p));
+  ASSERT_TRUE(p.end());
+  bufferlist out;
+  ::encode(s, out);
+  ASSERT_TRUE(out.contents_equal(full));
+
+  // anything else is left alone
+  s = cur;
+  p = delta.begin();
+  ASSERT_FALSE(s.apply_delta(p));
+  ASSERT_TRUE(p.end());
+  out.clear();
+  ::encode(s, out);
+  ASSERT_TRUE(out.contents_equal(full));
+}
+
 TEST(shard_id_t, iostream) {
     set<shard_id_t> shards;
     shards.insert(shard_id_t(0));
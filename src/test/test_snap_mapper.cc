@@ -366,6 +366,25 @@ public:
       cur = next.first;
     }
   }
+  void get_next_range() {
+    string cur = *rand_choose(names);
+    string end = *rand_choose(names);
+    unsigned max = 1 + rand() % 10;
+    vector<pair<string, bufferlist> > got;
+    int r = cache->get_next_range(cur, end, max, &got);
+    ASSERT_EQ(0, r);
+
+    map<string, bufferlist>::iterator i = truth.upper_bound(cur);
+    for (vector<pair<string, bufferlist> >::iterator j = got.begin();
+	 j != got.end();
+	 ++i, ++j) {
+      ASSERT_TRUE(i != truth.end());
+      ASSERT_EQ(i->first, j->first);
+      assert_bl_eq(i->second, j->second);
+    }
+    if (got.size() < max)
+      ASSERT_TRUE(i == truth.end() || !(i->first < end));
+  }
   virtual void SetUp() {
     driver.reset(new PausyAsyncMap());
     cache.reset(new MapCacher::MapCacher<string, bufferlist>(driver.get()));
@@ -420,7 +439,7 @@ TEST_F(MapCacherTest, Random)
     if (!(i % 50)) {
       std::cout << "On iteration " << i << std::endl;
     }
-    switch (rand() % 4) {
+    switch (rand() % 5) {
     case 0:
       get();
       break;
@@ -433,6 +452,9 @@ TEST_F(MapCacherTest, Random)
     case 3:
       remove();
       break;
+    case 4:
+      get_next_range();
+      break;
     }
   }
 }
@@ -543,6 +565,51 @@ public:
     snap_to_hobject.erase(snap);
   }
 
+  void trim_snap_batched() {
+    Mutex::Locker l(lock);
+    if (snap_to_hobject.empty())
+      return;
+    map<snapid_t, set<hobject_t> >::iterator snap =
+      rand_choose(snap_to_hobject);
+    set<hobject_t> hobjects = snap->second;
+
+    vector<hobject_t> batch;
+    while (mapper->get_next_objects_to_trim(
+	     snap->first, 1 + rand() % 10, &batch) == 0) {
+      for (vector<hobject_t>::iterator i = batch.begin();
+	   i != batch.end();
+	   ++i) {
+	const hobject_t &hoid = *i;
+	assert(!hoid.is_max());
+	assert(hobjects.count(hoid));
+	hobjects.erase(hoid);
+
+	map<hobject_t, set<snapid_t> >::iterator j =
+	  hobject_to_snap.find(hoid);
+	assert(j->second.count(snap->first));
+	set<snapid_t> old_snaps(j->second);
+	j->second.erase(snap->first);
+
+	{
+	  PausyAsyncMap::Transaction t;
+	  mapper->update_snaps(
+	    hoid,
+	    j->second,
+	    &old_snaps,
+	    &t);
+	  driver->submit(&t);
+	}
+	if (j->second.empty()) {
+	  hobject_to_snap.erase(j);
+	}
+      }
+      batch.clear();
+    }
+    assert(hobjects.empty());
+
+    snap_to_hobject.erase(snap);
+  }
+
   void remove_oid() {
     Mutex::Locker l(lock);
     if (hobject_to_snap.empty())
@@ -620,7 +687,7 @@ protected:
     for (int i = 0; i < 5000; ++i) {
       if (!(i % 50))
 	std::cout << i << std::endl;
-      switch (rand() % 5) {
+      switch (rand() % 6) {
       case 0:
 	get_tester().create_snap();
 	break;
@@ -636,6 +703,9 @@ protected:
       case 4:
 	get_tester().remove_oid();
 	break;
+      case 5:
+	get_tester().trim_snap_batched();
+	break;
       }
     }
   }
@@ -648,6 +718,14 @@ TEST_F(SnapMapperTest, Simple) {
   get_tester().trim_snap();
 }
 
+TEST_F(SnapMapperTest, SimpleBatched) {
+  init(1);
+  get_tester().create_snap();
+  for (int i = 0; i < 50; ++i)
+    get_tester().create_object();
+  get_tester().trim_snap_batched();
+}
+
 TEST_F(SnapMapperTest, More) {
   init(1);
   run();